@@ -1,6 +1,7 @@
 #include <gtk/gtk.h>
 
 #include "analysis_panel.h"
+#include "ui-queue.h"
 
 static GtkWidget* score_label;
 static GtkWidget* line_label;
@@ -64,31 +65,21 @@ GtkWidget *create_analysis_panel(void) {
 }
 
 void set_analysis_score(const char *score_value) {
-	gdk_threads_enter();
-	gtk_label_set_text(GTK_LABEL(score_label), score_value);
-	gdk_threads_leave();
+	ui_queue_label_text(score_label, score_value, FALSE);
 }
 
 void set_analysis_best_line(const char *best_line) {
-	gdk_threads_enter();
-	gtk_label_set_text(GTK_LABEL(line_label), best_line);
-	gdk_threads_leave();
+	ui_queue_label_text(line_label, best_line, FALSE);
 }
 
 void set_analysis_depth(const char *depth) {
-	gdk_threads_enter();
-	gtk_label_set_text(GTK_LABEL(depth_label), depth);
-	gdk_threads_leave();
+	ui_queue_label_text(depth_label, depth, FALSE);
 }
 
 void set_analysis_nodes_per_second(const char *nps) {
-	gdk_threads_enter();
-	gtk_label_set_text(GTK_LABEL(nps_label), nps);
-	gdk_threads_leave();
+	ui_queue_label_text(nps_label, nps, FALSE);
 }
 
 void set_analysis_engine_name(const char *engine_name) {
-	gdk_threads_enter();
-	gtk_label_set_text(GTK_LABEL(engine_name_label), engine_name);
-	gdk_threads_leave();
+	ui_queue_label_text(engine_name_label, engine_name, FALSE);
 }
\ No newline at end of file
@@ -0,0 +1,463 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <gtk/gtk.h>
+
+#include "board-context.h"
+#include "chess-backend.h"
+
+static const char *FONT_FACE = "Sans";
+
+#define BOARD_LAYERS_CACHE_SIZE 4 // both orientations of the main board and observation tiles sizes
+
+typedef struct {
+	int width;
+	int height;
+	int scale;
+	bool flipped;
+	double colours[6]; // dark then light square rgb
+	unsigned long last_used; // 0 when the slot is empty
+	cairo_surface_t *board;
+	cairo_surface_t *coordinates;
+} board_layers;
+
+static board_layers board_layers_cache[BOARD_LAYERS_CACHE_SIZE];
+static unsigned long board_layers_use_counter = 0;
+
+board_context *board_context_new(GtkWidget *widget, chess_game *game) {
+	board_context *ctx = calloc(1, sizeof(board_context));
+	if (ctx == NULL) {
+		perror("Failed to allocate board context");
+		return NULL;
+	}
+	ctx->widget = widget;
+	ctx->game = game;
+	pthread_mutex_init(&ctx->damage_lock, NULL);
+	return ctx;
+}
+
+void board_context_free(board_context *ctx) {
+	if (ctx == NULL) {
+		return;
+	}
+	sprite_cache_release(ctx->sprites);
+	cairo_surface_destroy(ctx->board_layer);
+	cairo_surface_destroy(ctx->coordinates_layer);
+	cairo_surface_destroy(ctx->pieces_layer);
+	cairo_surface_destroy(ctx->cache_layer);
+	if (ctx->damage != NULL) {
+		cairo_region_destroy(ctx->damage);
+	}
+	pthread_mutex_destroy(&ctx->damage_lock);
+	free(ctx);
+}
+
+/* Device scale factor of the board window, 1 until it is realized */
+int board_context_scale_factor(board_context *ctx) {
+	return ctx->widget != NULL ? gtk_widget_get_scale_factor(ctx->widget) : 1;
+}
+
+/* Create a layer in the board window's native image format and device scale,
+ * so that compositing layers and blitting them to the window is a plain copy
+ * Opaque layers use CAIRO_CONTENT_COLOR */
+cairo_surface_t *board_context_create_layer(board_context *ctx, cairo_content_t content, int width, int height) {
+	cairo_format_t format = content == CAIRO_CONTENT_COLOR ? CAIRO_FORMAT_RGB24 : CAIRO_FORMAT_ARGB32;
+	GdkWindow *window = ctx->widget != NULL ? gtk_widget_get_window(ctx->widget) : NULL;
+	if (window == NULL) {
+		// not realized yet
+		return cairo_image_surface_create(format, width, height);
+	}
+	return gdk_window_create_similar_image_surface(window, format, width, height, gdk_window_get_scale_factor(window));
+}
+
+/* Whole pixel bounds of a square, see square_edge */
+void board_context_square(board_context *ctx, int col, int row, int width, int height, cairo_rectangle_int_t *rect) {
+	int a = ctx->flipped ? 7 - col : col;
+	int b = ctx->flipped ? row : 7 - row;
+	rect->x = square_edge(a, width);
+	rect->y = square_edge(b, height);
+	rect->width = square_edge(a + 1, width) - rect->x;
+	rect->height = square_edge(b + 1, height) - rect->y;
+}
+
+/* Whole pixel cell covered by a piece sprite centred on x,y
+ * Sprites are wi/8 x hi/8, squares may be one pixel larger (see square_edge) */
+void piece_cell(double x, double y, int wi, int hi, cairo_rectangle_int_t *cell) {
+	cell->width = wi / 8;
+	cell->height = hi / 8;
+	cell->x = (int) floor(x - cell->width / 2.0 + 0.5);
+	cell->y = (int) floor(y - cell->height / 2.0 + 0.5);
+}
+
+void piece_rectangle(cairo_t *dc, double x, double y, int wi, int hi) {
+	cairo_rectangle_int_t cell;
+	piece_cell(x, y, wi, hi, &cell);
+	cairo_rectangle(dc, cell.x, cell.y, cell.width, cell.height);
+}
+
+/* Use a piece sprite centred on x,y as source
+ * Whole pixel offset and nearest filter let pixman do a plain blit instead of a filtered composite */
+void set_piece_source(cairo_t *dc, cairo_surface_t *surf, double x, double y, int wi, int hi) {
+	cairo_rectangle_int_t cell;
+	piece_cell(x, y, wi, hi, &cell);
+	cairo_set_source_surface(dc, surf, cell.x, cell.y);
+	cairo_pattern_set_filter(cairo_get_source(dc), CAIRO_FILTER_NEAREST);
+}
+
+/* Hold the shared sprite set for this square size, giving back the previous one */
+void board_context_set_sprites(board_context *ctx, int width, int height) {
+	sprite_set *previous = ctx->sprites;
+	ctx->sprites = sprite_cache_acquire(theme_dir, width / 8, height / 8, board_context_scale_factor(ctx));
+	sprite_cache_release(previous);
+}
+
+static void render_board_layers(board_context *ctx, int width, int height, bool flipped, cairo_surface_t **board_surface, cairo_surface_t **coordinates_surface) {
+
+	int j,k;
+	double tx = width / 8.0;
+	double ty = height / 8.0;
+	int edge_x[9], edge_y[9];
+	for (j = 0; j <= 8; j++) {
+		edge_x[j] = square_edge(j, width);
+		edge_y[j] = square_edge(j, height);
+	}
+
+	// Create a "memory-buffer" surface to draw on
+	*board_surface = board_context_create_layer(ctx, CAIRO_CONTENT_COLOR, width, height);
+	cairo_t *cr = cairo_create(*board_surface);
+
+	*coordinates_surface = board_context_create_layer(ctx, CAIRO_CONTENT_COLOR_ALPHA, width, height);
+	cairo_t *coordinates_cr = cairo_create(*coordinates_surface);
+
+	cairo_pattern_t *dark_square_pattern = cairo_pattern_create_rgb(dr, dg, db);
+	cairo_pattern_t *light_square_pattern = cairo_pattern_create_rgb(lr, lg, lb);
+
+	// Shading on light squares
+	cairo_pattern_t *light_gradient_pattern = cairo_pattern_create_radial(.0, .0, .0, .0, .0, (tx + ty) / 3.0f);
+	cairo_pattern_add_color_stop_rgba(light_gradient_pattern, 0.0f, dr, dg, db, 0.25f);
+	cairo_pattern_add_color_stop_rgba(light_gradient_pattern, 1.0f, dr, dg, db, 0.0f);
+
+	// Highlight on dark squares
+	cairo_pattern_t *dark_gradient_pattern = cairo_pattern_create_radial(tx, ty, .0, tx, ty, (tx + ty) / 3.0f);
+	cairo_pattern_add_color_stop_rgba(dark_gradient_pattern, 0.0f, lr, lg, lb, 0.25f);
+	cairo_pattern_add_color_stop_rgba(dark_gradient_pattern, 1.0f, 1, 1, 1, 0.0f);
+
+	// Draw Dark Squares
+	cairo_set_source(cr, dark_square_pattern);
+	for (j = 0; j < 8; j++) {
+		for (k = 0; k < 8; k++) {
+			if (get_square_colour(j, k)) {
+				cairo_rectangle(cr, edge_x[j], edge_y[k], edge_x[j + 1] - edge_x[j], edge_y[k + 1] - edge_y[k]);
+				cairo_fill(cr);
+
+				// Inner shadow effect
+				cairo_save(cr);
+				cairo_translate(cr, edge_x[j], edge_y[k]);
+				cairo_set_source (cr, dark_gradient_pattern);
+				cairo_rectangle(cr, 0, 0, edge_x[j + 1] - edge_x[j], edge_y[k + 1] - edge_y[k]);
+				cairo_fill(cr);
+				cairo_restore(cr);
+
+			}
+		}
+	}
+
+	// Draw Light Squares
+	cairo_set_source(cr, light_square_pattern);
+	for (j = 0; j < 8; j++) {
+		for (k = 0; k < 8; k++) {
+			if (!get_square_colour(j, k)) {
+				cairo_rectangle(cr, edge_x[j], edge_y[k], edge_x[j + 1] - edge_x[j], edge_y[k + 1] - edge_y[k]);
+				cairo_fill(cr);
+
+				cairo_save(cr);
+				cairo_translate(cr, edge_x[j], edge_y[k]);
+				cairo_set_source (cr, light_gradient_pattern);
+				cairo_rectangle(cr, 0, 0, edge_x[j + 1] - edge_x[j], edge_y[k + 1] - edge_y[k]);
+				cairo_fill(cr);
+				cairo_restore(cr);
+			}
+		}
+	}
+
+	// Draw smoothing lines between squares
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+	cairo_set_source_rgb(cr, (dr + lr) / 2.0f, (dg + lg) / 2.0f, (db + lb) / 2.0f);
+	cairo_set_line_width(cr, 1.0f);
+
+	// Vertical lines
+	for (j = 0; j <= 8; j++) {
+		cairo_move_to (cr, edge_x[j], 0);
+		cairo_line_to(cr, edge_x[j], height);
+	}
+	// Horizontal lines
+	for (j = 0; j <= 8; j++) {
+		cairo_move_to (cr, 0, edge_y[j]);
+		cairo_line_to(cr, width, edge_y[j]);
+	}
+	cairo_stroke (cr);
+
+	// Draw coordinates
+	PangoFontDescription *desc;
+	PangoLayout *layout;
+	layout = pango_cairo_create_layout(coordinates_cr);
+	char font_str[32];
+	float font_size = (float) (10 * tx / 100.0f);
+	sprintf(font_str, "%s %.1f", FONT_FACE, font_size);
+	desc = pango_font_description_from_string(font_str);
+	pango_font_description_set_weight(desc, PANGO_WEIGHT_SEMIBOLD);
+	pango_layout_set_font_description(layout, desc);
+	pango_font_description_free(desc);
+
+	double padding = tx / 60.0;
+	char coord[1];
+	bool light;
+
+	// Column names
+	light = true;
+	for (j = 0; j <= 8; j++) {
+		cairo_save(coordinates_cr);
+		cairo_set_source(coordinates_cr, light ? light_square_pattern : dark_square_pattern);
+		coord[0] = (char) (flipped ? 'h' - j : 'a' + j);
+		pango_layout_set_text(layout, coord, 1);
+		int pix_width;
+		int pix_height;
+		pango_layout_get_pixel_size(layout, &pix_width, &pix_height);
+		cairo_translate(coordinates_cr, edge_x[j] + padding, height - pix_height - padding);
+		pango_cairo_show_layout(coordinates_cr, layout);
+		cairo_restore(coordinates_cr);
+		light = !light;
+	}
+
+	// Rank numbers
+	light = true;
+	for (j = 0; j <= 8; j++) {
+		cairo_save(coordinates_cr);
+		cairo_set_source(coordinates_cr, light ? light_square_pattern : dark_square_pattern);
+		coord[0] = (char) (flipped ? '1' + j : '8' - j);
+		pango_layout_set_text(layout, coord, 1);
+		int pix_width;
+		int pix_height;
+		pango_layout_get_pixel_size(layout, &pix_width, &pix_height);
+		cairo_translate(coordinates_cr, width - pix_width - padding, edge_y[j] + padding);
+		pango_cairo_show_layout(coordinates_cr, layout);
+		cairo_restore(coordinates_cr);
+		light = !light;
+	}
+
+	cairo_destroy(cr);
+	cairo_destroy(coordinates_cr);
+	cairo_pattern_destroy(dark_square_pattern);
+	cairo_pattern_destroy(light_square_pattern);
+	cairo_pattern_destroy(dark_gradient_pattern);
+	cairo_pattern_destroy(light_gradient_pattern);
+}
+
+/* Point the board and coordinates layers at the ones for this size, scale, orientation and colours,
+ * only rendering them if they are not cached
+ * The cache is shared by all boards */
+void board_context_draw_board(board_context *ctx, int width, int height) {
+	int i;
+	int scale = board_context_scale_factor(ctx);
+	bool flipped = ctx->flipped;
+	double colours[6] = {dr, dg, db, lr, lg, lb};
+
+	board_layers *layers = NULL;
+	for (i = 0; i < BOARD_LAYERS_CACHE_SIZE; i++) {
+		board_layers *cached = &board_layers_cache[i];
+		if (cached->last_used && cached->width == width && cached->height == height && cached->scale == scale && cached->flipped == flipped &&
+		    !memcmp(cached->colours, colours, sizeof(colours))) {
+			layers = cached;
+			break;
+		}
+	}
+
+	if (layers == NULL) {
+		// evict the least recently used entry
+		layers = &board_layers_cache[0];
+		for (i = 1; i < BOARD_LAYERS_CACHE_SIZE && layers->last_used; i++) {
+			if (board_layers_cache[i].last_used < layers->last_used) {
+				layers = &board_layers_cache[i];
+			}
+		}
+		cairo_surface_destroy(layers->board);
+		cairo_surface_destroy(layers->coordinates);
+		render_board_layers(ctx, width, height, flipped, &layers->board, &layers->coordinates);
+		layers->width = width;
+		layers->height = height;
+		layers->scale = scale;
+		layers->flipped = flipped;
+		memcpy(layers->colours, colours, sizeof(colours));
+	}
+	layers->last_used = ++board_layers_use_counter;
+
+	// the layers in use keep their own reference, so evicting them from the cache is safe
+	cairo_surface_destroy(ctx->board_layer);
+	ctx->board_layer = cairo_surface_reference(layers->board);
+	cairo_surface_destroy(ctx->coordinates_layer);
+	ctx->coordinates_layer = cairo_surface_reference(layers->coordinates);
+}
+
+
+/* Render the pieces of the context's game onto a fresh pieces layer */
+void board_context_draw_pieces(board_context *ctx, int width, int height) {
+	int i, j;
+
+	cairo_surface_destroy(ctx->pieces_layer);
+	ctx->pieces_layer = board_context_create_layer(ctx, CAIRO_CONTENT_COLOR_ALPHA, width, height);
+	if (ctx->sprites == NULL) {
+		return;
+	}
+
+	cairo_t *dc = cairo_create(ctx->pieces_layer);
+	for (i = 0; i < 16; i++) {
+		chess_piece *pieces[2] = {&ctx->game->white_set[i], &ctx->game->black_set[i]};
+		for (j = 0; j < 2; j++) {
+			if (pieces[j]->dead) {
+				continue;
+			}
+			cairo_rectangle_int_t square;
+			board_context_square(ctx, pieces[j]->pos.column, pieces[j]->pos.row, width, height, &square);
+			double x = square.x + square.width / 2.0;
+			double y = square.y + square.height / 2.0;
+			set_piece_source(dc, sprite_set_surface(ctx->sprites, pieces[j]->type), x, y, width, height);
+			piece_rectangle(dc, x, y, width, height);
+			cairo_fill(dc);
+		}
+	}
+	cairo_destroy(dc);
+}
+
+void board_context_paint_layers(board_context *ctx, cairo_t *dc, int width, int height) {
+	// Board
+	cairo_set_operator(dc, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(dc, ctx->board_layer, 0.0f, 0.0f);
+	cairo_paint(dc);
+
+	cairo_set_operator(dc, CAIRO_OPERATOR_OVER);
+
+	// Under light
+	board_context_paint_highlights(ctx, dc, width, height);
+
+	// Coordinates
+	cairo_set_source_surface(dc, ctx->coordinates_layer, 0.0f, 0.0f);
+	cairo_paint(dc);
+
+	// Pieces
+	cairo_set_source_surface(dc, ctx->pieces_layer, 0.0f, 0.0f);
+	cairo_paint(dc);
+}
+
+void board_context_clear_highlights(board_context *ctx) {
+	ctx->highlights_count = 0;
+}
+
+// Remove all highlights of a square
+void board_context_clean_highlights(board_context *ctx, int col, int row) {
+	int i, kept = 0;
+	for (i = 0; i < ctx->highlights_count; i++) {
+		if (ctx->highlights[i].col != col || ctx->highlights[i].row != row) {
+			ctx->highlights[kept++] = ctx->highlights[i];
+		}
+	}
+	ctx->highlights_count = kept;
+}
+
+void board_context_add_highlight(board_context *ctx, int col, int row, bool check, double r, double g, double b, double a) {
+	if (ctx->highlights_count == MAX_SQUARE_HIGHLIGHTS) {
+		// drop the oldest
+		memmove(ctx->highlights, ctx->highlights + 1, (MAX_SQUARE_HIGHLIGHTS - 1) * sizeof(square_highlight));
+		ctx->highlights_count--;
+	}
+	square_highlight *highlight = &ctx->highlights[ctx->highlights_count++];
+	highlight->col = col;
+	highlight->row = row;
+	highlight->check = check;
+	highlight->r = r;
+	highlight->g = g;
+	highlight->b = b;
+	highlight->a = a;
+}
+
+/* Paint the highlights of the squares intersecting the clip of dc
+ * The current path of dc is preserved */
+void board_context_paint_highlights(board_context *ctx, cairo_t *dc, int width, int height) {
+	if (!ctx->highlights_count) {
+		return;
+	}
+
+	double clip_x1, clip_y1, clip_x2, clip_y2;
+	cairo_clip_extents(dc, &clip_x1, &clip_y1, &clip_x2, &clip_y2);
+
+	cairo_path_t *path = cairo_copy_path(dc);
+	cairo_new_path(dc);
+
+	int i;
+	for (i = 0; i < ctx->highlights_count; i++) {
+		square_highlight *highlight = &ctx->highlights[i];
+		cairo_rectangle_int_t square;
+		board_context_square(ctx, highlight->col, highlight->row, width, height, &square);
+		if (square.x >= clip_x2 || square.y >= clip_y2 ||
+		    square.x + square.width <= clip_x1 || square.y + square.height <= clip_y1) {
+			continue;
+		}
+
+		cairo_save(dc);
+		cairo_set_operator(dc, CAIRO_OPERATOR_OVER);
+		cairo_rectangle(dc, square.x, square.y, square.width, square.height);
+		if (highlight->check) {
+			double cx = square.x + square.width / 2.0;
+			double cy = square.y + square.height / 2.0;
+			double half_width = square.width / 2.0;
+			cairo_pattern_t *p = cairo_pattern_create_radial(cx, cy, 1.3 * half_width, cx, cy, 0.5 * half_width);
+			cairo_pattern_add_color_stop_rgba(p, 0, highlight->r, highlight->g, highlight->b, 0);
+			cairo_pattern_add_color_stop_rgba(p, 1, highlight->r, highlight->g, highlight->b, highlight->a);
+			cairo_clip(dc);
+			cairo_set_source(dc, p);
+			cairo_paint(dc);
+			cairo_pattern_destroy(p);
+		} else {
+			cairo_set_source_rgba(dc, highlight->r, highlight->g, highlight->b, highlight->a);
+			cairo_fill(dc);
+		}
+		cairo_restore(dc);
+	}
+
+	cairo_new_path(dc);
+	cairo_append_path(dc, path);
+	cairo_path_destroy(path);
+}
+
+void board_context_damage_rectangle(board_context *ctx, int x, int y, int width, int height) {
+	cairo_rectangle_int_t rect = {x, y, width, height};
+	pthread_mutex_lock(&ctx->damage_lock);
+	if (ctx->damage == NULL) {
+		ctx->damage = cairo_region_create();
+	}
+	cairo_region_union_rectangle(ctx->damage, &rect);
+	pthread_mutex_unlock(&ctx->damage_lock);
+}
+
+void board_context_damage_square(board_context *ctx, int col, int row, int width, int height) {
+	cairo_rectangle_int_t rect;
+	board_context_square(ctx, col, row, width, height, &rect);
+	board_context_damage_rectangle(ctx, rect.x, rect.y, rect.width, rect.height);
+}
+
+/* Damage accumulated so far, which the caller now owns, or NULL if none */
+cairo_region_t *board_context_take_damage(board_context *ctx) {
+	pthread_mutex_lock(&ctx->damage_lock);
+	cairo_region_t *damage = ctx->damage;
+	ctx->damage = NULL;
+	pthread_mutex_unlock(&ctx->damage_lock);
+	return damage;
+}
+
+/* Copy of the damage accumulated so far, or NULL if none */
+cairo_region_t *board_context_peek_damage(board_context *ctx) {
+	pthread_mutex_lock(&ctx->damage_lock);
+	cairo_region_t *damage = ctx->damage != NULL ? cairo_region_copy(ctx->damage) : NULL;
+	pthread_mutex_unlock(&ctx->damage_lock);
+	return damage;
+}
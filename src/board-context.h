@@ -0,0 +1,73 @@
+#ifndef CAIRO_BOARD_BOARD_CONTEXT_H
+#define CAIRO_BOARD_BOARD_CONTEXT_H
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <gtk/gtk.h>
+
+#include "cairo-board.h"
+#include "sprite-cache.h"
+
+/* Rendering state of one board widget
+ * The main board and any other board shown by the process each own one,
+ * boards of the same size share their piece sprites through the sprite cache
+ * Dragging, animations and move input only exist on the main board */
+
+#define MAX_SQUARE_HIGHLIGHTS 16
+
+typedef struct {
+	int col;
+	int row;
+	bool check; // radial check warning instead of a plain fill
+	double r, g, b, a;
+} square_highlight;
+
+typedef struct {
+	GtkWidget *widget;
+	chess_game *game;
+	bool flipped;
+
+	sprite_set *sprites; // NULL until the first board_context_set_sprites
+
+	cairo_surface_t *board_layer;
+	cairo_surface_t *coordinates_layer;
+	cairo_surface_t *pieces_layer;
+	cairo_surface_t *cache_layer; // all layers composited, blitted to the widget
+
+	// Square highlights, painted under the coordinates and pieces in the order they were added
+	square_highlight highlights[MAX_SQUARE_HIGHLIGHTS];
+	int highlights_count;
+
+	// Regions of cache_layer whose layers changed since it was last composited
+	cairo_region_t *damage;
+	pthread_mutex_t damage_lock;
+} board_context;
+
+board_context *board_context_new(GtkWidget *widget, chess_game *game);
+void board_context_free(board_context *ctx);
+
+cairo_surface_t *board_context_create_layer(board_context *ctx, cairo_content_t content, int width, int height);
+int board_context_scale_factor(board_context *ctx);
+
+void board_context_square(board_context *ctx, int col, int row, int width, int height, cairo_rectangle_int_t *rect);
+
+void board_context_set_sprites(board_context *ctx, int width, int height);
+void board_context_draw_board(board_context *ctx, int width, int height);
+void board_context_draw_pieces(board_context *ctx, int width, int height);
+void board_context_paint_layers(board_context *ctx, cairo_t *dc, int width, int height);
+
+void board_context_clear_highlights(board_context *ctx);
+void board_context_clean_highlights(board_context *ctx, int col, int row);
+void board_context_add_highlight(board_context *ctx, int col, int row, bool check, double r, double g, double b, double a);
+void board_context_paint_highlights(board_context *ctx, cairo_t *dc, int width, int height);
+
+void board_context_damage_rectangle(board_context *ctx, int x, int y, int width, int height);
+void board_context_damage_square(board_context *ctx, int col, int row, int width, int height);
+cairo_region_t *board_context_take_damage(board_context *ctx);
+cairo_region_t *board_context_peek_damage(board_context *ctx);
+
+void piece_cell(double x, double y, int wi, int hi, cairo_rectangle_int_t *cell);
+void piece_rectangle(cairo_t *dc, double x, double y, int wi, int hi);
+void set_piece_source(cairo_t *dc, cairo_surface_t *surf, double x, double y, int wi, int hi);
+
+#endif //CAIRO_BOARD_BOARD_CONTEXT_H
@@ -13,14 +13,18 @@
 #include <wchar.h>
 
 #include "clocks.h"
+#include "logging.h"
 
-/* debug macro */
+/* Logging macros, format into the calling thread's log ring when the file's
+ * subsystem is logged at that level, see logging.h */
 #ifndef debug
 #ifdef colour_console
-void debug(format, ...) { if (debug_flag) fprintf(stdout, "%s:\033[31m%d\033[0m " format, __FUNCTION__, __LINE__, ##__VA_ARGS__)
+#define log_at(level, format, ...) do { if (log_enabled(LOG_SUBSYSTEM, level)) fprintf(stdout, "%s:\033[31m%d\033[0m " format, __FUNCTION__, __LINE__, ##__VA_ARGS__); } while (0)
 #else
-#define debug(format, ...) if (debug_flag) fprintf(stdout, "%s:%d " format, __FUNCTION__, __LINE__, ##__VA_ARGS__)
+#define log_at(level, format, ...) do { if (log_enabled(LOG_SUBSYSTEM, level)) log_write(LOG_SUBSYSTEM, level, "%s:%d " format, __FUNCTION__, __LINE__, ##__VA_ARGS__); } while (0)
 #endif
+#define log_info(format, ...) log_at(LOG_INFO, format, ##__VA_ARGS__)
+#define debug(format, ...) log_at(LOG_DEBUG, format, ##__VA_ARGS__)
 #endif
 
 // Arg values for getopt
@@ -39,6 +43,10 @@ void debug(format, ...) { if (debug_flag) fprintf(stdout, "%s:\033[31m%d\033[0m
 #define ICS_TEST_HANDLE1	13
 #define ICS_TEST_HANDLE2	14
 #define ICS_TEST_PLAYER1	15
+#define TRACE_FILE_ARG		16
+#define LOG_LEVELS_ARG		17
+#define LOG_FILE_ARG		18
+#define CLOCK_CSV_ARG		19
 
 // base unicode char for chess fonts
 #define BASE_CHESS_UNICODE_CHAR 0x2654
@@ -109,6 +117,8 @@ typedef struct {
 	char black_rating[32];
 
 	char *moves_list; // String of the current moves list in SAN notation
+	size_t moves_list_len; // Length of moves_list, excluding the NULL terminator
+	size_t moves_list_size; // Bytes allocated for moves_list
 
 	unsigned int ply_num;
 
@@ -152,9 +162,12 @@ enum {
 
 struct anim_data {
 	chess_piece *piece;
-	double **plots;
-	int n_plots;
-	int step_index;
+	double start[2]; // path runs start->mid->end, mid is the elbow for knights
+	double mid[2];
+	double end[2];
+	gint64 start_time; // frame time of the first frame, 0 until it is painted
+	gint64 duration;
+	double prev_xy[2]; // position painted on the previous frame
 	int old_col;
 	int old_row;
 	int new_col;
@@ -163,6 +176,7 @@ struct anim_data {
 	int promo_type;
 	int move_source;
 	int killed_by;
+	struct anim_data *next_free; // link in the pool's free list
 };
 
 enum {
@@ -252,6 +266,7 @@ extern bool game_started;
 extern long my_game;
 
 extern gboolean debug_flag;
+extern gboolean startup_trace_flag;
 extern gboolean use_fig;
 extern gboolean ics_mode;
 extern bool guest_mode;
@@ -262,6 +277,7 @@ extern unsigned short ics_port;
 extern char my_password[128];
 
 extern double svg_w, svg_h;
+extern char theme_dir[];
 extern double dr,dg, db;
 extern double lr, lg, lb;
 extern double highlight_selected_r, highlight_selected_g, highlight_selected_b, highlight_selected_a;
@@ -296,6 +312,7 @@ extern int p_old_col, p_old_row;
 extern plys_list *main_list;
 
 void get_last_move_xy(int *x, int*y);
+void set_last_move_xy(int x, int y);
 void get_last_release_xy(int *x, int*y);
 void get_dragging_prev_xy(double *x, double*y);
 void set_dragging_prev_xy(double, double);
@@ -328,6 +345,8 @@ int colorise_type(int tt, int colour);
 void assign_surfaces();
 void piece_to_xy(chess_piece *piece, double *xy ,int wi, int hi);
 void loc_to_xy(int column, int row, double *xy, int wi, int hi);
+void loc_to_rectangle(int column, int row, cairo_rectangle_int_t *rect, int wi, int hi);
+int square_edge(int i, int size);
 int char_to_type(int whose_turn, char c);
 char type_to_char(int);
 char type_to_fen_char(int type);
@@ -339,14 +358,17 @@ void check_ending_clause(chess_game *game);
 void xy_to_loc(int x, int y, int *pos, int wi, int hi);
 chess_square *xy_to_square(chess_game *game, int x, int y, int wi, int hi);
 void flip_board(int wi, int hi);
+void startup_trace(const char *phase, gint64 since);
 wint_t type_to_unicode_char(int type);
 bool can_i_move_piece(chess_piece* piece);
 void set_last_move(char *move);
 void start_game(char *w_name, char *b_name, int seconds, int increment, int relation, bool should_lock);
+void reset_position(chess_game *game);
 void end_game(void);
 void update_eco_tag(bool should_lock_threads);
 void popup_join_channel_dialog(bool lock_threads);
 int resolve_move(chess_game *game, int t, char *move, int resolved_move[4]);
+int open_file(const char *name);
 void add_class(GtkWidget *, const char *);
 void insert_text_moves_list_view(const gchar *text, bool should_lock_threads);
 void refresh_moves_list_view(plys_list *list);
@@ -3,6 +3,7 @@
 #include <string.h>
 
 #include "cairo-board.h"
+#include "ui-queue.h"
 
 #define CHANNEL_BUFFER_MAX_LINES 256
 
@@ -357,30 +358,27 @@ void handle_channel_removed(int removed_channel) {
 	}
 }
 
+static void show_channel_call(gpointer channel_num) {
+	show_channel_function(NULL, channel_num);
+}
+
 void handle_channel_added(int added_channel) {
 	my_channels = g_slist_insert_sorted(my_channels, GINT_TO_POINTER(added_channel), sort_ints);
-	gdk_threads_enter();
-	show_channel_function(NULL, GINT_TO_POINTER(added_channel));
-	gdk_threads_leave();
+	ui_queue_call(show_channel_call, GINT_TO_POINTER(added_channel), NULL);
 }
 
 void show_one_channel(int show_this) {
 	if (is_in_my_channels(show_this)) {
-		gdk_threads_enter();
-		show_channel_function(NULL, GINT_TO_POINTER(show_this));
-		gdk_threads_leave();
+		ui_queue_call(show_channel_call, GINT_TO_POINTER(show_this), NULL);
 	}
 }
 
 void show_my_channels(void) {
 	GSList *chans = my_channels;
-	gdk_threads_enter();
 	while(chans) {
-		int next_chan = GPOINTER_TO_INT(chans->data);
-		show_channel_function(NULL, GINT_TO_POINTER(next_chan));
+		ui_queue_call(show_channel_call, chans->data, NULL);
 		chans = g_slist_next(chans);
 	}
-	gdk_threads_leave();
 }
 
 void show_channel_function(gpointer key, gpointer value) {
@@ -546,7 +544,26 @@ channel *get_channel(int channel_number) {
 	return channel;
 }
 
+struct channel_text {
+	int channel_num;
+	char *username;
+	char *message;
+};
+
+static void insert_channel_text_call(gpointer data) {
+	struct channel_text *text = data;
+	insert_text_channel_view(text->channel_num, text->username, text->message, FALSE);
+}
+
+static void free_channel_text(gpointer data) {
+	struct channel_text *text = data;
+	free(text->username);
+	free(text->message);
+	free(text);
+}
+
 /* Append message at the end of the sample channel buffer
+ * From worker threads (should_lock_threads) the text is copied and appended by the main loop
  * NB: message must be NULL terminated*/
 void insert_text_channel_view(int channel_num, char *username, char *message, gboolean should_lock_threads) {
 
@@ -554,7 +571,16 @@ void insert_text_channel_view(int channel_num, char *username, char *message, gb
 	char *final_message;
 
 	if (should_lock_threads) {
-		gdk_threads_enter();
+		struct channel_text *text = malloc(sizeof(struct channel_text));
+		if (!text) {
+			perror("Failed to allocate channel text");
+			return;
+		}
+		text->channel_num = channel_num;
+		text->username = strdup(username);
+		text->message = strdup(message);
+		ui_queue_call(insert_channel_text_call, text, free_channel_text);
+		return;
 	}
 
 	channel *channel = get_channel(channel_num);
@@ -601,10 +627,6 @@ void insert_text_channel_view(int channel_num, char *username, char *message, gb
 	/* Make the tab active */
 	//gtk_notebook_set_current_page(GTK_NOTEBOOK(channels_notebook), channel->index);
 
-	if (should_lock_threads) {
-		gdk_threads_leave();
-	}
-
 	free(final_username);
 	free(final_message);
 }
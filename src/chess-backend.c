@@ -1,8 +1,12 @@
+#define LOG_SUBSYSTEM LOG_CHESS
+
+#include <stdio.h>
 #include <stdlib.h>
-#include <malloc.h>
+#include <string.h>
 
 #include "chess-backend.h"
 #include "cairo-board.h"
+#include "trace.h"
 
 /* Returns the colour of the square[col][row]
  * 0 -> white
@@ -527,6 +531,7 @@ bool is_move_possible(chess_game *game, chess_piece *piece, int col, int row) {
 }
 
 bool is_move_legal(chess_game *game, chess_piece *piece, int col, int row) {
+	TRACE_FUNCTION();
 
 	// Player can't move if not his turn
 	if (piece->colour != game->whose_turn) {
@@ -1491,7 +1496,11 @@ chess_game *game_new() {
 	}
 	new_game->ply_num = 1;
 	new_game->hash_history_index = 0;
-	new_game->moves_list = calloc(256, SAN_MOVE_SIZE);
+	/* The SAN record is allocated on first append:
+	 * transient games used for legality checks never need one */
+	new_game->moves_list = NULL;
+	new_game->moves_list_len = 0;
+	new_game->moves_list_size = 0;
 	return new_game;
 }
 
@@ -1500,30 +1509,73 @@ void game_free(chess_game *game) {
 	free(game);
 }
 
-void append_san_move(chess_game *game, const char *san_move) {
+/* Makes sure the SAN record can hold at least 'needed' more chars plus the terminating NULL */
+static int reserve_san_moves(chess_game *game, size_t needed) {
+	size_t required = game->moves_list_len + needed + 1;
+	if (required <= game->moves_list_size) {
+		return 0;
+	}
+	size_t new_size = game->moves_list_size ? game->moves_list_size : MOVES_LIST_ALLOC_PAGE_SIZE * SAN_MOVE_SIZE;
+	while (new_size < required) {
+		new_size *= 2;
+	}
+	char *grown = realloc(game->moves_list, new_size);
+	if (!grown) {
+		perror("Realloc moves_list failed");
+		return -1;
+	}
+	game->moves_list = grown;
+	game->moves_list_size = new_size;
+	return 0;
+}
+
+static int format_san_move(chess_game *game, const char *san_move) {
+	char *tail = game->moves_list + game->moves_list_len;
+	size_t room = game->moves_list_size - game->moves_list_len;
+
 	// Whose-turn has already been swapped
-	char *append = calloc(SAN_MOVE_SIZE, sizeof(char));
 	if (game->ply_num == 1) {
-		sprintf(append, "1.%s", san_move);
-	} else {
-		if (game->whose_turn) {
-			sprintf(append, " %d.%s", 1 + (game->ply_num / 2), san_move);
-		} else {
-			sprintf(append, " %s", san_move);
+		return snprintf(tail, room, "1.%s", san_move);
+	}
+	if (game->whose_turn) {
+		return snprintf(tail, room, " %d.%s", 1 + (game->ply_num / 2), san_move);
+	}
+	return snprintf(tail, room, " %s", san_move);
+}
+
+void append_san_move(chess_game *game, const char *san_move) {
+	// Usually enough for " nnn." and the SAN; snprintf tells us if it wasn't
+	if (reserve_san_moves(game, strlen(san_move) + 8)) {
+		return;
+	}
+
+	int written = format_san_move(game, san_move);
+	if (written >= 0 && (size_t) written >= game->moves_list_size - game->moves_list_len) {
+		if (reserve_san_moves(game, (size_t) written)) {
+			game->moves_list[game->moves_list_len] = '\0';
+			return;
 		}
+		written = format_san_move(game, san_move);
+	}
+	if (written < 0) {
+		game->moves_list[game->moves_list_len] = '\0';
+		return;
 	}
 	game->ply_num++;
+	game->moves_list_len += written;
+}
 
-	size_t cur_len = strlen(game->moves_list);
-	size_t append_len = strlen(append);
-	size_t available = malloc_usable_size(game->moves_list);
-	size_t required = cur_len + append_len;
-	while (available < required) {
-		game->moves_list = (char *) realloc(game->moves_list, malloc_usable_size(game->moves_list) * 2);
-		available = malloc_usable_size(game->moves_list);
+/* Empties the SAN record, keeping its allocation for the next game */
+void reset_san_moves(chess_game *game) {
+	game->moves_list_len = 0;
+	if (game->moves_list) {
+		game->moves_list[0] = '\0';
 	}
-	memcpy(game->moves_list + cur_len, append, append_len);
-	free(append);
+	game->ply_num = 1;
+}
+
+const char *get_san_moves(chess_game *game) {
+	return game->moves_list ? game->moves_list : "";
 }
 
 // Saves the current hash to history and increment the hash_index
@@ -17,6 +17,10 @@ int get_square_colour(int col, int row);
 
 void append_san_move(chess_game *game, const char *san_move);
 
+void reset_san_moves(chess_game *game);
+
+const char *get_san_moves(chess_game *game);
+
 int get_possible_moves(chess_game *game, chess_piece *, int[64][2], int);
 
 int get_possible_pre_moves(chess_game *game, chess_piece *, int[64][2], int);
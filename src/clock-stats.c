@@ -0,0 +1,172 @@
+#define LOG_SUBSYSTEM LOG_CLOCK
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <gtk/gtk.h>
+
+#include "clock-stats.h"
+#include "cairo-board.h"
+
+enum {
+	EVENT_UPDATE,
+	EVENT_TICK
+};
+
+typedef struct {
+	int event;
+	int colour;
+	gint64 time; // since the game began
+	gint64 server_us; // update only
+	gint64 local_us; // update only
+	gint64 correction_us; // update: applied to the local time, tick: lateness
+} clock_event;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *csv_path = NULL;
+static GArray *events = NULL; // of the game in progress, NULL between games
+static gint64 game_start;
+static char players[2][64];
+static int games = 0;
+
+void clock_stats_set_csv(const char *file_path) {
+	free(csv_path);
+	csv_path = strdup(file_path);
+}
+
+static int compare_gint64(const void *a, const void *b) {
+	gint64 x = *(const gint64 *) a;
+	gint64 y = *(const gint64 *) b;
+	return x < y ? -1 : x > y;
+}
+
+/* Nearest rank percentile of sorted values */
+static gint64 percentile(const gint64 *sorted, guint count, int p) {
+	guint rank = (p * count + 99) / 100;
+	return sorted[rank ? rank - 1 : 0];
+}
+
+/* Must be called with stats_lock held */
+static void summarise(void) {
+	guint i;
+	guint updates = 0;
+	guint ticks = 0;
+	gint64 drift = 0;
+	gint64 max_correction = 0;
+	gint64 first_update = -1, last_update = 0;
+
+	gint64 *lateness = malloc(events->len * sizeof(gint64));
+	if (lateness == NULL) {
+		perror("Failed to summarise clock stats");
+		return;
+	}
+
+	for (i = 0; i < events->len; i++) {
+		clock_event *e = &g_array_index(events, clock_event, i);
+		if (e->event == EVENT_TICK) {
+			lateness[ticks++] = e->correction_us;
+			continue;
+		}
+		updates++;
+		drift += e->correction_us;
+		if (labs((long) e->correction_us) > labs((long) max_correction)) {
+			max_correction = e->correction_us;
+		}
+		if (first_update < 0) {
+			first_update = e->time;
+		}
+		last_update = e->time;
+	}
+
+	// corrections undo the local clock's drift from the server's
+	double minutes = (last_update - first_update) / 60e6;
+	double drift_per_minute = minutes > 0 ? -drift / 1000.0 / minutes : 0;
+
+	if (ticks) {
+		qsort(lateness, ticks, sizeof(gint64), compare_gint64);
+		log_info("Clock %s vs %s: %u updates, drift %+.1f ms/min, max correction %+.1f ms, "
+		         "%u ticks, jitter p50 %.2f ms p90 %.2f ms p99 %.2f ms\n",
+		         players[0], players[1], updates, drift_per_minute, max_correction / 1000.0, ticks,
+		         percentile(lateness, ticks, 50) / 1000.0, percentile(lateness, ticks, 90) / 1000.0,
+		         percentile(lateness, ticks, 99) / 1000.0);
+	} else {
+		log_info("Clock %s vs %s: %u updates, drift %+.1f ms/min, max correction %+.1f ms, no ticks\n",
+		         players[0], players[1], updates, drift_per_minute, max_correction / 1000.0);
+	}
+	free(lateness);
+}
+
+/* Must be called with stats_lock held */
+static void dump_csv(void) {
+	guint i;
+	FILE *f = fopen(csv_path, "a");
+	if (f == NULL) {
+		perror(csv_path);
+		return;
+	}
+	if (ftell(f) == 0) {
+		fprintf(f, "game,white,black,event,time_ms,colour,server_ms,local_ms,correction_ms,lateness_ms\n");
+	}
+	for (i = 0; i < events->len; i++) {
+		clock_event *e = &g_array_index(events, clock_event, i);
+		if (e->event == EVENT_UPDATE) {
+			fprintf(f, "%d,%s,%s,update,%.3f,%c,%.3f,%.3f,%.3f,\n", games, players[0], players[1],
+			        e->time / 1000.0, e->colour ? 'b' : 'w', e->server_us / 1000.0, e->local_us / 1000.0,
+			        e->correction_us / 1000.0);
+		} else {
+			fprintf(f, "%d,%s,%s,tick,%.3f,%c,,,,%.3f\n", games, players[0], players[1],
+			        e->time / 1000.0, e->colour ? 'b' : 'w', e->correction_us / 1000.0);
+		}
+	}
+	fclose(f);
+}
+
+/* Must be called with stats_lock held */
+static void finish_game(void) {
+	if (events == NULL) {
+		return;
+	}
+	if (events->len) {
+		summarise();
+		if (csv_path != NULL) {
+			dump_csv();
+		}
+	}
+	g_array_free(events, TRUE);
+	events = NULL;
+}
+
+void clock_stats_begin(const char *white, const char *black) {
+	pthread_mutex_lock(&stats_lock);
+	finish_game();
+	events = g_array_new(FALSE, FALSE, sizeof(clock_event));
+	game_start = g_get_monotonic_time();
+	snprintf(players[0], sizeof(players[0]), "%s", white);
+	snprintf(players[1], sizeof(players[1]), "%s", black);
+	games++;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+void clock_stats_end(void) {
+	pthread_mutex_lock(&stats_lock);
+	finish_game();
+	pthread_mutex_unlock(&stats_lock);
+}
+
+static void record(int event, int colour, gint64 server_us, gint64 local_us, gint64 correction_us) {
+	pthread_mutex_lock(&stats_lock);
+	if (events != NULL) {
+		clock_event e = {event, colour, g_get_monotonic_time() - game_start, server_us, local_us, correction_us};
+		g_array_append_val(events, e);
+	}
+	pthread_mutex_unlock(&stats_lock);
+}
+
+void clock_stats_update(int colour, gint64 server_us, gint64 local_us, gint64 correction_us) {
+	record(EVENT_UPDATE, colour, server_us, local_us, correction_us);
+}
+
+void clock_stats_tick(int colour, gint64 lateness_us) {
+	record(EVENT_TICK, colour, 0, 0, lateness_us);
+}
@@ -0,0 +1,20 @@
+#ifndef CAIRO_BOARD_CLOCK_STATS_H
+#define CAIRO_BOARD_CLOCK_STATS_H
+
+#include <gtk/gtk.h>
+
+/* Per game record of how the clock kept time, to check clock handling against real sessions
+ * Every server update (Style 12 time, local time, correction) and every clock tick (lateness)
+ * is kept until the game ends, then summarised to the log at info level: drift per minute,
+ * largest correction and tick jitter percentiles. With --clockcsv the records are appended
+ * to that file as well */
+
+void clock_stats_set_csv(const char *file_path);
+
+void clock_stats_begin(const char *white, const char *black);
+void clock_stats_end(void);
+
+void clock_stats_update(int colour, gint64 server_us, gint64 local_us, gint64 correction_us);
+void clock_stats_tick(int colour, gint64 lateness_us);
+
+#endif //CAIRO_BOARD_CLOCK_STATS_H
@@ -0,0 +1,128 @@
+#define LOG_SUBSYSTEM LOG_CLOCK
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <gtk/gtk.h>
+
+#include "clock-sync.h"
+#include "cairo-board.h"
+#include "metrics.h"
+#include "clock-stats.h"
+
+#define CLOCK_SYNC_MAX_RTT (30 * G_USEC_PER_SEC) // longer is a lost echo, not lag
+
+static pthread_mutex_t sync_lock = PTHREAD_MUTEX_INITIALIZER;
+static gint64 sent_at = 0; // when our last move left, 0 once its echo came back
+static int sent_colour = 0;
+static gint64 srtt = 0; // smoothed round trip, 0 until measured
+static gint64 rttvar = 0;
+static gint64 offset = 0; // smoothed local minus server time of the running side
+static bool have_offset = false;
+
+void clock_sync_reset(void) {
+	pthread_mutex_lock(&sync_lock);
+	sent_at = 0;
+	pthread_mutex_unlock(&sync_lock);
+}
+
+/* Our move is on its way. Our clock keeps running until the server echoes the move,
+ * it may yet refuse it, and the round trip is given back then, see clock_sync_board */
+void clock_sync_move_sent(chess_clock *clock, int colour) {
+	if (!is_active(clock, colour)) {
+		// not our turn in a running game, or examining
+		return;
+	}
+	pthread_mutex_lock(&sync_lock);
+	sent_at = g_get_monotonic_time();
+	sent_colour = colour;
+	pthread_mutex_unlock(&sync_lock);
+}
+
+/* Round trip estimate as TCP keeps it, see RFC 6298. Call with sync_lock held */
+static bool add_rtt_sample(gint64 rtt) {
+	if (rtt <= 0 || rtt >= CLOCK_SYNC_MAX_RTT) {
+		return false;
+	}
+	if (!srtt) {
+		srtt = rtt;
+		rttvar = rtt / 2;
+	} else {
+		rttvar = (3 * rttvar + labs((long) (srtt - rtt))) / 4;
+		srtt = (7 * srtt + rtt) / 8;
+	}
+	metrics_gauge(METRIC_ICS_LAG, srtt);
+	metrics_gauge(METRIC_ICS_LAG_VARIANCE, rttvar);
+	debug("Round trip %ldms, smoothed %ldms +/- %ldms\n", (long) rtt / 1000, (long) srtt / 1000, (long) rttvar / 1000);
+	return true;
+}
+
+/* A round trip timed outside of our moves, see the timeseal pings in netstuff.c */
+void clock_sync_rtt_sample(gint64 rtt) {
+	pthread_mutex_lock(&sync_lock);
+	add_rtt_sample(rtt);
+	pthread_mutex_unlock(&sync_lock);
+}
+
+static void add_offset_sample(gint64 sample) {
+	pthread_mutex_lock(&sync_lock);
+	offset = have_offset ? (7 * offset + sample) / 8 : sample;
+	have_offset = true;
+	gint64 smoothed = offset;
+	pthread_mutex_unlock(&sync_lock);
+	metrics_gauge(METRIC_ICS_CLOCK_OFFSET, smoothed);
+	debug("Clock offset %+ldms, smoothed %+ldms\n", (long) sample / 1000, (long) smoothed / 1000);
+}
+
+/* A <12> of the game on the main clock came in, before the clocks are swapped
+ * The side to move has been running at the server for about half a round trip since it was sent,
+ * so its window is moved down by that much: the display makes up for the lag */
+void clock_sync_board(chess_clock *clock, int white_time, int black_time, int to_move, int relation) {
+	gint64 now = g_get_monotonic_time();
+
+	gint64 credit = 0;
+	int colour;
+
+	pthread_mutex_lock(&sync_lock);
+	// relation -1: the opponent is to move, this is the echo of our move
+	if (relation == -1 && sent_at) {
+		// timeseal had the server stop our clock when the move left
+		if (add_rtt_sample(now - sent_at)) {
+			credit = now - sent_at;
+		}
+		sent_at = 0;
+	}
+	colour = sent_colour;
+	gint64 delay = srtt / 2;
+	pthread_mutex_unlock(&sync_lock);
+
+	if (credit) {
+		credit_one_clock(clock, colour, credit);
+	}
+
+	// only a side already running here says how far our time runs from the server's
+	bool running = is_active(clock, to_move);
+
+	gint64 error[2];
+	gint64 local[2];
+	gint64 server_us[2] = {(gint64) white_time * G_USEC_PER_SEC, (gint64) black_time * G_USEC_PER_SEC};
+	server_us[to_move] -= delay;
+	for (colour = 0; colour < 2; colour++) {
+		gint64 correction = sync_one_clock(clock, colour, server_us[colour], CLOCK_SYNC_RESOLUTION, &local[colour]);
+		clock_stats_update(colour, server_us[colour], local[colour], correction);
+		error[colour] = -correction;
+	}
+	debug("Clock errors white %ldms black %ldms, lag %ldms\n", (long) error[0] / 1000, (long) error[1] / 1000,
+	      (long) delay / 1000);
+
+	if (running) {
+		add_offset_sample(local[to_move] - server_us[to_move] - CLOCK_SYNC_RESOLUTION / 2);
+	}
+}
+
+gint64 clock_sync_lag(void) {
+	pthread_mutex_lock(&sync_lock);
+	gint64 lag = srtt;
+	pthread_mutex_unlock(&sync_lock);
+	return lag;
+}
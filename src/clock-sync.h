@@ -0,0 +1,28 @@
+#ifndef CAIRO_BOARD_CLOCK_SYNC_H
+#define CAIRO_BOARD_CLOCK_SYNC_H
+
+#include <gtk/gtk.h>
+
+#include "clocks.h"
+
+/* Keeps the local clock of an ICS game in step with the server
+ * Style 12 times are whole seconds, so they only say which second a side's time lies in:
+ * local time already in that second is kept, time outside is pulled in, smoothly while running.
+ * Timeseal stamps our moves when they leave and the server echoes them in a <12>,
+ * the time in between gives the round trip lag, as does timeseal's ping after our commands.
+ * Half of it is taken off the side to move, and how far the local time of a running side
+ * sits from the middle of its window gives the offset, both shown in the metrics panel */
+
+#define CLOCK_SYNC_RESOLUTION G_USEC_PER_SEC // of the times in style 12
+
+void clock_sync_reset(void);
+
+void clock_sync_move_sent(chess_clock *clock, int colour);
+
+void clock_sync_board(chess_clock *clock, int white_time, int black_time, int to_move, int relation);
+
+void clock_sync_rtt_sample(gint64 rtt);
+
+gint64 clock_sync_lag(void);
+
+#endif //CAIRO_BOARD_CLOCK_SYNC_H
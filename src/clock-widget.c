@@ -53,186 +53,267 @@ enum {
 	WARN_FG_GHOST_B = 20
 };
 
-// Active clock background
-static double active_bg_r = ACTIVE_BG_R / 255.0;
-static double active_bg_g = ACTIVE_BG_G / 255.0;
-static double active_bg_b = ACTIVE_BG_B / 255.0;
-
-// Inactive clock background
-static double inactive_bg_r = INACTIVE_BG_R / 255.0;
-static double inactive_bg_g = INACTIVE_BG_G / 255.0;
-static double inactive_bg_b = INACTIVE_BG_B / 255.0;
-
-// Active clock font colour
-static char active_fg_hex[8];
-static double active_fg_r = ACTIVE_FG_R / 255.0;
-static double active_fg_g = ACTIVE_FG_G / 255.0;
-static double active_fg_b = ACTIVE_FG_B / 255.0;
-
-// Inactive clock font colour
-static char inactive_fg_hex[8];
-static double inactive_fg_r = INACTIVE_FG_R / 255.0;
-static double inactive_fg_g = INACTIVE_FG_G / 255.0;
-static double inactive_fg_b = INACTIVE_FG_B / 255.0;
-
-// Low-on-time warning background
-static double warn_bg_r = WARN_BG_R / 255.0;
-static double warn_bg_g = WARN_BG_G / 255.0;
-static double warn_bg_b = WARN_BG_B / 255.0;
-
-// Active clock font colour for 7 segment ghost effect
-static char active_fg_ghost_hex[8];
-static double active_fg_ghost_r = ACTIVE_FG_GHOST_R / 255.0;
-static double active_fg_ghost_g = ACTIVE_FG_GHOST_G / 255.0;
-static double active_fg_ghost_b = ACTIVE_FG_GHOST_B / 255.0;
-
-// Inactive clock font colour for 7 segment ghost effect
-static char inactive_fg_ghost_hex[8];
-static double inactive_fg_ghost_r = INACTIVE_FG_GHOST_R / 255.0;
-static double inactive_fg_ghost_g = INACTIVE_FG_GHOST_G / 255.0;
-static double inactive_fg_ghost_b = INACTIVE_FG_GHOST_B / 255.0;
-
-// Low-on-time warning font colour for 7 segment ghost effect
-static char warn_fg_ghost_hex[8];
-static double warn_fg_ghost_r = WARN_FG_GHOST_R / 255.0;
-static double warn_fg_ghost_g = WARN_FG_GHOST_G / 255.0;
-static double warn_fg_ghost_b = WARN_FG_GHOST_B / 255.0;
-
-void rgb_to_css(char *hex, int r, int g, int b) {
-	sprintf(hex, "#%02X%02X%02X", r & 0xFF, g & 0xFF, b & 0xFF);
+enum {
+	INK_ACTIVE_BG,
+	INK_INACTIVE_BG,
+	INK_WARN_BG,
+	INK_ACTIVE_FG,
+	INK_INACTIVE_FG,
+	INK_ACTIVE_GHOST,
+	INK_INACTIVE_GHOST,
+	INK_WARN_GHOST,
+	INKS
+};
+
+static double inks[INKS][3];
+
+static void set_ink(int ink, int r, int g, int b) {
+	inks[ink][0] = r / 255.0;
+	inks[ink][1] = g / 255.0;
+	inks[ink][2] = b / 255.0;
 }
 
 void init_clock_colours(void) {
-	rgb_to_css(active_fg_hex, ACTIVE_FG_R, ACTIVE_FG_G, ACTIVE_FG_B);
-	rgb_to_css(inactive_fg_hex, INACTIVE_FG_R, INACTIVE_FG_G, INACTIVE_FG_B);
-	rgb_to_css(active_fg_ghost_hex, ACTIVE_FG_GHOST_R, ACTIVE_FG_GHOST_G, ACTIVE_FG_GHOST_B);
-	rgb_to_css(inactive_fg_ghost_hex, INACTIVE_FG_GHOST_R, INACTIVE_FG_GHOST_G, INACTIVE_FG_GHOST_B);
-	rgb_to_css(warn_fg_ghost_hex, WARN_FG_GHOST_R, WARN_FG_GHOST_G, WARN_FG_GHOST_B);
+	set_ink(INK_ACTIVE_BG, ACTIVE_BG_R, ACTIVE_BG_G, ACTIVE_BG_B);
+	set_ink(INK_INACTIVE_BG, INACTIVE_BG_R, INACTIVE_BG_G, INACTIVE_BG_B);
+	set_ink(INK_WARN_BG, WARN_BG_R, WARN_BG_G, WARN_BG_B);
+	set_ink(INK_ACTIVE_FG, ACTIVE_FG_R, ACTIVE_FG_G, ACTIVE_FG_B);
+	set_ink(INK_INACTIVE_FG, INACTIVE_FG_R, INACTIVE_FG_G, INACTIVE_FG_B);
+	set_ink(INK_ACTIVE_GHOST, ACTIVE_FG_GHOST_R, ACTIVE_FG_GHOST_G, ACTIVE_FG_GHOST_B);
+	set_ink(INK_INACTIVE_GHOST, INACTIVE_FG_GHOST_R, INACTIVE_FG_GHOST_G, INACTIVE_FG_GHOST_B);
+	set_ink(INK_WARN_GHOST, WARN_FG_GHOST_R, WARN_FG_GHOST_G, WARN_FG_GHOST_B);
 }
 
-gboolean draw_clock_face(GtkWidget *clock_face, cairo_t *crt) {
+static void set_ink_source(cairo_t *cr, int ink) {
+	cairo_set_source_rgb(cr, inks[ink][0], inks[ink][1], inks[ink][2]);
+}
 
-	static int last_wi = -1;
-	static int last_hi = -1;
-	static size_t last_white_len = 0;
-	static size_t last_black_len = 0;
-	static float font_size = -1;
+static int glyph_index(char c) {
+	const char *found = strchr(CLOCK_GLYPHS, c);
+	return c && found ? (int) (found - CLOCK_GLYPHS) : -1;
+}
 
-	ClockFace *cf = CLOCK_FACE(clock_face);
+static PangoLayout *create_glyph_layout(cairo_t *cr, float font_size) {
+	char font_str[32];
+	PangoLayout *layout = pango_cairo_create_layout(cr);
+	sprintf(font_str, "%s %.1f", FONT_FACE, font_size);
+	PangoFontDescription *desc = pango_font_description_from_string(font_str);
+	pango_layout_set_font_description(layout, desc);
+	pango_font_description_free(desc);
+	return layout;
+}
 
-	if (!cf->clock) {
-		fprintf(stderr, "Can't draw a NULL clock\n");
-		return FALSE;
+static cairo_surface_t *create_clock_surface(GtkWidget *widget, cairo_format_t format, int width, int height) {
+	GdkWindow *window = gtk_widget_get_window(widget);
+	if (window == NULL) {
+		// not realized yet
+		return cairo_image_surface_create(format, width, height);
 	}
+	return gdk_window_create_similar_image_surface(window, format, width, height, gdk_window_get_scale_factor(window));
+}
 
-	pthread_mutex_lock(&mutex_drawing);
-
-	cairo_surface_t *buffer_surf = cairo_image_surface_create(
-			CAIRO_FORMAT_ARGB32, 
-			gtk_widget_get_allocated_width(clock_face),
-			gtk_widget_get_allocated_height(clock_face));
-
-	cairo_t *buff_crt = cairo_create(buffer_surf);
-
-	char white[32];
-	char white_ghost[32];
-	char black[32];
-	char black_ghost[32];
-
-	clock_to_string(cf->clock, 0, white, white_ghost);
-	clock_to_string(cf->clock, 1, black, black_ghost);
-
-	PangoFontDescription *desc;
-	PangoLayout *layout;
+/* Glyph metrics at CLOCK_REF_FONT_SIZE, text width scales with the font size
+ * so the fitting size is found without shaping the clock strings again */
+#define CLOCK_REF_FONT_SIZE 100.0f
+static double ref_advance[CLOCK_GLYPH_COUNT];
+static double ref_height = -1;
+
+static void measure_reference_glyphs(cairo_t *cr) {
+	int i;
+	char glyph[2] = {0};
+	PangoRectangle logical;
+	PangoLayout *layout = create_glyph_layout(cr, CLOCK_REF_FONT_SIZE);
+
+	ref_height = 0;
+	for (i = 0; i < CLOCK_GLYPH_COUNT; i++) {
+		glyph[0] = CLOCK_GLYPHS[i];
+		pango_layout_set_text(layout, glyph, -1);
+		pango_layout_get_extents(layout, NULL, &logical);
+		ref_advance[i] = (double) logical.width / PANGO_SCALE;
+		if (logical.height > ref_height * PANGO_SCALE) {
+			ref_height = (double) logical.height / PANGO_SCALE;
+		}
+	}
+	g_object_unref(layout);
+}
 
-	layout = pango_cairo_create_layout(buff_crt);
+static double ref_text_width(const char *text) {
+	double width = 0;
+	for (; *text; text++) {
+		int i = glyph_index(*text);
+		if (i > -1) {
+			width += ref_advance[i];
+		}
+	}
+	return width;
+}
 
-	char font_str[32];
+/* Largest size, in .1pt steps, at which both clocks fit their half of the face */
+static float fit_font_size(int wi, int hi, const char *white, const char *black) {
+	int v_padding = 10;
+	int h_padding = 20;
 
-	float hi_font_size;
-	float wi_font_size;
+	float hi_font_size = (float) (hi / 1.5);
+	float wi_font_size = (float) (wi / 9.0);
+	float font_size = (hi_font_size < wi_font_size) ? hi_font_size : wi_font_size;
 
-	int wi = gtk_widget_get_allocated_width(clock_face);
-	int hi = gtk_widget_get_allocated_height(clock_face);
+	double widest = MAX(ref_text_width(white), ref_text_width(black));
+	double fit = CLOCK_REF_FONT_SIZE * (hi - v_padding) / ref_height;
+	if (widest > 0) {
+		fit = MIN(fit, CLOCK_REF_FONT_SIZE * (wi / 2.0 - h_padding) / widest);
+	}
+	if (fit < font_size) {
+		font_size = (float) (floor(fit * 10.0) / 10.0);
+	}
+	return font_size > 1 ? font_size : 1;
+}
 
-	size_t white_len = strlen(white);
-	size_t black_len = strlen(black);
+static void free_glyphs(clock_glyphs *glyphs) {
+	int i;
+	for (i = 0; i < CLOCK_GLYPH_COUNT; i++) {
+		if (glyphs->mask[i] != NULL) {
+			cairo_surface_destroy(glyphs->mask[i]);
+			glyphs->mask[i] = NULL;
+		}
+	}
+	glyphs->font_size = -1;
+}
 
-	// Create and Set font description
+static void rasterize_glyphs(GtkWidget *clock_face, cairo_t *cr, clock_glyphs *glyphs, float font_size) {
+	int i;
+	char glyph[2] = {0};
+	PangoRectangle ink, logical;
+	PangoLayout *layout = create_glyph_layout(cr, font_size);
+
+	free_glyphs(glyphs);
+	glyphs->height = 0;
+	for (i = 0; i < CLOCK_GLYPH_COUNT; i++) {
+		glyph[0] = CLOCK_GLYPHS[i];
+		pango_layout_set_text(layout, glyph, -1);
+		pango_layout_get_pixel_extents(layout, &ink, &logical);
+		glyphs->advance[i] = logical.width;
+		glyphs->height = MAX(glyphs->height, logical.height);
+
+		// the slanted segments may lean out of the glyph's cell
+		int x0 = MIN(ink.x, logical.x);
+		int y0 = MIN(ink.y, logical.y);
+		int x1 = MAX(ink.x + ink.width, logical.x + logical.width);
+		int y1 = MAX(ink.y + ink.height, logical.y + logical.height);
+		glyphs->mask_x[i] = x0;
+		glyphs->mask_y[i] = y0;
+		glyphs->mask[i] = create_clock_surface(clock_face, CAIRO_FORMAT_A8, MAX(x1 - x0, 1), MAX(y1 - y0, 1));
+
+		cairo_t *mask_cr = cairo_create(glyphs->mask[i]);
+		cairo_translate(mask_cr, -x0, -y0);
+		pango_cairo_update_layout(mask_cr, layout);
+		pango_cairo_show_layout(mask_cr, layout);
+		cairo_destroy(mask_cr);
+	}
+	glyphs->font_size = font_size;
+	g_object_unref(layout);
+}
 
-	/* *
-	 * Find Optimal Font Size in points
-	 * the initial guessed size is an average from experiments 
-	 * but is adjusted for the current display if too big
-	 * */
-	double halfWidth = (double) wi / 2.0f;
-	int w_pix_width, w_pix_height, b_pix_width, b_pix_height;
+static void side_state(chess_clock *clock, int black, bool active, bool warn, bool colon_on, clock_side *side) {
+	clock_to_string(clock, black, side->text, side->ghost);
+	if (active) {
+		side->bg = warn ? INK_WARN_BG : INK_ACTIVE_BG;
+		side->fg = INK_ACTIVE_FG;
+		side->ghost_fg = warn ? INK_WARN_GHOST : INK_ACTIVE_GHOST;
+		side->colon_fg = colon_on ? INK_ACTIVE_FG : side->ghost_fg;
+	} else {
+		side->bg = INK_INACTIVE_BG;
+		side->fg = INK_INACTIVE_FG;
+		side->ghost_fg = INK_INACTIVE_GHOST;
+		side->colon_fg = INK_INACTIVE_FG;
+	}
+}
 
-	if (last_wi == wi && last_hi == hi && last_white_len == white_len && last_black_len == black_len) {
-		// Reuse font size as previously calculated
-		sprintf(font_str, "%s %.1f", FONT_FACE, font_size);
-		desc = pango_font_description_from_string(font_str);
-		pango_layout_set_font_description(layout, desc);
-		pango_font_description_free(desc);
+/* Paint one half of the face, only the character cells that differ from what it showed
+ * unless full. Returns true if the whole half was repainted */
+static bool paint_side(ClockFace *cf, cairo_t *cr, int black, const clock_side *side, bool full) {
+	clock_glyphs *glyphs = &cf->glyphs;
+	clock_side *shown = &cf->shown[black];
+	int left = black ? cf->face_wi / 2 : 0;
+	int width = black ? cf->face_wi - left : cf->face_wi / 2;
+	size_t len = strlen(side->text);
+	size_t i;
+
+	int text_width = 0;
+	for (i = 0; i < len; i++) {
+		int g = glyph_index(side->text[i]);
+		text_width += g > -1 ? glyphs->advance[g] : 0;
+	}
+	int tx = left + (width - text_width) / 2;
+	int ty = (cf->face_hi - glyphs->height) / 2;
 
-		pango_layout_set_text(layout, black, -1);
-		pango_layout_get_pixel_size(layout, &b_pix_width, &b_pix_height);
+	// whole half when the layout or the colours changed
+	if (!full) {
+		full = len != strlen(shown->text) || side->bg != shown->bg || side->fg != shown->fg ||
+		       side->ghost_fg != shown->ghost_fg;
+	}
+	const char *colon = strrchr(side->text, ':');
+	size_t colon_at = colon != NULL ? (size_t) (colon - side->text) : len;
 
-		pango_layout_set_text(layout, white, -1);
-		pango_layout_get_pixel_size(layout, &w_pix_width, &w_pix_height);
+	cairo_save(cr);
+	if (full) {
+		cairo_rectangle(cr, left, 0, width, cf->face_hi);
 	} else {
-		// Calculating new font size since things have changed
-		float last_font_size = font_size;
-
-		int v_padding = 10;
-		int h_padding = 20;
-
-		hi_font_size = (float) (hi / 1.5);
-		wi_font_size = (float) (wi / 9.0);
-		font_size = (hi_font_size < wi_font_size) ? hi_font_size : wi_font_size;
-
-		sprintf(font_str, "%s %.1f", FONT_FACE, font_size);
-		desc = pango_font_description_from_string(font_str);
-		pango_layout_set_font_description(layout, desc);
-		pango_font_description_free(desc);
-
-		// Ensure both clocks fit
-		pango_layout_set_text(layout, black, -1);
-		pango_layout_get_pixel_size(layout, &b_pix_width, &b_pix_height);
-		while ((b_pix_height > hi - v_padding || b_pix_width > halfWidth - h_padding) && font_size > 1) {
-			font_size -= .1;
-			sprintf(font_str, "%s %.2f", FONT_FACE, font_size);
-			desc = pango_font_description_from_string(font_str);
-			pango_layout_set_font_description(layout, desc);
-			pango_font_description_free(desc);
-			pango_layout_get_pixel_size(layout, &b_pix_width, &b_pix_height);
+		bool dirty = false;
+		int x = tx;
+		for (i = 0; i < len; i++) {
+			int g = glyph_index(side->text[i]);
+			int advance = g > -1 ? glyphs->advance[g] : 0;
+			if (side->text[i] != shown->text[i] || side->ghost[i] != shown->ghost[i] ||
+			    (i == colon_at && side->colon_fg != shown->colon_fg)) {
+				cairo_rectangle(cr, x, 0, advance, cf->face_hi);
+				dirty = true;
+			}
+			x += advance;
 		}
-		pango_layout_set_text(layout, white, -1);
-		pango_layout_get_pixel_size(layout, &w_pix_width, &w_pix_height);
-		while ((w_pix_height > hi - v_padding || w_pix_width > halfWidth - h_padding) && font_size > 1) {
-			font_size -= .1;
-			sprintf(font_str, "%s %.2f", FONT_FACE, font_size);
-			desc = pango_font_description_from_string(font_str);
-			pango_layout_set_font_description(layout, desc);
-			pango_font_description_free(desc);
-			pango_layout_get_pixel_size(layout, &w_pix_width, &w_pix_height);
+		if (!dirty) {
+			cairo_restore(cr);
+			return false;
 		}
+	}
+	cairo_clip(cr);
+
+	set_ink_source(cr, side->bg);
+	cairo_paint(cr);
 
-		if (last_font_size > -1 && font_size != last_font_size) {
-			// Redraw whole clock as font size of both should change
-			gtk_widget_queue_draw(clock_face);
+	// every glyph, clipped to the changed cells, so overhanging segments stay whole
+	int x = tx;
+	for (i = 0; i < len; i++) {
+		int g = glyph_index(side->text[i]);
+		if (g < 0) {
+			continue;
 		}
+		int ghost = glyph_index(side->ghost[i]);
+		if (ghost > -1) {
+			set_ink_source(cr, side->ghost_fg);
+			cairo_mask_surface(cr, glyphs->mask[ghost], x + glyphs->mask_x[ghost], ty + glyphs->mask_y[ghost]);
+		}
+		set_ink_source(cr, i == colon_at ? side->colon_fg : side->fg);
+		cairo_mask_surface(cr, glyphs->mask[g], x + glyphs->mask_x[g], ty + glyphs->mask_y[g]);
+		x += glyphs->advance[g];
+	}
+	cairo_restore(cr);
+
+	*shown = *side;
+	return full;
+}
+
+gboolean draw_clock_face(GtkWidget *clock_face, cairo_t *crt) {
+	ClockFace *cf = CLOCK_FACE(clock_face);
+
+	if (!cf->clock) {
+		fprintf(stderr, "Can't draw a NULL clock\n");
+		return FALSE;
 	}
 
-	last_wi = wi;
-	last_hi = hi;
-	last_white_len = white_len;
-	last_black_len = black_len;
+	pthread_mutex_lock(&mutex_drawing);
 
-//	printf("Allocated height == %dpx\n", hi);
-//	printf("Final font size %f\n", font_size);
-//	printf("Final H ratio %f\n", hi / font_size);
-//	printf("Final W ratio %f\n", wi / font_size);
+	int wi = gtk_widget_get_allocated_width(clock_face);
+	int hi = gtk_widget_get_allocated_height(clock_face);
 
 	int wa = is_active(cf->clock, 0);
 	int ba = is_active(cf->clock, 1);
@@ -252,195 +333,101 @@ gboolean draw_clock_face(GtkWidget *clock_face, cairo_t *crt) {
 		}
 	}
 
-	cairo_save(buff_crt);
-
-	struct timeval my_time = cf->clock->remaining_time[cf->clock->relation > 0 ? 0 : 1];
-	struct timeval active_time = cf->clock->remaining_time[wa ? 0 : 1];
+	gint64 my_time = get_remaining_usec(cf->clock, cf->clock->relation > 0 ? 0 : 1);
+	gint64 active_time = get_remaining_usec(cf->clock, wa ? 0 : 1);
 	bool warn_toggle;
 	bool colon_toggle;
-	if (my_time.tv_sec <= 0) {
+	if (my_time < G_USEC_PER_SEC) {
 		warn_toggle = true;
 		colon_toggle = true;
 	} else {
-		warn_toggle = my_time.tv_usec > 500000;
-		colon_toggle = active_time.tv_usec > 500000;
+		// first half of each second
+		warn_toggle = my_time % G_USEC_PER_SEC > 500000;
+		colon_toggle = (active_time % G_USEC_PER_SEC + G_USEC_PER_SEC) % G_USEC_PER_SEC > 500000;
 	}
 
-	// paint white's clock background
-	double w_bg_r, w_bg_g, w_bg_b;
-	if (wa) {
-		if (warn_me && warn_toggle) {
-			w_bg_r = warn_bg_r;
-			w_bg_g = warn_bg_g;
-			w_bg_b = warn_bg_b;
-		} else {
-			w_bg_r = active_bg_r;
-			w_bg_g = active_bg_g;
-			w_bg_b = active_bg_b;
-		}
-	} else {
-		w_bg_r = inactive_bg_r;
-		w_bg_g = inactive_bg_g;
-		w_bg_b = inactive_bg_b;
-	}
-	cairo_set_source_rgb(buff_crt, w_bg_r, w_bg_g, w_bg_b);
-	cairo_rectangle(buff_crt, 0, 0, halfWidth, hi);
-	cairo_fill(buff_crt);
-
-	// paint white's clock text
-	double tx = .5 * (wi / 2.0f - w_pix_width);
-	double ty = .5 * (hi - w_pix_height);
-	cairo_translate(buff_crt, tx, ty);
-
-	pango_layout_set_text(layout, white_ghost, -1);
-	char *colon_colour;
-	if (wa) {
-		colon_colour = colon_toggle ? active_fg_hex : active_fg_ghost_hex;
-		if (warn_me && warn_toggle) {
-			cairo_set_source_rgb(buff_crt, warn_fg_ghost_r, warn_fg_ghost_g, warn_fg_ghost_b);
-			colon_colour = colon_toggle ? active_fg_hex : warn_fg_ghost_hex;
-		} else {
-			cairo_set_source_rgb(buff_crt, active_fg_ghost_r, active_fg_ghost_g, active_fg_ghost_b);
-		}
-	} else {
-		colon_colour = inactive_fg_hex;
-		cairo_set_source_rgb(buff_crt, inactive_fg_ghost_r, inactive_fg_ghost_g, inactive_fg_ghost_b);
-	}
-	pango_cairo_show_layout(buff_crt, layout);
-
-	char markup[256];
-	char *colon = strrchr(white, ':');
-	char before_colon[16];
-	char after_colon[16];
-	memset(before_colon, 0, 16);
-	memset(after_colon, 0, 16);
-	memcpy(before_colon, white, colon - white);
-	size_t prefixLen = strlen(before_colon);
-	memcpy(after_colon, colon + 1, white_len - prefixLen - 1);
-
-	sprintf(markup, "%s<span foreground=\"%s\">:</span>%s", before_colon, colon_colour, after_colon);
-	pango_layout_set_markup(layout, markup, -1);
-	if (wa) {
-		cairo_set_source_rgb(buff_crt, active_fg_r, active_fg_g, active_fg_b);
-	} else {
-		cairo_set_source_rgb(buff_crt, inactive_fg_r, inactive_fg_g, inactive_fg_b);
-	}
-	pango_cairo_show_layout(buff_crt, layout);
-
-
-	cairo_restore(buff_crt);
-	cairo_save(buff_crt);
+	// the colon only blinks along with the tenths or the low on time warning, see display_step
+	bool colon_on = !(warn_me || active_time < 10 * G_USEC_PER_SEC) || colon_toggle;
 
-	// paint black's clock background
-	cairo_translate(buff_crt, halfWidth, 0);
+	clock_side sides[2];
+	memset(sides, 0, sizeof(sides));
+	side_state(cf->clock, 0, wa, warn_me && warn_toggle, colon_on, &sides[0]);
+	side_state(cf->clock, 1, ba, warn_me && warn_toggle, colon_on, &sides[1]);
 
-	double b_bg_r, b_bg_g, b_bg_b;
-	if (ba) {
-		if (warn_me && warn_toggle) {
-			b_bg_r = warn_bg_r;
-			b_bg_g = warn_bg_g;
-			b_bg_b = warn_bg_b;
-		} else {
-			b_bg_r = active_bg_r;
-			b_bg_g = active_bg_g;
-			b_bg_b = active_bg_b;
+	bool full = false;
+	if (cf->face == NULL || cf->face_wi != wi || cf->face_hi != hi) {
+		if (cf->face != NULL) {
+			cairo_surface_destroy(cf->face);
 		}
-	} else {
-		b_bg_r = inactive_bg_r;
-		b_bg_g = inactive_bg_g;
-		b_bg_b = inactive_bg_b;
+		cf->face = create_clock_surface(clock_face, CAIRO_FORMAT_RGB24, wi, hi);
+		cf->face_wi = wi;
+		cf->face_hi = hi;
+		// glyphs follow the face, its device scale may have changed too
+		free_glyphs(&cf->glyphs);
+		full = true;
 	}
-	cairo_set_source_rgb(buff_crt, b_bg_r, b_bg_g, b_bg_b);
-	cairo_rectangle(buff_crt, 0, 0, halfWidth, hi);
-	cairo_fill(buff_crt);
-
-	// paint black's clock text
-	tx = .5 * (wi / 2.0f - b_pix_width);
-	cairo_translate(buff_crt, tx, ty);
-	pango_layout_set_text(layout, black_ghost, -1);
-	if (ba) {
-		colon_colour = colon_toggle ? active_fg_hex : active_fg_ghost_hex;
-		if (warn_me && warn_toggle) {
-			cairo_set_source_rgb(buff_crt, warn_fg_ghost_r, warn_fg_ghost_g, warn_fg_ghost_b);
-			colon_colour = colon_toggle ? active_fg_hex : warn_fg_ghost_hex;
-		} else {
-			cairo_set_source_rgb(buff_crt, active_fg_ghost_r, active_fg_ghost_g, active_fg_ghost_b);
-		}
-	} else {
-		colon_colour = inactive_fg_hex;
-		cairo_set_source_rgb(buff_crt, inactive_fg_ghost_r, inactive_fg_ghost_g, inactive_fg_ghost_b);
+
+	if (ref_height < 0) {
+		measure_reference_glyphs(crt);
 	}
-	pango_cairo_show_layout(buff_crt, layout);
-
-	colon = strrchr(black, ':');
-	memset(before_colon, 0, 16);
-	memset(after_colon, 0, 16);
-	memcpy(before_colon, black, colon - black);
-	prefixLen = strlen(before_colon);
-	memcpy(after_colon, colon + 1, black_len - prefixLen - 1);
-
-	sprintf(markup, "%s<span foreground=\"%s\">:</span>%s", before_colon, colon_colour, after_colon);
-	pango_layout_set_markup(layout, markup, -1);
-	pango_layout_get_pixel_size(layout, &b_pix_width, &b_pix_height);
-
-	if (ba) {
-		if (warn_me && warn_toggle) {
-			cairo_set_source_rgb(buff_crt, warn_fg_ghost_r, warn_fg_ghost_g, warn_fg_ghost_b);
-		} else {
-			cairo_set_source_rgb(buff_crt, active_fg_ghost_r, active_fg_ghost_g, active_fg_ghost_b);
+	// Font size only changes with the face size or the length of the clock strings
+	if (full || strlen(sides[0].text) != strlen(cf->shown[0].text) ||
+	    strlen(sides[1].text) != strlen(cf->shown[1].text)) {
+		float font_size = fit_font_size(wi, hi, sides[0].text, sides[1].text);
+		if (font_size != cf->glyphs.font_size) {
+			rasterize_glyphs(clock_face, crt, &cf->glyphs, font_size);
+			if (!full) {
+				// Redraw whole clock as font size of both should change
+				gtk_widget_queue_draw(clock_face);
+				full = true;
+			}
 		}
-	} else {
-		cairo_set_source_rgb(buff_crt, inactive_fg_ghost_r, inactive_fg_ghost_g, inactive_fg_ghost_b);
 	}
-	pango_cairo_show_layout(buff_crt, layout);
 
-	if (ba) {
-		cairo_set_source_rgb(buff_crt, active_fg_r, active_fg_g, active_fg_b);
+	cairo_t *face_cr = cairo_create(cf->face);
+	bool white_full = paint_side(cf, face_cr, 0, &sides[0], full);
+	bool black_full = paint_side(cf, face_cr, 1, &sides[1], full);
+
+	if (white_full || black_full) {
+		// paint separator on boundary to avoid aliasing
+		int w_bg = sides[0].bg;
+		int b_bg = sides[1].bg;
+		cairo_set_source_rgb(face_cr, (inks[w_bg][0] + inks[b_bg][0]) / 2.0, (inks[w_bg][1] + inks[b_bg][1]) / 2.0,
+		                     (inks[w_bg][2] + inks[b_bg][2]) / 2.0);
+		cairo_move_to(face_cr, wi / 2.0, 0);
+		cairo_line_to(face_cr, wi / 2.0, hi);
+		cairo_set_line_width(face_cr, 1.0f);
+		cairo_stroke(face_cr);
 	}
-	else {
-		cairo_set_source_rgb(buff_crt, inactive_fg_r, inactive_fg_g, inactive_fg_b);
-	}
-	pango_layout_set_text(layout, black, -1);
-	pango_cairo_show_layout(buff_crt, layout);
-
-	cairo_restore(buff_crt);
-
-	// debug clock text bounds
-//	pango_layout_set_text(layout, white, -1);
-//	pango_layout_get_pixel_size(layout, &pix_width, &pix_height);
-//	double rx = .5 * (wi / 2.0f - pix_width);
-//	double ry = .5 * (hi - pix_height);
-//	cairo_set_source_rgb(buff_crt, 1, 1, 1);
-//	cairo_rectangle(buff_crt, rx, ry, pix_width, pix_height);
-//	cairo_set_line_width(buff_crt, 1);
-//	cairo_stroke(buff_crt);
-
-	// paint separator on boundary to avoid aliasing
-	cairo_set_source_rgb(buff_crt, (w_bg_r + b_bg_r) / 2.0, (w_bg_g + b_bg_g) / 2.0, (w_bg_b + b_bg_b) / 2.0);
-
-	cairo_move_to (buff_crt, halfWidth, 0);
-	cairo_line_to(buff_crt, halfWidth, hi);
-	cairo_set_line_width(buff_crt, 1.0f);
-	cairo_stroke(buff_crt);
+	cairo_destroy(face_cr);
 
 	// Apply cache surface to crt
-	cairo_set_source_surface(crt, buffer_surf, 0.0f, 0.0f);
+	cairo_set_source_surface(crt, cf->face, 0.0f, 0.0f);
 	cairo_paint(crt);
 
-	// Cleanup
-	g_object_unref(layout);
-	cairo_destroy(buff_crt);
-	cairo_surface_destroy(buffer_surf);
 	pthread_mutex_unlock(&mutex_drawing);
+	return FALSE;
+}
+
+static void clock_face_finalize(GObject *object) {
+	ClockFace *cf = CLOCK_FACE(object);
+	free_glyphs(&cf->glyphs);
+	if (cf->face != NULL) {
+		cairo_surface_destroy(cf->face);
+	}
+	G_OBJECT_CLASS(clock_face_parent_class)->finalize(object);
 }
 
 static void clock_face_class_init(ClockFaceClass *class) {
 	GtkWidgetClass *widget_class;
 	widget_class = GTK_WIDGET_CLASS (class);
 	widget_class->draw = draw_clock_face;
+	G_OBJECT_CLASS(class)->finalize = clock_face_finalize;
 }
 
-static void clock_face_init(ClockFace *clock_face) {}
+static void clock_face_init(ClockFace *clock_face) {
+	clock_face->glyphs.font_size = -1;
+}
 
 void clock_face_set_clock(ClockFace *clock_face, chess_clock *clock) {
 	clock_face->clock = clock;
@@ -17,10 +17,41 @@ G_BEGIN_DECLS
 typedef struct _ClockFace	ClockFace;
 typedef struct _ClockFaceClass	ClockFaceClass;
 
+#define CLOCK_GLYPHS "0123456789:.-"
+#define CLOCK_GLYPH_COUNT 13
+#define CLOCK_TEXT_SIZE 32
+
+/* The clock characters shaped and rasterized once per font size */
+typedef struct {
+	float font_size; // -1 until rasterized
+	int height; // line height in pixels
+	int advance[CLOCK_GLYPH_COUNT];
+	int mask_x[CLOCK_GLYPH_COUNT]; // mask origin relative to the pen position
+	int mask_y[CLOCK_GLYPH_COUNT];
+	cairo_surface_t *mask[CLOCK_GLYPH_COUNT]; // glyph coverage, painted in any colour
+} clock_glyphs;
+
+/* What one half of the face shows */
+typedef struct {
+	char text[CLOCK_TEXT_SIZE];
+	char ghost[CLOCK_TEXT_SIZE]; // unlit segments behind the text
+	int bg; // inks, see clock-widget.c
+	int fg;
+	int ghost_fg;
+	int colon_fg; // the last colon blinks with the tenths or the low on time warning
+} clock_side;
+
 struct _ClockFace {
 	GtkDrawingArea parent;
 	/* the chess_clock displayed by this widget */
 	chess_clock *clock; 
+
+	clock_glyphs glyphs;
+	/* the face as last painted, updated only where a half changed */
+	cairo_surface_t *face;
+	int face_wi;
+	int face_hi;
+	clock_side shown[2];
 };
 
 struct _ClockFaceClass {
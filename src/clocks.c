@@ -1,3 +1,5 @@
+#define LOG_SUBSYSTEM LOG_CLOCK
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,8 +10,10 @@
 #include "clocks.h"
 #include "clock-widget.h"
 #include "chess-backend.h"
-
-#define CLOCK_INTERVAL 100000 // 100ms
+#include "trace.h"
+#include "metrics.h"
+#include "ui-queue.h"
+#include "clock-stats.h"
 
 extern int debug_flag;
 #ifndef debug
@@ -22,86 +26,117 @@ void debug(format, ...) { if (debug_flag) fprintf(stdout, "%s:\033[31m%d\033[0m
 
 void send_to_ics(char*);
 
-static struct timeval zero_tv = {0, -250000}; // allow 250ms margin
-
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wmissing-noreturn"
-void *black_clock_runner_function(void *_clock) {
-	chess_clock *clock = (chess_clock*)_clock;
-	struct timeval now, diff;
-
-	for (;;) {
-		sem_wait(&clock->sem_black);
-		sem_post(&clock->sem_black);
-
-		// get the current time
-		gettimeofday(&now, NULL);
-
-		// check the clock has not just resumed from pause
-		if (clock->last_modified_time[1].tv_sec) {
-			// measure exactly how long elapsed since last_update
-			timersub(&now, &clock->last_modified_time[1], &diff);
-
-			// thread safe update of the remaining time
-			pthread_mutex_lock(&clock->update_mutex);
-			timersub(&clock->remaining_time[1], &diff, &clock->remaining_time[1]);
-			pthread_mutex_unlock(&clock->update_mutex);
-		}
-
-		gdk_threads_enter();
-		if (clock->parent != NULL) {
-			refresh_one_clock(GTK_WIDGET(clock->parent), 1);
+#define CLOCK_EXPIRY_MARGIN 250000 // allow 250ms margin
+#define CLOCK_SLEW_US 1000000 // corrections to a running clock are spread over a second
+
+/* Time left on a side at now, must be called with update_mutex held */
+static gint64 remaining_at(chess_clock *clock, int color, gint64 now) {
+	gint64 usec = clock->remaining_us[color];
+	if (clock->started_at[color]) {
+		usec -= now - clock->started_at[color];
+		gint64 slewing = now - clock->slew_from[color];
+		if (slewing >= CLOCK_SLEW_US) {
+			usec += clock->slew_us[color];
+		} else if (slewing > 0) {
+			usec += clock->slew_us[color] * slewing / CLOCK_SLEW_US;
 		}
-		gdk_threads_leave();
-
-		// update last modified timestamp
-		clock->last_modified_time[1] = now;
-
-		// sleep approx 100ms
-		usleep(CLOCK_INTERVAL);
 	}
+	return usec;
 }
-#pragma clang diagnostic pop
 
+/* Make now the reference point of a side, folding in the elapsed time and any correction */
+static void rebase_clock(chess_clock *clock, int color, gint64 now) {
+	clock->remaining_us[color] = remaining_at(clock, color, now);
+	if (clock->started_at[color]) {
+		clock->started_at[color] = now;
+	}
+	clock->slew_us[color] = 0;
+}
 
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wmissing-noreturn"
-void *white_clock_runner_function(void *_clock) {
-	chess_clock *clock = (chess_clock*)_clock;
-	struct timeval now, diff;
+/* my time is less than 2/3 of my opponent's */
+static int is_low_on_time(long my_time, long opponent_time) {
+	return opponent_time > 0 && 1000 * my_time / opponent_time < 667;
+}
 
-	for (;;) {
-		sem_wait(&(clock->sem_white));
-		sem_post(&clock->sem_white);
+/* How often the display of the running side changes, must be called with update_mutex held:
+ * tenths show under 10s, the colon and the low on time warning blink every half second,
+ * otherwise only the seconds change */
+static gint64 display_step(chess_clock *clock, gint64 now, int color) {
+	long ms[2];
+	int i;
+	for (i = 0; i < 2; i++) {
+		gint64 usec = remaining_at(clock, i, now);
+		ms[i] = usec > 0 ? (long) (usec / 1000) : 0;
+	}
+	if (ms[color] < 10 * 1000) {
+		return 100000;
+	}
+	int mine = clock->relation > 0 ? 0 : 1;
+	if (clock->relation && color == mine && is_low_on_time(ms[mine], ms[!mine])) {
+		return 500000;
+	}
+	return G_USEC_PER_SEC;
+}
 
-		// get the current time
-		gettimeofday(&now, NULL);
+/* Delay until the remaining time crosses the next multiple of step */
+static guint next_change_ms(gint64 remaining_us, gint64 step) {
+	gint64 left = remaining_us % step;
+	if (left <= 0) {
+		left += step;
+	}
+	return (guint) ((left + 999) / 1000);
+}
 
-		// check the clock has not just resumed from pause
-		if (clock->last_modified_time[0].tv_sec) {
-			// measure exactly how long elapsed since last_update
-			timersub(&now, &clock->last_modified_time[0], &diff);
+static gboolean clock_tick(gpointer data);
 
-			// thread safe update of the remaining time
-			pthread_mutex_lock(&clock->update_mutex);
-			timersub(&clock->remaining_time[0], &diff, &clock->remaining_time[0]);
-			pthread_mutex_unlock(&clock->update_mutex);
-		}
+/* Must be called with update_mutex held */
+static void arm_clock_timer(chess_clock *clock, gint64 now, int color) {
+	gint64 remaining = remaining_at(clock, color, now);
+	guint delay = next_change_ms(remaining, display_step(clock, now, color));
+	if (clock->slew_us[color] && now - clock->slew_from[color] < CLOCK_SLEW_US) {
+		// the display runs off its nominal rate while a correction is slewed in
+		delay = MIN(delay, 100);
+	}
+	if (clock->timer_id) {
+		g_source_remove(clock->timer_id);
+	}
+	clock->tick_due = now + delay * 1000;
+	clock->timer_id = gdk_threads_add_timeout(delay, clock_tick, clock);
+}
 
-		gdk_threads_enter();
-		if (clock->parent != NULL) {
-			refresh_one_clock(GTK_WIDGET(clock->parent), 0);
-		}
-		gdk_threads_leave();
+/* Runs with the GDK lock held, repaints the running side and rearms for its next change */
+static gboolean clock_tick(gpointer data) {
+	chess_clock *clock = (chess_clock*)data;
+	gint64 now = g_get_monotonic_time();
+	int color = -1;
 
-		// update last modified timestamp
-		clock->last_modified_time[0] = now;
+	pthread_mutex_lock(&clock->update_mutex);
+	if (g_source_get_id(g_main_current_source()) != clock->timer_id) {
+		// superseded by the timer of a clock started since
+		pthread_mutex_unlock(&clock->update_mutex);
+		return G_SOURCE_REMOVE;
+	}
+	TRACE_BEGIN("clock_tick");
+	metrics_sample(METRIC_CLOCK_JITTER, now - clock->tick_due);
+
+	clock->timer_id = 0;
+	if (clock->started_at[0]) {
+		color = 0;
+	} else if (clock->started_at[1]) {
+		color = 1;
+	}
+	if (color > -1) {
+		clock_stats_tick(color, now - clock->tick_due);
+		arm_clock_timer(clock, now, color);
+	}
+	pthread_mutex_unlock(&clock->update_mutex);
 
-		// sleep approx 100ms
-		usleep(CLOCK_INTERVAL);
+	if (color > -1 && clock->parent != NULL) {
+		refresh_one_clock(GTK_WIDGET(clock->parent), color);
 	}
+	TRACE_END("clock_tick");
+	return G_SOURCE_REMOVE;
 }
-#pragma clang diagnostic pop
 
 chess_clock *clock_new(int initial_time_s, int incerement_s, int relation) {
 
@@ -111,27 +146,23 @@ chess_clock *clock_new(int initial_time_s, int incerement_s, int relation) {
 		return NULL;
 	}
 	clock->relation = relation;
+	clock->parent = NULL;
 
 	// Set initial values into the clock
-	clock->remaining_time[0].tv_sec = initial_time_s;
-	clock->remaining_time[0].tv_usec = 0;
-
-	clock->remaining_time[1].tv_sec = initial_time_s;
-	clock->remaining_time[1].tv_usec = 0;
-
-	/* setting this field to 0 is
-	 * our convention to say that the clock was stopped */
-	clock->last_modified_time[0].tv_sec = 0;
-	clock->last_modified_time[1].tv_sec = 0;
-
-	sem_init(&clock->sem_white, 0, 0); // locked state
-	sem_init(&clock->sem_black, 0, 0); // locked state
-	pthread_mutex_init(&clock->update_mutex, NULL);// = PTHREAD_MUTEX_INITIALIZER;
-
-	// Spawn both white and black runner threads
-	// (both in blocked state)
-	pthread_create(&clock->white_clock_runner, NULL, white_clock_runner_function, clock);
-	pthread_create(&clock->black_clock_runner, NULL, black_clock_runner_function, clock);
+	clock->remaining_us[0] = (gint64) initial_time_s * G_USEC_PER_SEC;
+	clock->remaining_us[1] = (gint64) initial_time_s * G_USEC_PER_SEC;
+
+	// both clocks stopped
+	clock->started_at[0] = 0;
+	clock->started_at[1] = 0;
+	clock->slew_us[0] = 0;
+	clock->slew_us[1] = 0;
+	clock->slew_from[0] = 0;
+	clock->slew_from[1] = 0;
+	clock->timer_id = 0;
+	clock->tick_due = 0;
+
+	pthread_mutex_init(&clock->update_mutex, NULL);
 	return clock;
 }
 
@@ -155,15 +186,11 @@ void clock_reset(chess_clock *clock, int initial_time, int increment, int relati
 }
 
 void clock_destroy(chess_clock *clock) {
-	pthread_cancel(clock->white_clock_runner);
-	pthread_cancel(clock->black_clock_runner);
-	pthread_join(clock->white_clock_runner, NULL);
-	pthread_join(clock->black_clock_runner, NULL);
-
-	sem_post(&clock->sem_white);
-	sem_destroy(&clock->sem_white);
-	sem_post(&clock->sem_black);
-	sem_destroy(&clock->sem_black);
+	pthread_mutex_lock(&clock->update_mutex);
+	if (clock->timer_id) {
+		g_source_remove(clock->timer_id);
+		clock->timer_id = 0;
+	}
 	pthread_mutex_unlock(&clock->update_mutex);
 	pthread_mutex_destroy(&clock->update_mutex);
 
@@ -172,42 +199,60 @@ void clock_destroy(chess_clock *clock) {
 
 /* this is thread safe */
 void update_clocks(chess_clock *clock, int white_s, int black_s, bool shouldLock) {
+	gint64 now = g_get_monotonic_time();
+	int color;
 	pthread_mutex_lock(&clock->update_mutex);
-	clock->remaining_time[0].tv_sec = white_s;
-	clock->remaining_time[0].tv_usec = 0;
-	clock->remaining_time[1].tv_sec = black_s;
-	clock->remaining_time[1].tv_usec = 0;
-	pthread_mutex_unlock(&clock->update_mutex);
-	if (shouldLock) {
-		gdk_threads_enter();
+	clock->remaining_us[0] = (gint64) white_s * G_USEC_PER_SEC;
+	clock->remaining_us[1] = (gint64) black_s * G_USEC_PER_SEC;
+	for (color = 0; color < 2; color++) {
+		clock->slew_us[color] = 0;
+		if (clock->started_at[color]) {
+			// count down the new time from now
+			clock->started_at[color] = now;
+			arm_clock_timer(clock, now, color);
+		}
 	}
-	refresh_both_clocks(GTK_WIDGET(clock->parent));
+	pthread_mutex_unlock(&clock->update_mutex);
 	if (shouldLock) {
-		gdk_threads_leave();
+		ui_queue_clock_refresh(GTK_WIDGET(clock->parent), 0);
+		ui_queue_clock_refresh(GTK_WIDGET(clock->parent), 1);
+	} else {
+		refresh_both_clocks(GTK_WIDGET(clock->parent));
 	}
 }
 
-// locks the associated runner function and reset the mtime
+// takes the time used since the clock started off its remaining time
 void stop_one_clock(chess_clock *clock, int color, bool should_lock) {
 
-	sem_wait(color ? &clock->sem_black : &clock->sem_white);
-
 	pthread_mutex_lock(&clock->update_mutex);
-	clock->last_modified_time[color].tv_sec = 0;
+	if (clock->started_at[color]) {
+		rebase_clock(clock, color, g_get_monotonic_time());
+		clock->started_at[color] = 0;
+	}
+	if (!clock->started_at[0] && !clock->started_at[1] && clock->timer_id) {
+		// frozen, no more ticks until a clock starts again
+		g_source_remove(clock->timer_id);
+		clock->timer_id = 0;
+	}
 	pthread_mutex_unlock(&clock->update_mutex);
 
 	refresh_one_clock(GTK_WIDGET(clock->parent), color);
 }
 
-// unlocks the associated runner funtion
+// starts counting down from now and wakes up when the display should change
 void start_one_clock(chess_clock *clock, int color) {
-	sem_post(color ? &clock->sem_black : &clock->sem_white);
+	pthread_mutex_lock(&clock->update_mutex);
+	if (!clock->started_at[color]) {
+		gint64 now = g_get_monotonic_time();
+		clock->started_at[color] = now;
+		clock->slew_us[color] = 0;
+		arm_clock_timer(clock, now, color);
+	}
+	pthread_mutex_unlock(&clock->update_mutex);
 }
 
 int is_active(chess_clock *clock, int color) {
-	int ret;
-	sem_getvalue(color ? &clock->sem_black : &clock->sem_white, &ret);
-	return ret;
+	return clock->started_at[color] != 0;
 }
 
 void swap_clocks(chess_clock *clock, bool shouldLock) {
@@ -238,8 +283,68 @@ void start_one_stop_other_clock(chess_clock *clock, int color_to_start, bool sho
 	}
 }
 
+/* Time left on a side, counted from its start timestamp while it runs, negative once expired */
+gint64 get_remaining_usec(chess_clock *clock, int color) {
+	pthread_mutex_lock(&clock->update_mutex);
+	gint64 usec = remaining_at(clock, color, g_get_monotonic_time());
+	pthread_mutex_unlock(&clock->update_mutex);
+	return usec;
+}
+
+/* Give usec back to a side, running or not */
+void credit_one_clock(chess_clock *clock, int color, gint64 usec) {
+	pthread_mutex_lock(&clock->update_mutex);
+	clock->remaining_us[color] += usec;
+	if (clock->started_at[color]) {
+		arm_clock_timer(clock, g_get_monotonic_time(), color);
+	}
+	pthread_mutex_unlock(&clock->update_mutex);
+
+	if (clock->parent != NULL) {
+		ui_queue_clock_refresh(GTK_WIDGET(clock->parent), color);
+	}
+}
+
+/* Pull a side's time into [server_us, server_us + resolution_us), where the server says it is
+ * Time already in there is kept, so the display keeps its fractions of a second.
+ * A running side is slewed in over CLOCK_SLEW_US unless the correction is larger than that,
+ * a stopped one is set. Returns the correction, 0 if the local time agreed with the server,
+ * and the local time before it in local_us */
+gint64 sync_one_clock(chess_clock *clock, int color, gint64 server_us, gint64 resolution_us, gint64 *local_us) {
+	gint64 now = g_get_monotonic_time();
+	gint64 correction = 0;
+
+	pthread_mutex_lock(&clock->update_mutex);
+	gint64 local = remaining_at(clock, color, now);
+	*local_us = local;
+	if (local < server_us) {
+		correction = server_us - local;
+	} else if (local >= server_us + resolution_us) {
+		correction = server_us + resolution_us - 1 - local;
+	}
+	if (correction) {
+		rebase_clock(clock, color, now);
+		if (clock->started_at[color] && labs((long) correction) < CLOCK_SLEW_US) {
+			clock->slew_us[color] = correction;
+			clock->slew_from[color] = now;
+			arm_clock_timer(clock, now, color);
+		} else {
+			clock->remaining_us[color] += correction;
+			if (clock->started_at[color]) {
+				arm_clock_timer(clock, now, color);
+			}
+		}
+	}
+	pthread_mutex_unlock(&clock->update_mutex);
+
+	if (correction && clock->parent != NULL) {
+		ui_queue_clock_refresh(GTK_WIDGET(clock->parent), color);
+	}
+	return correction;
+}
+
 long get_remaining_time(chess_clock *clock, int color) {
-	long millis = tv_to_ms(&clock->remaining_time[color]);
+	long millis = (long) (get_remaining_usec(clock, color) / 1000);
 	if (millis < 0) {
 		millis = 0;
 	}
@@ -248,8 +353,8 @@ long get_remaining_time(chess_clock *clock, int color) {
 
 void print_clock(chess_clock *clock) {
 	char black_time[32], white_time[32];
-	ms_to_string(tv_to_ms(&clock->remaining_time[0]), white_time);
-	ms_to_string(tv_to_ms(&clock->remaining_time[1]), black_time);
+	ms_to_string((long) (get_remaining_usec(clock, 0) / 1000), white_time);
+	ms_to_string((long) (get_remaining_usec(clock, 1) / 1000), black_time);
 	fprintf(stdout, "\rWhite time: [%s] - Black time: [%s]\n", white_time, black_time);
 }
 
@@ -348,17 +453,14 @@ void clock_to_string(chess_clock *clock, int color, char clock_string[], char gh
 }
 
 int is_clock_expired(chess_clock *clock, int color) {
-	return timercmp( &clock->remaining_time[color], &zero_tv, < );
+	return get_remaining_usec(clock, color) < -CLOCK_EXPIRY_MARGIN;
 }
 
 int am_low_on_time(chess_clock *clock) {
 	if (!clock->relation) return 0;
 	long my_time =       get_remaining_time(clock, (clock->relation > 0 ? 0 : 1));
 	long opponent_time = get_remaining_time(clock, (clock->relation > 0 ? 1 : 0));
-	if (opponent_time > 0) {
-		return 1000 * my_time / opponent_time < 667; // my time is less than 2/3 of my opponent's
-	}
-	return 0;
+	return is_low_on_time(my_time, opponent_time);
 }
 
 int clock_main(void) {
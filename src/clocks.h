@@ -2,7 +2,6 @@
 #define __CAIRO_CHESS_CLOCKS_H__
 
 #include <pthread.h>
-#include <semaphore.h>
 #include <sys/time.h>
 #include <gtk/gtk.h>
 #include <stdbool.h>
@@ -10,12 +9,12 @@
 typedef struct _chess_clock {
 	int initial_time; // in seconds
 	int increment; // in seconds
-	struct timeval remaining_time[2]; // timeval values [0] is white_time, [1] is black_time
-	struct timeval last_modified_time[2]; // timeval values [0] is white_time, [1] is black_time
-	pthread_t white_clock_runner;
-	pthread_t black_clock_runner;
-	sem_t sem_white;
-	sem_t sem_black;
+	gint64 remaining_us[2]; // [0] is white_time, [1] is black_time, as of started_at while running
+	gint64 started_at[2]; // monotonic time the side's clock was started, 0 while stopped
+	gint64 slew_us[2]; // correction being spread into a running side's time since slew_from
+	gint64 slew_from[2];
+	guint timer_id; // one timer for both sides, due when the running side's display next changes
+	gint64 tick_due;
 	pthread_mutex_t update_mutex;
 
 	/* my relation to this clock: 
@@ -34,8 +33,6 @@ chess_clock *clock_new(int initial_time_s, int incerement_s, int relation);
 void clock_destroy(chess_clock *);
 void clock_reset(chess_clock *clock, int initial_time, int increment, int relation, bool should_lock);
 void clock_freeze(chess_clock *clock);
-void *black_clock_runner_function(void *);
-void *white_clock_runner_function(void *);
 void start_one_clock(chess_clock *, int);
 void stop_one_clock(chess_clock *, int, bool);
 void swap_clocks(chess_clock *clock, bool);
@@ -48,6 +45,9 @@ void ms_to_string(long, char[]);
 void clock_to_string(chess_clock *, int, char[], char[]);
 void update_clocks(chess_clock *, int, int, bool);
 long get_remaining_time(chess_clock *, int);
+gint64 get_remaining_usec(chess_clock *, int);
+void credit_one_clock(chess_clock *clock, int color, gint64 usec);
+gint64 sync_one_clock(chess_clock *clock, int color, gint64 server_us, gint64 resolution_us, gint64 *local_us);
 int am_low_on_time(chess_clock *clock);
 void set_parent_widget(GtkWidget *parent);
 
@@ -4,6 +4,9 @@
  *  Created on: 24 Nov 2009
  *      Author: hts
  */
+
+#define LOG_SUBSYSTEM LOG_DRAW
+
 #include <stdlib.h>
 #include <gtk/gtk.h>
 
@@ -18,27 +21,31 @@
 #include "cairo-board.h"
 #include "chess-backend.h"
 #include "crafty-adapter.h"
+#include "trace.h"
+#include "metrics.h"
+#include "sprite-cache.h"
+#include "board-context.h"
+#include "clock-sync.h"
 
 chess_game *main_game;
 
 /* Prototypes */
-static void clean_last_drag_step(cairo_t *cdc, double wi, double hi);
-static void plot_coords(double start[2], double mid[2], double end[2], int points_to_plot, double **plots, int *nPlots);
+static void clean_last_drag_step(cairo_t *cdc, int wi, int hi);
+static double ease_path(double progress);
+static struct anim_data *alloc_anim_data(void);
 static void free_anim_data(struct anim_data *anim);
 static void square_to_rectangle(cairo_t *dc, int col, int row, int wi, int hi);
 static void squares_for_move(cairo_t *dc, int move[4], int wi, int hi);
 static void clip_to_square(cairo_t *dc, int col, int row, int wi, int hi);
-static void highlight_square(cairo_t *dc, int col, int row, double r, double g, double b, double a, int wi, int hi);
-static void highlight_check_square(cairo_t *dc, int col, int row, double r, double g, double b, double a, int wi, int hi);
+static void send_move_to_ics(char *ics_mv, int colour);
+static void highlight_square(int col, int row, double r, double g, double b, double a);
+static void highlight_check_square(int col, int row, double r, double g, double b, double a);
 static void update_dragging_background(chess_piece *piece, int wi, int hi);
 static void restore_dragging_background(chess_piece *piece, int move_result, int wi, int hi);
 static void logical_promote(int last_promote);
 
-static const char *FONT_FACE = "Sans";
-
 enum layer_id {
 	BOARD_LAYER = 0,
-	HIGHLIGHT_UNDER_LAYER,
 	COORDINATES_LAYER,
 	PIECES_LAYER,
 	HIGHLIGHT_OVER_LAYER,
@@ -47,22 +54,78 @@ enum layer_id {
 	DRAGGING_BACKGROUND
 };
 
-cairo_surface_t *board_layer = NULL;
-cairo_surface_t *highlight_under_layer = NULL;
-cairo_surface_t *coordinates_layer = NULL;
-cairo_surface_t *pieces_layer = NULL;
-cairo_surface_t *highlight_over_layer = NULL;
+// Board, coordinates, pieces and cache layers of the board we play on
+board_context *main_board = NULL;
 
-cairo_surface_t *cache_layer = NULL;
+cairo_surface_t *highlight_over_layer = NULL;
 cairo_surface_t *dragging_background = NULL;
 
 RsvgHandle *piecesSvg[12];
-cairo_surface_t *piece_surfaces[12];
+cairo_surface_t *piece_surfaces[12]; // borrowed from main_board's sprite set
 
 GHashTable *anims_map;
 
+// Move animations come from a fixed pool, see alloc_anim_data
+static struct anim_data anim_pool[ANIM_POOL_SIZE];
+static struct anim_data *anim_free_list = NULL;
+static bool anim_pool_ready = false;
+static pthread_mutex_t anim_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Fraction of the start->mid->end path covered at progress (0 to 1) through the animation
+ * Exponential ease in to the halfway point and out from it, a step covering ANIM_EASE_RATE
+ * times the distance of the first step by the middle */
+static double ease_path(double progress) {
+	if (progress <= 0.0) {
+		return 0.0;
+	}
+	if (progress >= 1.0) {
+		return 1.0;
+	}
+	if (progress < 0.5) {
+		return 0.5 * (pow(ANIM_EASE_RATE, 2.0 * progress) - 1.0) / (ANIM_EASE_RATE - 1.0);
+	}
+	return 1.0 - 0.5 * (pow(ANIM_EASE_RATE, 2.0 * (1.0 - progress)) - 1.0) / (ANIM_EASE_RATE - 1.0);
+}
+
+/* Take an animation from the pool, NULL when all ANIM_POOL_SIZE are running
+ * Called from whichever thread plays the move, freed on the main loop */
+static struct anim_data *alloc_anim_data(void) {
+	int i;
+	struct anim_data *anim;
+
+	pthread_mutex_lock(&anim_pool_lock);
+	if (!anim_pool_ready) {
+		for (i = ANIM_POOL_SIZE - 1; i >= 0; i--) {
+			anim_pool[i].next_free = anim_free_list;
+			anim_free_list = &anim_pool[i];
+		}
+		anim_pool_ready = true;
+	}
+	anim = anim_free_list;
+	if (anim != NULL) {
+		anim_free_list = anim->next_free;
+	}
+	pthread_mutex_unlock(&anim_pool_lock);
+
+	if (anim == NULL) {
+		debug("Animation pool exhausted, move played without animation\n");
+		return NULL;
+	}
+	memset(anim, 0, sizeof(struct anim_data));
+	return anim;
+}
+
+/* Give an animation back to the pool */
+static void free_anim_data(struct anim_data *anim) {
+	pthread_mutex_lock(&anim_pool_lock);
+	anim->next_free = anim_free_list;
+	anim_free_list = anim;
+	pthread_mutex_unlock(&anim_pool_lock);
+}
+
 static gboolean is_scaled = false;
 static bool just_made_premove = false;
+static guint drag_tick_id = 0;
 
 static chess_piece *mouse_clicked_piece = NULL;
 static chess_piece *mouse_dragged_piece = NULL;
@@ -80,170 +143,36 @@ struct anim_data *get_anim_for_piece(chess_piece *piece) {
 	return g_hash_table_lookup(anims_map, piece);
 }
 
+void init_main_board(GtkWidget *widget, chess_game *game) {
+	main_board = board_context_new(widget, game);
+}
+
+/* Device scale factor of the board window, 1 until it is realized */
+int board_scale_factor(void) {
+	return board_context_scale_factor(main_board);
+}
+
 void update_pieces_surfaces(int wi, int hi) {
-	cairo_t *dc;
 	int i;
+	board_context_set_sprites(main_board, wi, hi);
 	for (i = 0; i < 12; i++) {
-		cairo_surface_destroy(piece_surfaces[i]);
-		piece_surfaces[i] = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, (int) (((double) wi) / 8.0f),
-		                                               (int) (((double) hi) / 8.0f));
-		dc = cairo_create(piece_surfaces[i]);
-		cairo_scale(dc, wi * svg_w, hi * svg_h);
-		rsvg_handle_render_cairo(piecesSvg[i], dc);
-		cairo_destroy(dc);
+		piece_surfaces[i] = main_board->sprites != NULL ? sprite_set_surface(main_board->sprites, i) : NULL;
 	}
 	assign_surfaces();
 }
 
 /* Internal convenience method */
-void apply_surface_at(cairo_t *cdc, cairo_surface_t *surf, double x, double y, double w, double h) {
-	cairo_set_source_surface(cdc, surf, x, y);
-	cairo_rectangle(cdc, x, y, w, h);
-	cairo_fill(cdc);
+static void apply_piece_at(cairo_t *dc, cairo_surface_t *surf, double x, double y, int wi, int hi) {
+	set_piece_source(dc, surf, x, y, wi, hi);
+	piece_rectangle(dc, x, y, wi, hi);
+	cairo_fill(dc);
 }
 
 void draw_board_surface(int width, int height) {
-
-	int j,k;
-	double tx = width / 8.0;
-	double ty = height / 8.0;
-
-	bool flipped = is_board_flipped();
-
-	// Create a "memory-buffer" surface to draw on
-	cairo_surface_destroy(board_layer);
-	board_layer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
-	cairo_t *cr = cairo_create(board_layer);
-
-	cairo_surface_destroy(coordinates_layer);
-	coordinates_layer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
-	cairo_t *coordinates_cr = cairo_create(coordinates_layer);
-
-	cairo_pattern_t *dark_square_pattern = cairo_pattern_create_rgb(dr, dg, db);
-	cairo_pattern_t *light_square_pattern = cairo_pattern_create_rgb(lr, lg, lb);
-
-	// Shading on light squares
-	cairo_pattern_t *light_gradient_pattern = cairo_pattern_create_radial(.0, .0, .0, .0, .0, (tx + ty) / 3.0f);
-	cairo_pattern_add_color_stop_rgba(light_gradient_pattern, 0.0f, dr, dg, db, 0.25f);
-	cairo_pattern_add_color_stop_rgba(light_gradient_pattern, 1.0f, dr, dg, db, 0.0f);
-
-	// Highlight on dark squares
-	cairo_pattern_t *dark_gradient_pattern = cairo_pattern_create_radial(tx, ty, .0, tx, ty, (tx + ty) / 3.0f);
-	cairo_pattern_add_color_stop_rgba(dark_gradient_pattern, 0.0f, lr, lg, lb, 0.25f);
-	cairo_pattern_add_color_stop_rgba(dark_gradient_pattern, 1.0f, 1, 1, 1, 0.0f);
-
-	// Draw Dark Squares
-	cairo_set_source(cr, dark_square_pattern);
-	for (j = 0; j < 8; j++) {
-		for (k = 0; k < 8; k++) {
-			if (get_square_colour(j, k)) {
-				cairo_rectangle(cr, j*tx, k*ty, tx, ty);
-				cairo_fill(cr);
-
-				// Inner shadow effect
-				cairo_save(cr);
-				cairo_translate(cr, j*tx, k*ty);
-				cairo_set_source (cr, dark_gradient_pattern);
-				cairo_rectangle(cr, 0, 0, tx, ty);
-				cairo_fill(cr);
-				cairo_restore(cr);
-
-			}
-		}
-	}
-
-	// Draw Light Squares
-	cairo_set_source(cr, light_square_pattern);
-	for (j = 0; j < 8; j++) {
-		for (k = 0; k < 8; k++) {
-			if (!get_square_colour(j, k)) {
-				cairo_rectangle(cr, j*tx, k*ty, tx, ty);
-				cairo_fill(cr);
-
-				cairo_save(cr);
-				cairo_translate(cr, j*tx, k*ty);
-				cairo_set_source (cr, light_gradient_pattern);
-				cairo_rectangle(cr, 0, 0, tx, ty);
-				cairo_fill(cr);
-				cairo_restore(cr);
-			}
-		}
-	}
-
-	// Draw smoothing lines between squares
-	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
-	cairo_set_source_rgb(cr, (dr + lr) / 2.0f, (dg + lg) / 2.0f, (db + lb) / 2.0f);
-	cairo_set_line_width(cr, 1.0f);
-
-	// Vertical lines
-	for (j = 0; j <= 8; j++) {
-		cairo_move_to (cr, j * tx, 0);
-		cairo_line_to(cr, j * tx, height);
-	}
-	// Horizontal lines
-	for (j = 0; j <= 8; j++) {
-		cairo_move_to (cr, 0, j * ty);
-		cairo_line_to(cr, width, j * ty);
-	}
-	cairo_stroke (cr);
-
-	// Draw coordinates
-	PangoFontDescription *desc;
-	PangoLayout *layout;
-	layout = pango_cairo_create_layout(coordinates_cr);
-	char font_str[32];
-	float font_size = (float) (10 * tx / 100.0f);
-	sprintf(font_str, "%s %.1f", FONT_FACE, font_size);
-	desc = pango_font_description_from_string(font_str);
-	pango_font_description_set_weight(desc, PANGO_WEIGHT_SEMIBOLD);
-	pango_layout_set_font_description(layout, desc);
-	pango_font_description_free(desc);
-
-	double padding = tx / 60.0;
-	char coord[1];
-	bool light;
-
-	// Column names
-	light = true;
-	for (j = 0; j <= 8; j++) {
-		cairo_save(coordinates_cr);
-		cairo_set_source(coordinates_cr, light ? light_square_pattern : dark_square_pattern);
-		coord[0] = (char) (flipped ? 'h' - j : 'a' + j);
-		pango_layout_set_text(layout, coord, 1);
-		int pix_width;
-		int pix_height;
-		pango_layout_get_pixel_size(layout, &pix_width, &pix_height);
-		cairo_translate(coordinates_cr, (j * tx) + padding, height - pix_height - padding);
-		pango_cairo_show_layout(coordinates_cr, layout);
-		cairo_restore(coordinates_cr);
-		light = !light;
-	}
-
-	// Rank numbers
-	light = true;
-	for (j = 0; j <= 8; j++) {
-		cairo_save(coordinates_cr);
-		cairo_set_source(coordinates_cr, light ? light_square_pattern : dark_square_pattern);
-		coord[0] = (char) (flipped ? '1' + j : '8' - j);
-		pango_layout_set_text(layout, coord, 1);
-		int pix_width;
-		int pix_height;
-		pango_layout_get_pixel_size(layout, &pix_width, &pix_height);
-		cairo_translate(coordinates_cr, width - pix_width - padding, (j * tx) + padding);
-		pango_cairo_show_layout(coordinates_cr, layout);
-		cairo_restore(coordinates_cr);
-		light = !light;
-	}
-
-	cairo_destroy(cr);
-	cairo_destroy(coordinates_cr);
-	cairo_pattern_destroy(dark_square_pattern);
-	cairo_pattern_destroy(light_square_pattern);
-	cairo_pattern_destroy(dark_gradient_pattern);
-	cairo_pattern_destroy(light_gradient_pattern);
+	main_board->flipped = is_board_flipped();
+	board_context_draw_board(main_board, width, height);
 }
 
-
 void rebuild_surfaces(int swi, int shi) {
 	// re-render source surfaces only if size has changed
 	if (needs_update) {
@@ -254,45 +183,18 @@ void rebuild_surfaces(int swi, int shi) {
 }
 
 void draw_pieces_surface(int width, int height) {
-
-	cairo_t* dc = NULL;
-	int i;
-
-	cairo_surface_destroy(pieces_layer);
-	pieces_layer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
-	dc = cairo_create(pieces_layer);
-
-	double xy[2];
-	for (i = 0; i < 16; i++) {
-		if (!main_game->white_set[i].dead) {
-			piece_to_xy(&main_game->white_set[i], xy, width, height);
-			apply_surface_at(dc, main_game->white_set[i].surf, xy[0] - width / 16.0f, xy[1] - height / 16.0f,
-			                 width / 8.0f, height / 8.0f);
-		}
-		if (!main_game->black_set[i].dead) {
-			piece_to_xy(&main_game->black_set[i], xy, width, height);
-			apply_surface_at(dc, main_game->black_set[i].surf, xy[0] - width / 16.0f, xy[1] - height / 16.0f,
-			                 width / 8.0f, height / 8.0f);
-		}
-	}
-
-	cairo_destroy(dc);
-
+	board_context_draw_pieces(main_board, width, height);
 }
 
 void update_pieces_surface_by_loc(int width, int height, int old_col, int old_row, int new_col, int new_row) {
 	double xy[2];
-	double sq_width = width / 8.0f;
-	double sq_height = height / 8.0f;
-	double half_sq_width = width / 16.0f;
-	double half_sq_height = height / 16.0f;
 
-	cairo_t *dc = cairo_create(pieces_layer);
+	cairo_t *dc = cairo_create(main_board->pieces_layer);
 	cairo_save(dc);
 
 	// Clean out old piece from surface
 	loc_to_xy(old_col, old_row, xy, width, height);
-	cairo_rectangle(dc, floor(xy[0] - half_sq_width), floor(xy[1] - half_sq_height), ceil(sq_width), ceil(sq_height));
+	piece_rectangle(dc, xy[0], xy[1], width, height);
 	cairo_clip(dc);
 	cairo_set_source_rgba(dc, 0.0f, 0.0f, 0.0f, 0.0f);
 	cairo_set_operator(dc, CAIRO_OPERATOR_SOURCE);
@@ -307,10 +209,10 @@ void update_pieces_surface_by_loc(int width, int height, int old_col, int old_ro
 	}
 	if (piece != NULL) {
 		loc_to_xy(piece->pos.column, piece->pos.row, xy, width, height);
-		cairo_rectangle(dc, floor(xy[0] - half_sq_width), floor(xy[1] - half_sq_height), ceil(sq_width), ceil(sq_height));
+		piece_rectangle(dc, xy[0], xy[1], width, height);
 		cairo_clip(dc);
 		cairo_set_operator(dc, CAIRO_OPERATOR_SOURCE);
-		apply_surface_at(dc, piece->surf, xy[0] - half_sq_width, xy[1] - half_sq_height, sq_width, sq_height);
+		apply_piece_at(dc, piece->surf, xy[0], xy[1], width, height);
 	}
 	cairo_destroy(dc);
 }
@@ -318,17 +220,13 @@ void update_pieces_surface_by_loc(int width, int height, int old_col, int old_ro
 // This must be called after a real move
 void update_pieces_surface(int width, int height, int old_col, int old_row, chess_piece *piece) {
 	double xy[2];
-	double sq_width = width / 8.0f;
-	double sq_height = height / 8.0f;
-	double half_sq_width = width / 16.0f;
-	double half_sq_height = height / 16.0f;
 
-	cairo_t *dc = cairo_create(pieces_layer);
+	cairo_t *dc = cairo_create(main_board->pieces_layer);
 	cairo_save(dc);
 
 	// Clean out old piece from surface
 	loc_to_xy(old_col, old_row, xy, width, height);
-	cairo_rectangle(dc, floor(xy[0] - half_sq_width), floor(xy[1] - half_sq_height), ceil(sq_width), ceil(sq_height));
+	piece_rectangle(dc, xy[0], xy[1], width, height);
 	cairo_clip(dc);
 	cairo_set_source_rgba(dc, 0.0f, 0.0f, 0.0f, 0.0f);
 	cairo_set_operator(dc, CAIRO_OPERATOR_SOURCE);
@@ -339,32 +237,28 @@ void update_pieces_surface(int width, int height, int old_col, int old_row, ches
 	// Add new piece to surface
 	if (piece != NULL) {
 		loc_to_xy(piece->pos.column, piece->pos.row, xy, width, height);
-		cairo_rectangle(dc, floor(xy[0] - half_sq_width), floor(xy[1] - half_sq_height), ceil(sq_width), ceil(sq_height));
+		piece_rectangle(dc, xy[0], xy[1], width, height);
 		cairo_clip(dc);
 		cairo_set_operator(dc, CAIRO_OPERATOR_SOURCE);
-		apply_surface_at(dc, piece->surf, xy[0] - width / 16.0f, xy[1] - height / 16.0f, width / 8.0f, height / 8.0f);
+		apply_piece_at(dc, piece->surf, xy[0], xy[1], width, height);
 	}
 	cairo_destroy(dc);
 }
 
 void piece_to_ghost(chess_piece *piece, int wi, int hi) {
 	double xy[2];
-	double sq_width = wi / 8.0f;
-	double sq_height = hi / 8.0f;
-	double half_sq_width = wi / 16.0f;
-	double half_sq_height = hi / 16.0f;
 
-	cairo_t *dc = cairo_create(pieces_layer);
+	cairo_t *dc = cairo_create(main_board->pieces_layer);
 
 	// Clean out old piece from surface
 	loc_to_xy(piece->pos.column, piece->pos.row, xy, wi, hi);
-	cairo_rectangle(dc, floor(xy[0] - half_sq_width), floor(xy[1] - half_sq_height), ceil(sq_width), ceil(sq_height));
+	piece_rectangle(dc, xy[0], xy[1], wi, hi);
 	cairo_clip(dc);
 	cairo_set_operator(dc, CAIRO_OPERATOR_SOURCE);
 	cairo_set_source_rgba(dc, 0.0f, 0.0f, 0.0f, 0.0f);
 	cairo_paint(dc);
 	// Add piece ghost to surface
-	cairo_set_source_surface(dc, piece->surf, xy[0] - half_sq_width, xy[1] - half_sq_height);
+	set_piece_source(dc, piece->surf, xy[0], xy[1], wi, hi);
 	cairo_paint_with_alpha(dc, 0.35);
 	cairo_destroy(dc);
 }
@@ -376,75 +270,114 @@ void kill_piece_from_surface(int width, int height, int col, int row) {
 // Restore piece to pieces_layer surface
 void restore_piece_to_surface(int width, int height, chess_piece *piece) {
 
-	// size of a square
-	double ww = width/8.0f;
-	double hh = height/8.0f;
-
 	// Add new piece to surface
 	if (piece != NULL) {
 		double xy[2];
-		cairo_t *dc = cairo_create(pieces_layer);
+		cairo_t *dc = cairo_create(main_board->pieces_layer);
 		loc_to_xy(piece->pos.column, piece->pos.row, xy, width, height);
-		cairo_rectangle(dc, floor(xy[0] - width / 16.0f), floor(xy[1] - height / 16.0f), ceil(ww), ceil(hh));
+		piece_rectangle(dc, xy[0], xy[1], width, height);
 		cairo_clip(dc);
 		cairo_set_operator(dc, CAIRO_OPERATOR_SOURCE);
-		apply_surface_at(dc, piece->surf, xy[0] - width / 16.0f, xy[1] - height / 16.0f, ww, hh);
+		apply_piece_at(dc, piece->surf, xy[0], xy[1], width, height);
 		cairo_destroy(dc);
 	}
 
 }
 
-void paint_layers(cairo_t *cdc) {
-	// Board
-	cairo_set_operator(cdc, CAIRO_OPERATOR_SOURCE);
-	cairo_set_source_surface(cdc, board_layer, 0.0f, 0.0f);
-	cairo_paint(cdc);
+void damage_rectangle(int x, int y, int width, int height) {
+	board_context_damage_rectangle(main_board, x, y, width, height);
+}
 
-	cairo_set_operator(cdc, CAIRO_OPERATOR_OVER);
+void damage_square(int col, int row, int wi, int hi) {
+	board_context_damage_square(main_board, col, row, wi, hi);
+}
 
-	// Under light
-	cairo_set_source_surface(cdc, highlight_under_layer, 0.0f, 0.0f);
-	cairo_paint(cdc);
+void damage_board(void) {
+	damage_rectangle(0, 0, old_wi, old_hi);
+}
 
-	// Coordinates
-	cairo_set_source_surface(cdc, coordinates_layer, 0.0f, 0.0f);
-	cairo_paint(cdc);
+/* Queue a redraw of the damaged regions only, draw_cheap_repaint will composite them
+ * Must be called with the GDK lock held */
+void queue_board_damage(void) {
+	int i;
+	if (board == NULL) {
+		// rendering offscreen, see render-bench.c
+		return;
+	}
+	cairo_region_t *damage = board_context_peek_damage(main_board);
+
+	if (damage == NULL) {
+		return;
+	}
+	if (is_scaled) {
+		// cache_layer coordinates don't match the widget's until de-scaled
+		gtk_widget_queue_draw(board);
+	} else {
+		for (i = 0; i < cairo_region_num_rectangles(damage); i++) {
+			cairo_rectangle_int_t rect;
+			cairo_region_get_rectangle(damage, i, &rect);
+			gtk_widget_queue_draw_area(board, rect.x, rect.y, rect.width, rect.height);
+		}
+	}
+	cairo_region_destroy(damage);
+}
 
-	// Pieces
-	cairo_set_source_surface(cdc, pieces_layer, 0.0f, 0.0f);
-	cairo_paint(cdc);
+/* Queue a redraw of part of the board, cache_layer gets blitted there on the next frame
+ * Coordinates are in cache_layer space */
+static void queue_board_area(double x, double y, double width, double height) {
+	if (board == NULL) {
+		// rendering offscreen, see render-bench.c
+		return;
+	}
+	if (is_scaled) {
+		x *= w_ratio;
+		width *= w_ratio;
+		y *= h_ratio;
+		height *= h_ratio;
+	}
+	// smallest whole-pixel area covering it, only fractional once scaled
+	int x0 = (int) floor(x);
+	int y0 = (int) floor(y);
+	gtk_widget_queue_draw_area(board, x0, y0, (int) ceil(x + width) - x0, (int) ceil(y + height) - y0);
+}
+
+/* Queue a redraw of the cell covered by a piece sprite centred on x,y */
+static void queue_piece_area(double x, double y, int wi, int hi) {
+	cairo_rectangle_int_t cell;
+	piece_cell(x, y, wi, hi, &cell);
+	queue_board_area(cell.x, cell.y, cell.width, cell.height);
+}
+
+void paint_layers(cairo_t *cdc) {
+	board_context_paint_layers(main_board, cdc, old_wi, old_hi);
 
 	// Over light
 //	cairo_set_source_surface(cdc, highlight_over_layer, 0.0f, 0.0f);
 //	cairo_paint(cdc);
 }
 
-void init_highlight_under_surface(int wi, int hi) {
-	cairo_surface_destroy(highlight_under_layer);
-	highlight_under_layer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, wi, hi);
+void clear_square_highlights(void) {
+	board_context_clear_highlights(main_board);
 }
 
 void init_highlight_over_surface(int wi, int hi) {
 	cairo_surface_destroy(highlight_over_layer);
-	highlight_over_layer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, wi, hi);
+	highlight_over_layer = board_context_create_layer(main_board, CAIRO_CONTENT_COLOR_ALPHA, wi, hi);
 }
 
 void draw_full_update(cairo_t *cdr, int wi, int hi) {
+	TRACE_FUNCTION();
 
 	rebuild_surfaces(wi, hi);
 	draw_pieces_surface(wi, hi);
 
 	// Re-highlight highlighted square if any
-	init_highlight_under_surface(wi, hi);
-	if (mouse_clicked[0] >= 0 || king_in_check_piece != NULL) {
-		cairo_t *high_cr = cairo_create(highlight_under_layer);
-		if (mouse_clicked[0] >= 0) {
-			highlight_square(high_cr, mouse_clicked[0], mouse_clicked[1], highlight_selected_r, highlight_selected_g, highlight_selected_b, highlight_selected_a, wi, hi);
-		}
-		if (king_in_check_piece != NULL) {
-			highlight_check_square(high_cr, king_in_check_piece->pos.column, king_in_check_piece->pos.row, check_warn_r, check_warn_g, check_warn_b, check_warn_a, wi, hi);
-		}
-		cairo_destroy(high_cr);
+	clear_square_highlights();
+	if (mouse_clicked[0] >= 0) {
+		highlight_square(mouse_clicked[0], mouse_clicked[1], highlight_selected_r, highlight_selected_g, highlight_selected_b, highlight_selected_a);
+	}
+	if (king_in_check_piece != NULL) {
+		highlight_check_square(king_in_check_piece->pos.column, king_in_check_piece->pos.row, check_warn_r, check_warn_g, check_warn_b, check_warn_a);
 	}
 
 	if (highlight_last_move) {
@@ -464,21 +397,24 @@ void draw_full_update(cairo_t *cdr, int wi, int hi) {
 	old_wi = wi;
 	old_hi = hi;
 
-	cairo_surface_destroy(cache_layer);
-	cache_layer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, wi, hi);
-	cairo_t *cache_cr = cairo_create(cache_layer);
+	cairo_surface_destroy(main_board->cache_layer);
+	main_board->cache_layer = board_context_create_layer(main_board, CAIRO_CONTENT_COLOR, wi, hi);
+	cairo_t *cache_cr = cairo_create(main_board->cache_layer);
 	paint_layers(cache_cr);
 	if (mouse_dragged_piece != NULL && is_moveit_flag()) {
 		debug("Dragged while resetting!\n");
 		double dragged_x, dragged_y;
 		get_dragging_prev_xy(&dragged_x, &dragged_y);
-		cairo_set_source_surface (cache_cr, mouse_dragged_piece->surf, dragged_x-wi/16.0f, dragged_y-hi/16.0f);
+		set_piece_source(cache_cr, mouse_dragged_piece->surf, dragged_x, dragged_y, wi, hi);
 		cairo_set_operator(cache_cr, CAIRO_OPERATOR_OVER);
 		cairo_paint(cache_cr);
 	}
 	cairo_destroy(cache_cr);
 
-	cairo_set_source_surface(cdr, cache_layer, 0, 0);
+	// everything was just composited
+	cairo_region_destroy(board_context_take_damage(main_board));
+
+	cairo_set_source_surface(cdr, main_board->cache_layer, 0, 0);
 	cairo_set_operator(cdr, CAIRO_OPERATOR_SOURCE);
 	cairo_paint(cdr);
 	is_scaled = false;
@@ -494,7 +430,7 @@ void draw_scaled(cairo_t *cdr, int wi, int hi) {
 	cairo_scale(cdr, w_ratio, h_ratio);
 	is_scaled = true;
 
-	cairo_set_source_surface(cdr, cache_layer, 0, 0);
+	cairo_set_source_surface(cdr, main_board->cache_layer, 0, 0);
 	cairo_set_operator(cdr, CAIRO_OPERATOR_SOURCE);
 	cairo_paint(cdr);
 
@@ -502,9 +438,7 @@ void draw_scaled(cairo_t *cdr, int wi, int hi) {
 }
 
 void draw_cheap_repaint(cairo_t *cdr, int wi, int hi) {
-
-	// Just redraw layers
-	cairo_t *cache_cr = cairo_create(cache_layer);
+	TRACE_FUNCTION();
 
 	if (is_scaled) {
 		w_ratio = wi / ((double) old_wi);
@@ -512,20 +446,30 @@ void draw_cheap_repaint(cairo_t *cdr, int wi, int hi) {
 		cairo_scale(cdr, w_ratio, h_ratio);
 	}
 
-	paint_layers(cache_cr);
+	// Re-composite only the regions whose layers changed, the rest of cache_layer is up to date
+	cairo_region_t *damage = board_context_take_damage(main_board);
+	if (damage != NULL) {
+		cairo_t *cache_cr = cairo_create(main_board->cache_layer);
+		gdk_cairo_region(cache_cr, damage);
+		cairo_clip(cache_cr);
 
-	if (mouse_dragged_piece != NULL && is_moveit_flag()) {
-		debug("Dragged while resetting!\n");
-		double dragged_x, dragged_y;
-		get_dragging_prev_xy(&dragged_x, &dragged_y);
-		cairo_set_source_surface (cache_cr, mouse_dragged_piece->surf, dragged_x-wi/16.0f, dragged_y-hi/16.0f);
-		cairo_set_operator(cache_cr, CAIRO_OPERATOR_OVER);
-		cairo_paint(cache_cr);
-	}
+		paint_layers(cache_cr);
 
-	cairo_destroy(cache_cr);
+		if (mouse_dragged_piece != NULL && is_moveit_flag()) {
+			debug("Dragged while resetting!\n");
+			double dragged_x, dragged_y;
+			get_dragging_prev_xy(&dragged_x, &dragged_y);
+			set_piece_source(cache_cr, mouse_dragged_piece->surf, dragged_x, dragged_y, wi, hi);
+			cairo_set_operator(cache_cr, CAIRO_OPERATOR_OVER);
+			cairo_paint(cache_cr);
+		}
 
-	cairo_set_source_surface(cdr, cache_layer, 0, 0);
+		cairo_destroy(cache_cr);
+		cairo_region_destroy(damage);
+	}
+
+	// GTK already clipped cdr to the queued area
+	cairo_set_source_surface(cdr, main_board->cache_layer, 0, 0);
 	cairo_set_operator(cdr, CAIRO_OPERATOR_SOURCE);
 	cairo_paint(cdr);
 }
@@ -598,7 +542,7 @@ void highlightPotentialMoves(GtkWidget *pWidget, chess_piece *piece, int wi, int
 		cairo_clip(cdr);
 		cairo_clip(ddc);
 		paint_layers(ddc);
-		cairo_set_source_surface(cdr, cache_layer, 0, 0);
+		cairo_set_source_surface(cdr, main_board->cache_layer, 0, 0);
 		cairo_paint(cdr);
 	}
 	cairo_destroy(bdc);
@@ -607,14 +551,7 @@ void highlightPotentialMoves(GtkWidget *pWidget, chess_piece *piece, int wi, int
 }
 
 void paint_layers_at_square(cairo_t *dc, int col, int row, int wi, int hi) {
-	double xy[2];
-	double square_width = wi / 8.0f;
-	double square_height = hi / 8.0f;
-	double half_width = square_width / 2.0f;
-	double half_height = square_height / 2.0f;
-
-	loc_to_xy(col, row, xy, wi, hi);
-	cairo_rectangle(dc, xy[0] - half_width - 1, xy[1] - half_height, square_width + 2, square_height + 2);
+	square_to_rectangle(dc, col, row, wi, hi);
 
 	cairo_save(dc);
 	cairo_clip(dc);
@@ -627,58 +564,59 @@ void paint_layers_at_square(cairo_t *dc, int col, int row, int wi, int hi) {
 //	cairo_fill(dc);
 }
 
-void clean_highlight_surface(int col, int row, int wi, int hi) {
-	double xy[2];
-	double square_width = wi / 8.0f;
-	double square_height = hi / 8.0f;
-	double half_width = square_width / 2.0f;
-	double half_height = square_height / 2.0f;
-
-	loc_to_xy(col, row, xy, wi, hi);
-
-	cairo_t *highlight = cairo_create(highlight_under_layer);
-	cairo_rectangle(highlight, xy[0] - half_width - 1, xy[1] - half_height, square_width + 2, square_height + 2);
-	cairo_set_source_rgba(highlight, 0, 0, 0, 0);
-	cairo_set_operator(highlight, CAIRO_OPERATOR_SOURCE);
-	cairo_clip(highlight);
-	cairo_paint(highlight);
-	cairo_destroy(highlight);
+void clean_square_highlights(int col, int row) {
+	board_context_clean_highlights(main_board, col, row);
 }
 
-static gboolean animate_one_step(gpointer data) {
-
-	if (!is_running_flag()) {
-		return FALSE;
+/* Position along the start->mid->end path at the given frame time
+ * Returns true once the animation reached its destination */
+static bool anim_position_at(struct anim_data *anim, gint64 frame_time, double xy[2]) {
+	double progress = (double) (frame_time - anim->start_time) / anim->duration;
+	if (progress >= 1.0) {
+		xy[0] = anim->end[0];
+		xy[1] = anim->end[1];
+		return true;
+	}
+
+	// first half of the eased path runs to mid, second half on to end
+	double eased = 2.0 * ease_path(progress);
+	if (eased < 1.0) {
+		xy[0] = anim->start[0] + eased * (anim->mid[0] - anim->start[0]);
+		xy[1] = anim->start[1] + eased * (anim->mid[1] - anim->start[1]);
+	} else {
+		xy[0] = anim->mid[0] + (eased - 1.0) * (anim->end[0] - anim->mid[0]);
+		xy[1] = anim->mid[1] + (eased - 1.0) * (anim->end[1] - anim->mid[1]);
 	}
+	return false;
+}
 
+/* Paint the frame of a move animation due at frame_time to the layers and queue the areas it changed
+ * Returns G_SOURCE_REMOVE once the animation is over, anim is freed by then */
+gboolean paint_animation_frame(struct anim_data *anim, gint64 frame_time, int wi, int hi) {
+	double step_xy[2];
 	double step_x, step_y;
 	double prev_x, prev_y;
 
-	struct anim_data *anim = (struct anim_data *)data;
-
-	double wi = (double) gtk_widget_get_allocated_width(board);
-	double hi = (double) gtk_widget_get_allocated_height(board);
-
-	step_x = anim->plots[anim->step_index][0];
-	step_y = anim->plots[anim->step_index][1];
-	prev_x = anim->plots[anim->step_index-1][0];
-	prev_y = anim->plots[anim->step_index-1][1];
-
-	double ww = wi/8.0f;
-	double hh = hi/8.0f;
-
-	// First step, remove piece surface from pieces_layer
-	if (anim->step_index < 2) {
+	// First frame, start the clock and remove piece surface from pieces_layer
+	if (!anim->start_time) {
+		anim->start_time = frame_time;
+		anim->prev_xy[0] = anim->start[0];
+		anim->prev_xy[1] = anim->start[1];
 		kill_piece_from_surface(wi, hi, anim->old_col, anim->old_row);
 	}
 
+	bool final_step = anim_position_at(anim, frame_time, step_xy);
+	step_x = step_xy[0];
+	step_y = step_xy[1];
+	prev_x = anim->prev_xy[0];
+	prev_y = anim->prev_xy[1];
+
 	// Animation was killed, find out why
 	if (anim->killed_by || anim->piece->dead) {
 		if (anim->piece->dead) {
 			debug("Piece was killed while being animated! killed by %d\n", anim->killed_by);
 		}
 
-		gdk_threads_enter();
 		// handle promote
 		if (anim->move_result > 0 && anim->move_result & PROMOTE && anim->move_source == AUTO_SOURCE) {
 			debug("Promote from killed anim\n");
@@ -690,20 +628,19 @@ static gboolean animate_one_step(gpointer data) {
 		// clean last step from dragging background
 		cairo_t *dragging_dc = cairo_create(dragging_background);
 		cairo_save(dragging_dc);
-		cairo_rectangle(dragging_dc, floor(prev_x - wi / 16), floor(prev_y - hi / 16), ceil(ww), ceil(hh));
+		piece_rectangle(dragging_dc, prev_x, prev_y, wi, hi);
 		cairo_clip(dragging_dc);
 		paint_layers(dragging_dc);
 
 		// paint buffer surface with dragging background
-		cairo_t *cache_dc = cairo_create(cache_layer);
+		cairo_t *cache_dc = cairo_create(main_board->cache_layer);
 		cairo_save(cache_dc);
 		cairo_set_source_surface(cache_dc, dragging_background, 0.0f, 0.0f);
-		cairo_rectangle(cache_dc, floor(prev_x - wi / 16), floor(prev_y - hi / 16), ceil(ww), ceil(hh));
+		piece_rectangle(cache_dc, prev_x, prev_y, wi, hi);
 		cairo_clip(cache_dc);
 		cairo_paint(cache_dc);
 
-		cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
-		cairo_rectangle(cdr, floor(prev_x - wi / 16), floor(prev_y - hi / 16), ceil(ww), ceil(hh));
+		queue_piece_area(prev_x, prev_y, wi, hi);
 
 		// In case anim was killed by other animated piece taking it or
 		// new anim, repaint piece on its would have been destination
@@ -715,17 +652,14 @@ static gboolean animate_one_step(gpointer data) {
 			double killed_xy[2];
 			cairo_restore(dragging_dc);
 			loc_to_xy(anim->new_col, anim->new_row, killed_xy, wi, hi);
-			cairo_rectangle(dragging_dc, floor(killed_xy[0] - wi / 16), floor(killed_xy[1] - hi / 16), ceil(ww), ceil(hh));
+			piece_rectangle(dragging_dc, killed_xy[0], killed_xy[1], wi, hi);
 			cairo_clip(dragging_dc);
-			cairo_set_operator(cdr, CAIRO_OPERATOR_SOURCE);
-			cairo_set_source_surface(dragging_dc, board_layer, 0.0f, 0.0f);
+			cairo_set_source_surface(dragging_dc, main_board->board_layer, 0.0f, 0.0f);
 			cairo_paint(dragging_dc);
-			cairo_set_operator(cdr, CAIRO_OPERATOR_OVER);
-			cairo_set_source_surface(dragging_dc, highlight_under_layer, 0.0f, 0.0f);
+			board_context_paint_highlights(main_board, dragging_dc, wi, hi);
+			cairo_set_source_surface(dragging_dc, main_board->coordinates_layer, 0.0f, 0.0f);
 			cairo_paint(dragging_dc);
-			cairo_set_source_surface(dragging_dc, coordinates_layer, 0.0f, 0.0f);
-			cairo_paint(dragging_dc);
-			cairo_set_source_surface(dragging_dc, anim->piece->surf, killed_xy[0] - wi / 16, killed_xy[1] - hi / 16);
+			set_piece_source(dragging_dc, anim->piece->surf, killed_xy[0], killed_xy[1], wi, hi);
 			cairo_paint(dragging_dc);
 
 			// debug
@@ -734,13 +668,12 @@ static gboolean animate_one_step(gpointer data) {
 
 			cairo_restore(cache_dc);
 			cairo_save(cache_dc);
-			cairo_rectangle(cache_dc, floor(killed_xy[0] - wi / 16), floor(killed_xy[1] - hi / 16), ceil(ww), ceil(hh));
+			piece_rectangle(cache_dc, killed_xy[0], killed_xy[1], wi, hi);
 			cairo_clip(cache_dc);
-			cairo_set_operator(cdr, CAIRO_OPERATOR_SOURCE);
 			cairo_set_source_surface(cache_dc, dragging_background, 0, 0);
 			cairo_paint(cache_dc);
 			cairo_restore(cache_dc);
-			cairo_rectangle(cdr, floor(killed_xy[0] - wi / 16), floor(killed_xy[1] - hi / 16), ceil(ww), ceil(hh));
+			queue_piece_area(killed_xy[0], killed_xy[1], wi, hi);
 		}
 
 		// If a piece is being dragged and overlaps with the animation, repaint the dragged piece above to cache layer
@@ -748,8 +681,7 @@ static gboolean animate_one_step(gpointer data) {
 			double dragged_x, dragged_y;
 			get_dragging_prev_xy(&dragged_x, &dragged_y);
 			//FIXME: better lock access to mouse_dragged_piece (this could segfault otherwise)
-			cairo_set_source_surface(cache_dc, mouse_dragged_piece->surf, dragged_x - wi / 16.0f,
-			                         dragged_y - hi / 16.0f);
+			set_piece_source(cache_dc, mouse_dragged_piece->surf, dragged_x, dragged_y, wi, hi);
 			cairo_set_operator(cache_dc, CAIRO_OPERATOR_OVER);
 			cairo_paint(cache_dc);
 		}
@@ -757,35 +689,17 @@ static gboolean animate_one_step(gpointer data) {
 		cairo_destroy(dragging_dc);
 		cairo_destroy(cache_dc);
 
-		cairo_clip(cdr);
-
-		// apply buffered surface to cr (NB: cr is clipped)
-		cairo_set_operator(cdr, CAIRO_OPERATOR_OVER);
-		cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
-		cairo_paint(cdr);
-
-		// debug
-//			cairo_set_source_rgba (cdr, 1, 0, 0, .5f);
-//			cairo_paint(cdr);
-
-		cairo_destroy(cdr);
-		/* LEAVE THREADS */
-		gdk_threads_leave();
-
 		if (anim->killed_by != KILLED_BY_OTHER_ANIMATION_SAME_PIECE) {
 			g_hash_table_remove(anims_map, anim->piece);
 		}
 		free_anim_data(anim);
-		return FALSE;
+		return G_SOURCE_REMOVE;
 	}
 
-	/* ENTER THREADS */
-	gdk_threads_enter();
-
 	// clean last step from dragging background - [added since we now paint to dragging_layer]
 	cairo_t *dragging_dc = cairo_create(dragging_background);
 	cairo_save(dragging_dc);
-	cairo_rectangle(dragging_dc, floor(prev_x - wi / 16), floor(prev_y - hi / 16), ceil(ww), ceil(hh));
+	piece_rectangle(dragging_dc, prev_x, prev_y, wi, hi);
 	cairo_clip(dragging_dc);
 	paint_layers(dragging_dc);
 	// debug
@@ -794,14 +708,14 @@ static gboolean animate_one_step(gpointer data) {
 
 	// paint piece on it - [added since we now paint to dragging_layer]
 	cairo_restore(dragging_dc);
-	cairo_set_source_surface(dragging_dc, anim->piece->surf, step_x-wi/16, step_y-hi/16);
-	cairo_rectangle(dragging_dc, floor(step_x-wi/16), floor(step_y-hi/16), ceil(ww), ceil(hh));
+	set_piece_source(dragging_dc, anim->piece->surf, step_x, step_y, wi, hi);
+	piece_rectangle(dragging_dc, step_x, step_y, wi, hi);
 	cairo_clip(dragging_dc);
 	cairo_paint(dragging_dc);
 
 	// debug
 //	cairo_set_source_rgba (dragging_dc, 0, 0, 1, .5f);
-//	cairo_rectangle(dragging_dc, floor(step_x-wi/16), floor(step_y-hi/16), ceil(ww), ceil(hh));
+//	piece_rectangle(dragging_dc, step_x, step_y, wi, hi);
 //	cairo_set_line_width(dragging_dc, 1);
 //	cairo_stroke(dragging_dc);
 //	cairo_paint(dragging_dc);
@@ -809,16 +723,16 @@ static gboolean animate_one_step(gpointer data) {
 	cairo_destroy(dragging_dc);
 
 	// paint buffer surface with dragging background
-	cairo_t *cache_dc = cairo_create(cache_layer);
+	cairo_t *cache_dc = cairo_create(main_board->cache_layer);
 	cairo_set_source_surface (cache_dc, dragging_background, 0.0f, 0.0f);
-	cairo_rectangle(cache_dc, floor(prev_x-wi/16), floor(prev_y-hi/16), ceil(ww), ceil(hh));
-	cairo_rectangle(cache_dc, floor(step_x-wi/16), floor(step_y-hi/16), ceil(ww), ceil(hh));
+	piece_rectangle(cache_dc, prev_x, prev_y, wi, hi);
+	piece_rectangle(cache_dc, step_x, step_y, wi, hi);
 	cairo_clip(cache_dc);
 	cairo_paint(cache_dc);
 
 	// paint animated piece at new position - [removed since we now paint to dragging_layer]
 	//	cairo_set_operator(cache_dc, CAIRO_OPERATOR_OVER);
-	//	cairo_set_source_surface (cache_dc, anim->piece->surf, step_x-wi/16.0f, step_y-hi/16.0f);
+	//	set_piece_source(cache_dc, anim->piece->surf, step_x, step_y, wi, hi);
 	//	cairo_paint(cache_dc);
 
 	// If a piece is being dragged and overlaps with the animation, repaint the dragged piece above to cache layer
@@ -826,45 +740,23 @@ static gboolean animate_one_step(gpointer data) {
 		double dragged_x, dragged_y;
 		get_dragging_prev_xy(&dragged_x, &dragged_y);
 		//FIXME: better lock access to mouse_dragged_piece (this could segfault otherwise)
-		cairo_set_source_surface (cache_dc, mouse_dragged_piece->surf, dragged_x-wi/16.0f, dragged_y-hi/16.0f);
+		set_piece_source(cache_dc, mouse_dragged_piece->surf, dragged_x, dragged_y, wi, hi);
 		cairo_set_operator(cache_dc, CAIRO_OPERATOR_OVER);
 		cairo_paint(cache_dc);
 	}
 
 	cairo_destroy(cache_dc);
 
+	queue_piece_area(step_x, step_y, wi, hi);
+	queue_piece_area(prev_x, prev_y, wi, hi);
 
-	// If the board isn't drawable we're probably exiting
-	// free up allocated memory and stop animation
-	if (gdk_window_is_destroyed(gtk_widget_get_window(board))) {
-		debug("Aborting animation.\n");
-		free_anim_data(anim);
-		gdk_threads_leave();
-		return FALSE;
-	}
-	cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
-	cairo_rectangle(cdr, floor(step_x-wi/16.0f), floor(step_y-hi/16.0f), ceil(ww), ceil(hh));
-	cairo_rectangle(cdr, floor(prev_x-wi/16.0f), floor(prev_y-hi/16.0f), ceil(ww), ceil(hh));
-	cairo_clip(cdr);
-
-	// apply buffered surface to cr (NB: cr is clipped)
-	cairo_set_operator(cdr, CAIRO_OPERATOR_SOURCE);
-	cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
-	cairo_paint(cdr);
-
-	// debug
-//	cairo_set_operator (cdr, CAIRO_OPERATOR_OVER);
-//	cairo_set_source_rgba (cdr, 1, 0, 0, .3f);
-//	cairo_paint(cdr);
-
-	cairo_destroy(cdr);
-
-	anim->step_index++;
-	if (anim->step_index >= anim->n_plots) { // final step
+	anim->prev_xy[0] = step_x;
+	anim->prev_xy[1] = step_y;
+	if (final_step) {
 
 		// clean last step from dragging background
 		cairo_t *dragging_dc = cairo_create(dragging_background);
-		cairo_rectangle(dragging_dc, floor(step_x-wi/16), floor(step_y-hi/16), ceil(ww), ceil(hh));
+		piece_rectangle(dragging_dc, step_x, step_y, wi, hi);
 		cairo_clip(dragging_dc);
 		paint_layers(dragging_dc);
 		cairo_destroy(dragging_dc);
@@ -873,19 +765,21 @@ static gboolean animate_one_step(gpointer data) {
 
 		update_pieces_surface(wi, hi, anim->old_col, anim->old_row, anim->piece);
 
-		cairo_t *cache_dc = cairo_create(cache_layer);
+		cairo_t *cache_dc = cairo_create(main_board->cache_layer);
 
 		// repaint destination square
-		cairo_rectangle(cache_dc, floor(step_x-wi/16.0f), floor(step_y-hi/16.0f), ceil(ww), ceil(hh));
+		piece_rectangle(cache_dc, step_x, step_y, wi, hi);
 		cairo_set_operator (cache_dc, CAIRO_OPERATOR_SOURCE);
-		cairo_set_source_surface(cache_dc, board_layer, 0.0f, 0.0f);
+		cairo_set_source_surface(cache_dc, main_board->board_layer, 0.0f, 0.0f);
 		cairo_fill_preserve(cache_dc);
 		cairo_set_operator (cache_dc, CAIRO_OPERATOR_OVER);
-		cairo_set_source_surface(cache_dc, highlight_under_layer, 0.0f, 0.0f);
-		cairo_fill_preserve(cache_dc);
-		cairo_set_source_surface(cache_dc, coordinates_layer, 0.0f, 0.0f);
+		cairo_save(cache_dc);
+		cairo_clip_preserve(cache_dc);
+		board_context_paint_highlights(main_board, cache_dc, wi, hi);
+		cairo_restore(cache_dc);
+		cairo_set_source_surface(cache_dc, main_board->coordinates_layer, 0.0f, 0.0f);
 		cairo_fill_preserve(cache_dc);
-		cairo_set_source_surface(cache_dc, pieces_layer, 0.0f, 0.0f);
+		cairo_set_source_surface(cache_dc, main_board->pieces_layer, 0.0f, 0.0f);
 
 		// If a piece is being dragged and overlaps with the animation final step
 		// repaint the dragged piece above to cache layer
@@ -894,7 +788,7 @@ static gboolean animate_one_step(gpointer data) {
 			double dragged_x, dragged_y;
 			get_dragging_prev_xy(&dragged_x, &dragged_y);
 			//FIXME: better lock access to mouse_dragged_piece (this could segfault otherwise)
-			cairo_set_source_surface (cache_dc, mouse_dragged_piece->surf, dragged_x-wi/16.0f, dragged_y-hi/16.0f);
+			set_piece_source(cache_dc, mouse_dragged_piece->surf, dragged_x, dragged_y, wi, hi);
 			cairo_set_operator(cache_dc, CAIRO_OPERATOR_OVER);
 		}
 		cairo_fill(cache_dc);
@@ -939,12 +833,12 @@ static gboolean animate_one_step(gpointer data) {
 
 			// repaint rook source square
 			loc_to_xy(oc, or, rook_xy, wi, hi);
-			cairo_rectangle(cache_dc, rook_xy[0]-wi/16.0f, rook_xy[1]-hi/16.0f, ww, hh);
+			piece_rectangle(cache_dc, rook_xy[0], rook_xy[1], wi, hi);
 			cairo_set_operator (cache_dc, CAIRO_OPERATOR_SOURCE);
-			cairo_set_source_surface(cache_dc, board_layer, 0.0f, 0.0f);
+			cairo_set_source_surface(cache_dc, main_board->board_layer, 0.0f, 0.0f);
 			cairo_fill_preserve(cache_dc);
 			cairo_set_operator (cache_dc, CAIRO_OPERATOR_OVER);
-			cairo_set_source_surface(cache_dc, coordinates_layer, 0.0f, 0.0f);
+			cairo_set_source_surface(cache_dc, main_board->coordinates_layer, 0.0f, 0.0f);
 			//cairo_fill(cache_dc);
 			// If a piece is being dragged and overlaps with the animation final step
 			// repaint the dragged piece above to cache layer
@@ -953,7 +847,7 @@ static gboolean animate_one_step(gpointer data) {
 				double dragged_x, dragged_y;
 				get_dragging_prev_xy(&dragged_x, &dragged_y);
 				//FIXME: better lock access to mouse_dragged_piece (this could segfault otherwise)
-				cairo_set_source_surface (cache_dc, mouse_dragged_piece->surf, dragged_x-wi/16.0f, dragged_y-hi/16.0f);
+				set_piece_source(cache_dc, mouse_dragged_piece->surf, dragged_x, dragged_y, wi, hi);
 				cairo_set_operator(cache_dc, CAIRO_OPERATOR_OVER);
 				cairo_fill(cache_dc);
 			}
@@ -963,14 +857,14 @@ static gboolean animate_one_step(gpointer data) {
 
 			// repaint rook destination square
 			loc_to_xy(nc, nr, rook_xy, wi, hi);
-			cairo_rectangle(cache_dc, rook_xy[0] - wi / 16.0f, rook_xy[1] - hi / 16.0f, ww, hh);
+			piece_rectangle(cache_dc, rook_xy[0], rook_xy[1], wi, hi);
 			cairo_set_operator (cache_dc, CAIRO_OPERATOR_SOURCE);
-			cairo_set_source_surface(cache_dc, board_layer, 0.0f, 0.0f);
+			cairo_set_source_surface(cache_dc, main_board->board_layer, 0.0f, 0.0f);
 			cairo_fill_preserve(cache_dc);
 			cairo_set_operator (cache_dc, CAIRO_OPERATOR_OVER);
-			cairo_set_source_surface(cache_dc, coordinates_layer, 0.0f, 0.0f);
+			cairo_set_source_surface(cache_dc, main_board->coordinates_layer, 0.0f, 0.0f);
 			cairo_fill_preserve(cache_dc);
-			cairo_set_source_surface(cache_dc, pieces_layer, 0.0f, 0.0f);
+			cairo_set_source_surface(cache_dc, main_board->pieces_layer, 0.0f, 0.0f);
 
 			//cairo_fill(cache_dc);
 			// If a piece is being dragged and overlaps with the animation final step
@@ -980,7 +874,7 @@ static gboolean animate_one_step(gpointer data) {
 				double dragged_x, dragged_y;
 				get_dragging_prev_xy(&dragged_x, &dragged_y);
 				//FIXME: better lock access to mouse_dragged_piece (this could segfault otherwise)
-				cairo_set_source_surface (cache_dc, mouse_dragged_piece->surf, dragged_x-wi/16.0f, dragged_y-hi/16.0f);
+				set_piece_source(cache_dc, mouse_dragged_piece->surf, dragged_x, dragged_y, wi, hi);
 				cairo_set_operator(cache_dc, CAIRO_OPERATOR_OVER);
 				cairo_fill(cache_dc);
 			}
@@ -995,13 +889,13 @@ static gboolean animate_one_step(gpointer data) {
 		if (anim->move_result > 0 && anim->move_result & EN_PASSANT) {
 			loc_to_xy(anim->new_col, anim->new_row + (anim->piece->colour ? 1 : -1), pawn_xy, wi, hi);
 			// repaint square where eaten pawn was
-			cairo_rectangle(cache_dc, pawn_xy[0]-wi/16.0f, pawn_xy[1]-hi/16.0f, ww, hh);
+			piece_rectangle(cache_dc, pawn_xy[0], pawn_xy[1], wi, hi);
 			cairo_set_operator (cache_dc, CAIRO_OPERATOR_SOURCE);
 
-			cairo_set_source_surface(cache_dc, board_layer, 0.0f, 0.0f);
+			cairo_set_source_surface(cache_dc, main_board->board_layer, 0.0f, 0.0f);
 			cairo_fill(cache_dc);
 			// DEBUG
-			//cairo_rectangle(cache_dc, pawn_xy[0]-wi/16.0f, pawn_xy[1]-hi/16.0f, ww, hh);
+			//piece_rectangle(cache_dc, pawn_xy[0], pawn_xy[1], wi, hi);
 			//cairo_set_source_rgba(cache_dc, 1, 0, 0, .7f);
 			//cairo_set_operator (cache_dc, CAIRO_OPERATOR_OVER);
 			//cairo_fill(cache_dc);
@@ -1017,56 +911,61 @@ static gboolean animate_one_step(gpointer data) {
 			choose_promote(anim->promo_type, true, false, anim->old_col, anim->old_row, anim->new_col, anim->new_row);
 		}
 
-		cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
-
 		// destroy buffer drawing context
 		cairo_destroy(cache_dc);
 
-		// clip cr to repaint only needed squares
-		cairo_rectangle(cdr, floor(step_x-wi/16.0f), floor(step_y-hi/16.0f), ceil(ww), ceil(hh));
-		// Add special clipping squares in case of castling
+		// repaint only needed squares
+		queue_piece_area(step_x, step_y, wi, hi);
+		// Add special squares in case of castling
 		if (anim->move_result > 0 && anim->move_result & CASTLE) {
 			loc_to_xy(oc, or, rook_xy, wi, hi);
-			cairo_rectangle(cdr, floor(rook_xy[0]-wi/16.0f), floor(rook_xy[1]-hi/16.0f), ceil(ww), ceil(hh));
+			queue_piece_area(rook_xy[0], rook_xy[1], wi, hi);
 			loc_to_xy(nc, nr, rook_xy, wi, hi);
-			cairo_rectangle(cdr, floor(rook_xy[0]-wi/16.0f), floor(rook_xy[1]-hi/16.0f), ceil(ww), ceil(hh));
+			queue_piece_area(rook_xy[0], rook_xy[1], wi, hi);
 		}
 
-		// Add special clipping squares in case of en-passant
+		// Add special squares in case of en-passant
 		if (anim->move_result > 0 && anim->move_result & EN_PASSANT) {
 			loc_to_xy(anim->new_col, anim->new_row + (anim->piece->colour ? 1 : -1), pawn_xy, wi, hi);
-			cairo_rectangle(cdr, floor(pawn_xy[0]-wi/16.0f), floor(pawn_xy[1]-hi/16.0f), ceil(ww), ceil(hh));
+			queue_piece_area(pawn_xy[0], pawn_xy[1], wi, hi);
 		}
 
-		// Actual clip
-		cairo_clip(cdr);
-
-		cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
-		cairo_set_operator (cdr, CAIRO_OPERATOR_OVER);
-		//cairo_set_operator (cdr, CAIRO_OPERATOR_SOURCE);
-		cairo_paint(cdr);
+		restore_dragging_background(anim->piece, anim->move_result, wi, hi);
 
-		// debug : uncomment the following to highlight repainted areas
-//		cairo_set_source_rgba (cdr, 0.0f, 1.0f, 0.0f, .75f);
-//		cairo_paint(cdr);
+		if (!anim->killed_by) {
+			g_hash_table_remove(anims_map, anim->piece);
+		}
+		free_anim_data(anim);
+		return G_SOURCE_REMOVE;
+	}
+	return G_SOURCE_CONTINUE;
 
-		cairo_destroy(cdr);
+}
 
-		restore_dragging_background(anim->piece, anim->move_result, wi, hi);
+/* Paint one frame of a move animation
+ * Runs from the frame clock, with the GDK lock held, so it follows the display refresh
+ * and frames are simply skipped when the main loop is late */
+static gboolean animate_one_step(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer data) {
+	struct anim_data *anim = (struct anim_data *)data;
 
-		/* LEAVE THREADS */
-		gdk_threads_leave();
+	if (!is_running_flag()) {
+		return G_SOURCE_REMOVE;
+	}
 
-		if (!anim->killed_by) {
+	// If the board isn't drawable we're probably exiting
+	// free up allocated memory and stop animation
+	if (gdk_window_is_destroyed(gtk_widget_get_window(board))) {
+		debug("Aborting animation.\n");
+		// a later animation of the same piece may have taken its entry
+		if (g_hash_table_lookup(anims_map, anim->piece) == anim) {
 			g_hash_table_remove(anims_map, anim->piece);
 		}
 		free_anim_data(anim);
-		return FALSE;
+		return G_SOURCE_REMOVE;
 	}
-	/* LEAVE THREADS */
-	gdk_threads_leave();
-	return TRUE;
 
+	return paint_animation_frame(anim, gdk_frame_clock_get_frame_time(frame_clock),
+	                             gtk_widget_get_allocated_width(board), gtk_widget_get_allocated_height(board));
 }
 
 void highlight_pre_move(int pre_move[4], int wi, int hi) {
@@ -1074,12 +973,12 @@ void highlight_pre_move(int pre_move[4], int wi, int hi) {
 		prev_highlighted_pre_move[i] = pre_move[i];
 	}
 
-	cairo_t *high_cr = cairo_create(highlight_under_layer);
-	clean_highlight_surface(pre_move[0], pre_move[1], wi, hi);
-	clean_highlight_surface(pre_move[2], pre_move[3], wi, hi);
-	highlight_square(high_cr, pre_move[0], pre_move[1], highlight_pre_move_r, highlight_pre_move_g, highlight_pre_move_b, highlight_pre_move_a, wi, hi);
-	highlight_square(high_cr, pre_move[2], pre_move[3], highlight_pre_move_r, highlight_pre_move_g, highlight_pre_move_b, highlight_pre_move_a, wi, hi);
-	cairo_destroy(high_cr);
+	clean_square_highlights(pre_move[0], pre_move[1]);
+	clean_square_highlights(pre_move[2], pre_move[3]);
+	highlight_square(pre_move[0], pre_move[1], highlight_pre_move_r, highlight_pre_move_g, highlight_pre_move_b, highlight_pre_move_a);
+	highlight_square(pre_move[2], pre_move[3], highlight_pre_move_r, highlight_pre_move_g, highlight_pre_move_b, highlight_pre_move_a);
+	damage_square(pre_move[0], pre_move[1], wi, hi);
+	damage_square(pre_move[2], pre_move[3], wi, hi);
 }
 
 void highlight_move(int source_col, int source_row, int dest_col, int dest_row, int wi, int hi) {
@@ -1088,20 +987,84 @@ void highlight_move(int source_col, int source_row, int dest_col, int dest_row,
 	prev_highlighted_move[2] = dest_col;
 	prev_highlighted_move[3] = dest_row;
 
-	cairo_t *high_cr = cairo_create(highlight_under_layer);
-	highlight_square(high_cr, source_col, source_row, highlight_move_r, highlight_move_g, highlight_move_b, highlight_move_a, wi, hi);
-	highlight_square(high_cr, dest_col, dest_row, highlight_move_r, highlight_move_g, highlight_move_b, highlight_move_a, wi, hi);
-	cairo_destroy(high_cr);
+	highlight_square(source_col, source_row, highlight_move_r, highlight_move_g, highlight_move_b, highlight_move_a);
+	highlight_square(dest_col, dest_row, highlight_move_r, highlight_move_g, highlight_move_b, highlight_move_a);
+	damage_square(source_col, source_row, wi, hi);
+	damage_square(dest_col, dest_row, wi, hi);
 }
 
 void warn_check(int wi, int hi) {
 	double king_xy[2];
 	king_in_check_piece = get_king(main_game->whose_turn, main_game->squares);
 	loc_to_xy(king_in_check_piece->pos.column, king_in_check_piece->pos.row, king_xy, wi, hi);
-	cairo_t *high_cr = cairo_create(highlight_under_layer);
-	highlight_check_square(high_cr, king_in_check_piece->pos.column, king_in_check_piece->pos.row, check_warn_r, check_warn_g,
-	                       check_warn_b, check_warn_a, wi, hi);
-	cairo_destroy(high_cr);
+	highlight_check_square(king_in_check_piece->pos.column, king_in_check_piece->pos.row, check_warn_r, check_warn_g,
+	                       check_warn_b, check_warn_a);
+	damage_square(king_in_check_piece->pos.column, king_in_check_piece->pos.row, wi, hi);
+}
+
+/* Plot the path of a piece moving between two squares, to be painted by paint_animation_frame
+ * The move must already have been made on main_game */
+struct anim_data *plan_move_animation(chess_piece *piece, int old_col, int old_row, int new_col, int new_row, int move_result, int move_source, int wi, int hi) {
+	double n_xy[2];
+	double o_xy[2];
+	loc_to_xy(old_col, old_row, o_xy, wi, hi);
+	loc_to_xy(new_col, new_row, n_xy, wi, hi);
+
+	double points_to_plot = sqrt( pow(abs(n_xy[0]-o_xy[0]), 2) + pow(abs(n_xy[1]-o_xy[1]), 2));
+	points_to_plot *= 5.0f * 16.0f / (wi + hi);
+	//points_to_plot *= 10.0f*5.0f*16.0f/(wi+hi);
+	//printf("POINTS TO PLOT == %f, wi %d, hi %d\n", points_to_plot, wi, hi);
+	if (points_to_plot < 12) {
+		points_to_plot = 12;
+	} else if (points_to_plot < 16) {
+		points_to_plot = 16;
+	} else if (points_to_plot > 22) {
+		points_to_plot = 22;
+	}
+
+	double mid[2];
+	if (piece->type != W_KNIGHT && piece->type != B_KNIGHT) {
+		mid[0] = (n_xy[0] + o_xy[0]) / 2.0;
+		mid[1] = (n_xy[1] + o_xy[1]) / 2.0;
+	} else {
+		points_to_plot = 14;
+		if (abs(n_xy[0] - o_xy[0]) > abs(n_xy[1] - o_xy[1])) {
+			// long step along X axis
+			mid[0] = n_xy[0] + (n_xy[0] > o_xy[0] ? -1 : 1) * wi / 8.0;
+			mid[1] = o_xy[1];
+		} else {
+			// long step along Y axis
+			mid[0] = o_xy[0];
+			mid[1] = n_xy[1] + (n_xy[1] > o_xy[1] ? -1 : 1) * hi / 8.0;
+		}
+	}
+
+	points_to_plot *= 2.0f;
+//	points_to_plot /= 3.0f;
+
+	struct anim_data *animation = alloc_anim_data();
+	if (animation == NULL) {
+		return NULL;
+	}
+	animation->old_col = old_col;
+	animation->old_row = old_row;
+	animation->new_col = new_col;
+	animation->new_row = new_row;
+	animation->move_result = move_result;
+	animation->piece = piece;
+	animation->start[0] = o_xy[0];
+	animation->start[1] = o_xy[1];
+	animation->mid[0] = mid[0];
+	animation->mid[1] = mid[1];
+	animation->end[0] = n_xy[0];
+	animation->end[1] = n_xy[1];
+	animation->start_time = 0;
+	// ANIM_STEP_DURATION for each of the steps the distance calls for
+	animation->duration = ((int) points_to_plot + 1) * ANIM_STEP_DURATION;
+	animation->move_source = move_source;
+	animation->killed_by = KILLED_BY_NONE;
+
+	return animation;
 }
 
 gboolean auto_move(chess_piece *piece, int new_col, int new_row, int check_legality, int move_source, bool logical_only) {
@@ -1130,25 +1093,22 @@ gboolean auto_move(chess_piece *piece, int new_col, int new_row, int check_legal
 		mouse_dragged_piece = NULL;
 
 		// repaint square from last dragging step
-		cairo_t *cache_dc = cairo_create(cache_layer);
+		cairo_t *cache_dc = cairo_create(main_board->cache_layer);
 		clean_last_drag_step(cache_dc, wi, hi);
 		cairo_destroy(cache_dc);
 
 		cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
 
-		double ww = wi/8.0f;
-		double hh = hi/8.0f;
-
 		double dragged_x, dragged_y;
 		get_dragging_prev_xy(&dragged_x, &dragged_y);
 
 		// clip cr to repaint only needed square
-		cairo_rectangle(cdr, floor(dragged_x - wi / 16.0f), floor(dragged_y - hi / 16.0f), ceil(ww), ceil(hh));
+		piece_rectangle(cdr, dragged_x, dragged_y, wi, hi);
 
 		// Actual clip
 		cairo_clip(cdr);
 
-		cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
+		cairo_set_source_surface(cdr, main_board->cache_layer, 0.0f, 0.0f);
 		cairo_set_operator (cdr, CAIRO_OPERATOR_OVER);
 		cairo_paint(cdr);
 
@@ -1179,11 +1139,11 @@ gboolean auto_move(chess_piece *piece, int new_col, int new_row, int check_legal
 					sprintf(ics_mv, "%c%c%c%c=%c\n",
 					        'a' + old_col, '1' + old_row, 'a' + new_col, '1' + new_row,
 					        type_to_char(piece->type));
-					send_to_ics(ics_mv);
+					send_move_to_ics(ics_mv, piece->colour);
 				} else {
 					sprintf(ics_mv, "%c%c%c%c\n",
 					        'a' + old_col, '1' + old_row, 'a' + new_col, '1' + new_row);
-					send_to_ics(ics_mv);
+					send_move_to_ics(ics_mv, piece->colour);
 				}
 			}
 			char uci_mv[MOVE_BUFF_SIZE];
@@ -1214,18 +1174,16 @@ gboolean auto_move(chess_piece *piece, int new_col, int new_row, int check_legal
 		// Show check warning
 		double king_xy[2];
 		double old_king_xy[2];
-		double ww = wi / 8.0;
-		double hh = hi / 8.0;
 
 		chess_piece *clean_old_check = king_in_check_piece;
-		cairo_t *cache_dc = cairo_create(cache_layer);
+		cairo_t *cache_dc = cairo_create(main_board->cache_layer);
 		cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
 
 		// Clean up all highlights after a successful move
 		if (lock_threads) {
 			gdk_threads_enter();
 		}
-		init_highlight_under_surface(wi, hi);
+		clear_square_highlights();
 //		init_highlight_over_surface(wi, hi);
 
 		if (highlight_last_move) {
@@ -1267,26 +1225,26 @@ gboolean auto_move(chess_piece *piece, int new_col, int new_row, int check_legal
 
 			loc_to_xy(king_in_check_piece->pos.column, king_in_check_piece->pos.row, king_xy, wi, hi);
 			cairo_save(cache_dc);
-			cairo_rectangle(cache_dc, king_xy[0] - wi / 16.0f, king_xy[1] - hi / 16.0f, ww, hh);
+			piece_rectangle(cache_dc, king_xy[0], king_xy[1], wi, hi);
 			cairo_clip(cache_dc);
 			paint_layers(cache_dc);
 			cairo_restore(cache_dc);
-			cairo_rectangle(cdr, floor(king_xy[0] - wi / 16.0f), floor(king_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
+			piece_rectangle(cdr, king_xy[0], king_xy[1], wi, hi);
 		} else {
 			king_in_check_piece = NULL;
 		}
 
 		if (clean_old_check != NULL && clean_old_check != piece) {
 			loc_to_xy(clean_old_check->pos.column, clean_old_check->pos.row, old_king_xy, wi, hi);
-			cairo_rectangle(cache_dc, old_king_xy[0] - wi / 16.0f, old_king_xy[1] - hi / 16.0f, ww, hh);
+			piece_rectangle(cache_dc, old_king_xy[0], old_king_xy[1], wi, hi);
 			cairo_clip(cache_dc);
 			paint_layers(cache_dc);
-			cairo_rectangle(cdr, floor(old_king_xy[0] - wi / 16.0f), floor(old_king_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
+			piece_rectangle(cdr, old_king_xy[0], old_king_xy[1], wi, hi);
 		}
 		cairo_destroy(cache_dc);
 
 		cairo_clip(cdr);
-		cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
+		cairo_set_source_surface(cdr, main_board->cache_layer, 0.0f, 0.0f);
 		cairo_set_operator(cdr, CAIRO_OPERATOR_SOURCE);
 		cairo_paint(cdr);
 		cairo_destroy(cdr);
@@ -1295,75 +1253,42 @@ gboolean auto_move(chess_piece *piece, int new_col, int new_row, int check_legal
 		}
 
 		// Start animation
-		double n_xy[2];
-		double o_xy[2];
-		loc_to_xy(old_col, old_row, o_xy, wi, hi);
-		loc_to_xy(new_col, new_row, n_xy, wi, hi);
-
-		double points_to_plot = sqrt( pow(abs(n_xy[0]-o_xy[0]), 2) + pow(abs(n_xy[1]-o_xy[1]), 2));
-		points_to_plot *= 5.0f * 16.0f / (wi + hi);
-		//points_to_plot *= 10.0f*5.0f*16.0f/(wi+hi);
-		//printf("POINTS TO PLOT == %f, wi %d, hi %d\n", points_to_plot, wi, hi);
-		if (points_to_plot < 12) {
-			points_to_plot = 12;
-		} else if (points_to_plot < 16) {
-			points_to_plot = 16;
-		} else if (points_to_plot > 22) {
-			points_to_plot = 22;
-		}
-
-		double mid[2];
-		if (piece->type != W_KNIGHT && piece->type != B_KNIGHT) {
-			mid[0] = (n_xy[0] + o_xy[0]) / 2.0;
-			mid[1] = (n_xy[1] + o_xy[1]) / 2.0;
-		} else {
-			points_to_plot = 14;
-			if (abs(n_xy[0] - o_xy[0]) > abs(n_xy[1] - o_xy[1])) {
-				// long step along X axis
-				mid[0] = n_xy[0] + (n_xy[0] > o_xy[0] ? -1 : 1) * wi / 8.0;
-				mid[1] = o_xy[1];
-			} else {
-				// long step along Y axis
-				mid[0] = o_xy[0];
-				mid[1] = n_xy[1] + (n_xy[1] > o_xy[1] ? -1 : 1) * hi / 8.0;
-			}
-		}
-
-		points_to_plot *= 2.0f;
-//		points_to_plot /= 3.0f;
-
-		double **anim_steps;
-		// this will be freed when we free the anim structure!
-
-		anim_steps = malloc(ANIM_SIZE*sizeof(int*));
-		int i;
-		for (i=0; i<ANIM_SIZE; i++) {
-			anim_steps[i] = malloc(2*sizeof(int));
-		}
-		int n_anim_steps;
-
-		plot_coords(o_xy, mid, n_xy, (int) points_to_plot, anim_steps, &n_anim_steps);
-
-		struct anim_data *animation = malloc(sizeof(struct anim_data));
-		animation->old_col = old_col;
-		animation->old_row = old_row;
-		animation->new_col = new_col;
-		animation->new_row = new_row;
-		animation->move_result = move_result;
+		struct anim_data *animation = plan_move_animation(piece, old_col, old_row, new_col, new_row, move_result, move_source, wi, hi);
 		if (move_result & PROMOTE) {
-			animation->promo_type = main_game->promo_type;
+			if (animation != NULL) {
+				animation->promo_type = main_game->promo_type;
+			}
 			if (move_source != MANUAL_SOURCE) {
 				logical_promote(main_game->promo_type);
 			}
 
 		}
-		animation->piece = piece;
-		animation->plots = anim_steps;
-		animation->n_plots = n_anim_steps;
-		animation->step_index = 1;
-		animation->move_source = move_source;
-		animation->killed_by = KILLED_BY_NONE;
 
+		if (lock_threads) {
+			gdk_threads_enter();
+		}
+		if (animation == NULL) {
+			// pool exhausted: stop the animations of the pieces involved and redraw the whole board instead
+			// as when taken by an instant move, their next frame only cleans up after them
+			struct anim_data *old_anim = get_anim_for_piece(piece);
+			if (old_anim) {
+				old_anim->killed_by = KILLED_BY_INSTANT_MOVE_TAKING;
+			}
+			if (move_result & PIECE_TAKEN) {
+				struct anim_data *killed_anim = get_anim_for_piece(last_piece_taken);
+				if (killed_anim) {
+					killed_anim->killed_by = KILLED_BY_INSTANT_MOVE_TAKING;
+				}
+			}
+			needs_update = 1;
+			if (board != NULL) {
+				gtk_widget_queue_draw(board);
+			}
+			if (lock_threads) {
+				gdk_threads_leave();
+			}
+			return TRUE;
+		}
 		struct anim_data *old_anim = get_anim_for_piece(animation->piece);
 		if (old_anim) {
 			old_anim->killed_by = KILLED_BY_OTHER_ANIMATION_SAME_PIECE;
@@ -1378,9 +1303,10 @@ gboolean auto_move(chess_piece *piece, int new_col, int new_row, int check_legal
 
 		g_hash_table_insert(anims_map, animation->piece, animation);
 
-//		g_timeout_add(1000/240, animate_one_step, animation);
-//		g_timeout_add(1000/60, animate_one_step, animation);
-		g_timeout_add(8, animate_one_step, animation);
+		gtk_widget_add_tick_callback(board, animate_one_step, animation, NULL);
+		if (lock_threads) {
+			gdk_threads_leave();
+		}
 		return TRUE;
 	}
 
@@ -1397,7 +1323,7 @@ gboolean auto_move(chess_piece *piece, int new_col, int new_row, int check_legal
 
 void init_dragging_background(int wi, int hi) {
 	cairo_surface_destroy (dragging_background);
-	dragging_background = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, wi, hi);
+	dragging_background = board_context_create_layer(main_board, CAIRO_CONTENT_COLOR, wi, hi);
 	cairo_t *drag_dc = cairo_create(dragging_background);
 	paint_layers(drag_dc);
 	cairo_destroy (drag_dc);
@@ -1406,24 +1332,20 @@ void init_dragging_background(int wi, int hi) {
 // Remove passed piece from dragging surface
 static void update_dragging_background(chess_piece *piece, int wi, int hi) {
 
-	double ww = wi / 8.0f;
-	double hh = hi / 8.0f;
-
 	double xy[2];
 	piece_to_xy(piece, xy, wi, hi);
 
 	cairo_t *drag_dc = cairo_create(dragging_background);
 
 	// Repaint square from which piece originated without the pieces layer, thus removing the dragged piece
-	cairo_rectangle(drag_dc, xy[0] - wi / 16.0f, xy[1] - hi / 16.0f, ww, hh);
+	piece_rectangle(drag_dc, xy[0], xy[1], wi, hi);
 	cairo_clip_preserve(drag_dc);
 	cairo_set_operator (drag_dc, CAIRO_OPERATOR_SOURCE);
-	cairo_set_source_surface(drag_dc, board_layer, 0.0f, 0.0f);
+	cairo_set_source_surface(drag_dc, main_board->board_layer, 0.0f, 0.0f);
 	cairo_fill_preserve(drag_dc);
 	cairo_set_operator(drag_dc, CAIRO_OPERATOR_OVER);
-	cairo_set_source_surface(drag_dc, highlight_under_layer, 0.0f, 0.0f);
-	cairo_fill_preserve(drag_dc);
-	cairo_set_source_surface(drag_dc, coordinates_layer, 0.0f, 0.0f);
+	board_context_paint_highlights(main_board, drag_dc, wi, hi);
+	cairo_set_source_surface(drag_dc, main_board->coordinates_layer, 0.0f, 0.0f);
 //	cairo_fill_preserve(drag_dc);
 //	cairo_set_source_surface(drag_dc, highlight_over_layer, 0.0f, 0.0f);
 	cairo_fill(drag_dc);
@@ -1432,16 +1354,13 @@ static void update_dragging_background(chess_piece *piece, int wi, int hi) {
 
 // Refresh dragging background for a square
 static void update_dragging_background_at(int col, int row, int wi, int hi) {
-	double ww = wi / 8.0f;
-	double hh = hi / 8.0f;
-
 	double xy[2];
 	loc_to_xy(col, row, xy, wi, hi);
 
 	cairo_t *drag_dc = cairo_create(dragging_background);
 
 	// Repaint square from which piece originated without the pieces layer, thus removing the dragged piece
-	cairo_rectangle(drag_dc, xy[0] - wi / 16.0f, xy[1] - hi / 16.0f, ww, hh);
+	piece_rectangle(drag_dc, xy[0], xy[1], wi, hi);
 	cairo_clip(drag_dc);
 	paint_layers(drag_dc);
 	cairo_destroy(drag_dc);
@@ -1454,16 +1373,13 @@ static void update_dragging_background_with_piece(chess_piece *piece, int wi, in
 
 static void restore_dragging_background(chess_piece *piece, int move_result, int wi, int hi) {
 
-	double ww = wi/8.0f;
-	double hh = hi/8.0f;
-
 	double xy[2];
 	piece_to_xy(piece, xy, wi, hi);
 
 	cairo_t *drag_dc = cairo_create(dragging_background);
 
 	// Repaint square to where piece landed
-	cairo_rectangle(drag_dc, floor(xy[0] - wi / 16.0f), floor(xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
+	piece_rectangle(drag_dc, xy[0], xy[1], wi, hi);
 
 	// handle castle
 	if (move_result > 0 && move_result & CASTLE) { // need to clean out old rooks pos
@@ -1500,11 +1416,11 @@ static void restore_dragging_background(chess_piece *piece, int move_result, int
 
 		// repaint rook source square
 		loc_to_xy(oc, or, rook_xy, wi, hi);
-		cairo_rectangle(drag_dc, floor(rook_xy[0] - wi / 16.0f), floor(rook_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
+		piece_rectangle(drag_dc, rook_xy[0], rook_xy[1], wi, hi);
 
 		// repaint rook destination square
 		loc_to_xy(nc, nr, rook_xy, wi, hi);
-		cairo_rectangle(drag_dc, floor(rook_xy[0] - wi / 16.0f), floor(rook_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
+		piece_rectangle(drag_dc, rook_xy[0], rook_xy[1], wi, hi);
 	}
 
 	// handle en-passant
@@ -1512,7 +1428,7 @@ static void restore_dragging_background(chess_piece *piece, int move_result, int
 	if (move_result > 0 && move_result & EN_PASSANT) {
 		// repaint square where eaten pawn was
 		loc_to_xy(piece->pos.column, piece->pos.row + (main_game->whose_turn ? -1 : 1), pawn_xy, wi, hi);
-		cairo_rectangle(drag_dc, pawn_xy[0] - wi / 16.0f, pawn_xy[1] - hi / 16.0f, ww, hh);
+		piece_rectangle(drag_dc, pawn_xy[0], pawn_xy[1], wi, hi);
 	}
 
 	cairo_clip(drag_dc);
@@ -1521,17 +1437,13 @@ static void restore_dragging_background(chess_piece *piece, int move_result, int
 }
 
 // repaint square from last dragging step
-// NB: allow one pixel around square in case of rounding
 // This is only a convenience method and is not thread safe
-static void clean_last_drag_step(cairo_t *cdc, double wi, double hi) {
-	double ww = wi / 8.0f;
-	double hh = hi / 8.0f;
-
+static void clean_last_drag_step(cairo_t *cdc, int wi, int hi) {
 	double dragged_x, dragged_y;
 	get_dragging_prev_xy(&dragged_x, &dragged_y);
 
 	cairo_save(cdc);
-	cairo_rectangle(cdc, dragged_x - 1 - wi / 16.0f, dragged_y - 1 - hi / 16.0f, ww + 2, hh + 2);
+	piece_rectangle(cdc, dragged_x, dragged_y, wi, hi);
 	cairo_clip(cdc);
 
 	paint_layers(cdc);
@@ -1600,12 +1512,12 @@ void handle_left_mouse_up(void) {
 						sprintf(uci_mv, "%c%c%c%c%c\n",
 						        'a' + p_old_col, '1' + p_old_row, 'a' + ij[0], '1' + ij[1],
 						        (char) (type_to_char(mouse_dragged_piece->type) + 32));
-						send_to_ics(ics_mv);
+						send_move_to_ics(ics_mv, mouse_dragged_piece->colour);
 						send_to_uci(uci_mv);
 					} else {
 						sprintf(ics_mv, "%c%c%c%c\n",
 						        'a' + p_old_col, '1' + p_old_row, 'a' + ij[0], '1' + ij[1]);
-						send_to_ics(ics_mv);
+						send_move_to_ics(ics_mv, mouse_dragged_piece->colour);
 						send_to_uci(ics_mv);
 					}
 
@@ -1659,18 +1571,16 @@ void handle_left_mouse_up(void) {
 		ij[1] = mouse_dragged_piece->pos.row;
 
 		double xy[2];
-		double ww = wi/8.0f;
-		double hh = hi/8.0f;
 		loc_to_xy(ij[0], ij[1], xy, wi, hi);
 
-		cairo_t *cache_dc = cairo_create(cache_layer);
+		cairo_t *cache_dc = cairo_create(main_board->cache_layer);
 
 		// repaint square from last dragging step
 		clean_last_drag_step(cache_dc, wi, hi);
 
 		// repaint destination square
 		cairo_save(cache_dc);
-		cairo_rectangle(cache_dc, floor(xy[0] - wi / 16.0f), floor(xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
+		piece_rectangle(cache_dc, xy[0], xy[1], wi, hi);
 		cairo_clip(cache_dc);
 		paint_layers(cache_dc);
 		cairo_restore(cache_dc);
@@ -1728,24 +1638,24 @@ void handle_left_mouse_up(void) {
 
 			// repaint rook source square
 			loc_to_xy(oc, or, rook_xy, wi, hi);
-			cairo_rectangle(cache_dc, floor(rook_xy[0]-wi/16.0f), floor(rook_xy[1]-hi/16.0f), ceil(ww), ceil(hh));
+			piece_rectangle(cache_dc, rook_xy[0], rook_xy[1], wi, hi);
 			cairo_set_operator (cache_dc, CAIRO_OPERATOR_SOURCE);
-			cairo_set_source_surface(cache_dc, board_layer, 0.0f, 0.0f);
+			cairo_set_source_surface(cache_dc, main_board->board_layer, 0.0f, 0.0f);
 			cairo_fill_preserve(cache_dc);
 			cairo_set_operator (cache_dc, CAIRO_OPERATOR_OVER);
-			cairo_set_source_surface(cache_dc, coordinates_layer, 0.0f, 0.0f);
+			cairo_set_source_surface(cache_dc, main_board->coordinates_layer, 0.0f, 0.0f);
 			cairo_fill(cache_dc);
 
 			// repaint rook destination square
 			loc_to_xy(nc, nr, rook_xy, wi, hi);
-			cairo_rectangle(cache_dc, floor(rook_xy[0]-wi/16.0f), floor(rook_xy[1]-hi/16.0f), ceil(ww), ceil(hh));
+			piece_rectangle(cache_dc, rook_xy[0], rook_xy[1], wi, hi);
 			cairo_set_operator (cache_dc, CAIRO_OPERATOR_SOURCE);
-			cairo_set_source_surface(cache_dc, board_layer, 0.0f, 0.0f);
+			cairo_set_source_surface(cache_dc, main_board->board_layer, 0.0f, 0.0f);
 			cairo_fill_preserve(cache_dc);
 			cairo_set_operator (cache_dc, CAIRO_OPERATOR_OVER);
-			cairo_set_source_surface(cache_dc, coordinates_layer, 0.0f, 0.0f);
+			cairo_set_source_surface(cache_dc, main_board->coordinates_layer, 0.0f, 0.0f);
 			cairo_fill_preserve(cache_dc);
-			cairo_set_source_surface(cache_dc, pieces_layer, 0.0f, 0.0f);
+			cairo_set_source_surface(cache_dc, main_board->pieces_layer, 0.0f, 0.0f);
 			cairo_fill(cache_dc);
 		}
 
@@ -1753,8 +1663,8 @@ void handle_left_mouse_up(void) {
 		if (move_result > 0 && move_result & EN_PASSANT) {
 			loc_to_xy(ij[0], ij[1] + (mouse_dragged_piece->colour ? 1 : -1), pawn_xy, wi, hi);
 			// repaint square where eaten pawn was
-			cairo_rectangle(cache_dc, pawn_xy[0]-wi/16.0f, pawn_xy[1]-hi/16.0f, ww, hh);
-			cairo_set_source_surface(cache_dc, board_layer, 0.0f, 0.0f);
+			piece_rectangle(cache_dc, pawn_xy[0], pawn_xy[1], wi, hi);
+			cairo_set_source_surface(cache_dc, main_board->board_layer, 0.0f, 0.0f);
 			cairo_set_operator (cache_dc, CAIRO_OPERATOR_SOURCE);
 			cairo_fill(cache_dc);
 			kill_piece_from_surface(wi, hi, ij[0], ij[1] + (main_game->whose_turn ? -1 : 1));
@@ -1769,13 +1679,13 @@ void handle_left_mouse_up(void) {
 		if (move_result >= 0) {
 
 			// Clean up all highlights after a successful move
-			init_highlight_under_surface(wi, hi);
+			clear_square_highlights();
 //			init_highlight_over_surface(wi, hi);
 
 			// Clean the ghost
 			kill_piece_from_surface(wi, hi, p_old_col, p_old_row);
 			cairo_save(cache_dc);
-			cairo_rectangle(cache_dc, floor(old_xy[0] - wi / 16.0f), floor(old_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
+			piece_rectangle(cache_dc, old_xy[0], old_xy[1], wi, hi);
 			cairo_clip(cache_dc);
 			paint_layers(cache_dc);
 			cairo_restore(cache_dc);
@@ -1819,7 +1729,7 @@ void handle_left_mouse_up(void) {
 
 				loc_to_xy(king_in_check_piece->pos.column, king_in_check_piece->pos.row, king_xy, wi, hi);
 				cairo_save(cache_dc);
-				cairo_rectangle(cache_dc, king_xy[0] - wi / 16.0f, king_xy[1] - hi / 16.0f, ww, hh);
+				piece_rectangle(cache_dc, king_xy[0], king_xy[1], wi, hi);
 				cairo_clip(cache_dc);
 				paint_layers(cache_dc);
 				cairo_restore(cache_dc);
@@ -1832,7 +1742,7 @@ void handle_left_mouse_up(void) {
 			if (clean_old_check != NULL) {
 				if (clean_old_check != mouse_dragged_piece) {
 					loc_to_xy(clean_old_check->pos.column, clean_old_check->pos.row, old_king_xy, wi, hi);
-					cairo_rectangle(cache_dc, old_king_xy[0] - wi / 16.0f, old_king_xy[1] - hi / 16.0f, ww, hh);
+					piece_rectangle(cache_dc, old_king_xy[0], old_king_xy[1], wi, hi);
 					cairo_clip(cache_dc);
 					paint_layers(cache_dc);
 					update_dragging_background_with_piece(clean_old_check, wi, hi);
@@ -1852,8 +1762,8 @@ void handle_left_mouse_up(void) {
 		get_dragging_prev_xy(&dragged_x, &dragged_y);
 
 		// clip cr to repaint only needed squares
-		cairo_rectangle(cdr, dragged_x - wi / 16.0f, dragged_y - hi / 16.0f, ww, hh);
-		cairo_rectangle(cdr, floor(xy[0] - wi / 16.0f), floor(xy[1] - hi / 16.0f), ceil(ww + 1), ceil(hh + 1));
+		piece_rectangle(cdr, dragged_x, dragged_y, wi, hi);
+		piece_rectangle(cdr, xy[0], xy[1], wi, hi);
 
 		if (is_pre_move) {
 			square_to_rectangle(cdr, prev_highlighted_pre_move[0], prev_highlighted_pre_move[1], wi, hi);
@@ -1863,29 +1773,29 @@ void handle_left_mouse_up(void) {
 		// Add special clipping squares in case of castling
 		if (move_result > 0 && move_result & CASTLE) {
 			loc_to_xy(oc, or, rook_xy, wi, hi);
-			cairo_rectangle(cdr, floor(rook_xy[0] - wi / 16.0f), floor(rook_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
+			piece_rectangle(cdr, rook_xy[0], rook_xy[1], wi, hi);
 			loc_to_xy(nc, nr, rook_xy, wi, hi);
-			cairo_rectangle(cdr, floor(rook_xy[0] - wi / 16.0f), floor(rook_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
+			piece_rectangle(cdr, rook_xy[0], rook_xy[1], wi, hi);
 		}
 
 		// Add special clipping squares in case of en-passant
 		if (move_result > 0 && move_result & EN_PASSANT) {
 			loc_to_xy(ij[0], ij[1] + (mouse_dragged_piece->colour ? 1 : -1), pawn_xy, wi, hi);
-			cairo_rectangle(cdr, floor(pawn_xy[0] - wi / 16.0f), floor(pawn_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
+			piece_rectangle(cdr, pawn_xy[0], pawn_xy[1], wi, hi);
 		}
 
 		// Add special clipping squares if king is checked
 		if (king_is_checked) {
-			cairo_rectangle(cdr, floor(king_xy[0] - wi / 16.0f), floor(king_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
+			piece_rectangle(cdr, king_xy[0], king_xy[1], wi, hi);
 		}
 
 		if (clean_old_check != NULL && move_result >= 0) {
-			cairo_rectangle(cdr, floor(old_king_xy[0] - wi / 16.0f), floor(old_king_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
+			piece_rectangle(cdr, old_king_xy[0], old_king_xy[1], wi, hi);
 		}
 
 		// Clean the ghost
 		if (move_result >= 0) {
-			cairo_rectangle(cdr, floor(old_xy[0] - wi / 16.0f), floor(old_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
+			piece_rectangle(cdr, old_xy[0], old_xy[1], wi, hi);
 		}
 
 		// Clean last move highlight
@@ -1897,7 +1807,7 @@ void handle_left_mouse_up(void) {
 		// Actual clip
 		cairo_clip(cdr);
 
-		cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
+		cairo_set_source_surface(cdr, main_board->cache_layer, 0.0f, 0.0f);
 		cairo_set_operator (cdr, CAIRO_OPERATOR_SOURCE);
 		cairo_paint(cdr);
 
@@ -1938,17 +1848,14 @@ void handle_left_mouse_up(void) {
 				mouse_clicked[0] = ij[0];
 				mouse_clicked[1] = ij[1];
 
-				cairo_t *high_cr = cairo_create(highlight_under_layer);
 				if (king_in_check_piece == mouse_clicked_piece) {
-					// clean out old highlight surface
-					clean_highlight_surface(mouse_clicked[0], mouse_clicked[1], wi, hi);
-					highlight_square(high_cr, ij[0], ij[1], highlight_selected_r, highlight_selected_g, highlight_selected_b, highlight_selected_a, wi, hi);
-					highlight_check_square(high_cr, king_in_check_piece->pos.column, king_in_check_piece->pos.row, check_warn_r, check_warn_g, check_warn_b, check_warn_a, wi, hi);
+					// clean out old highlights
+					clean_square_highlights(mouse_clicked[0], mouse_clicked[1]);
+					highlight_square(ij[0], ij[1], highlight_selected_r, highlight_selected_g, highlight_selected_b, highlight_selected_a);
+					highlight_check_square(king_in_check_piece->pos.column, king_in_check_piece->pos.row, check_warn_r, check_warn_g, check_warn_b, check_warn_a);
 				} else {
-					// paint to highlight_under_layer
-					highlight_square(high_cr, ij[0], ij[1], highlight_selected_r, highlight_selected_g, highlight_selected_b, highlight_selected_a, wi, hi);
+					highlight_square(ij[0], ij[1], highlight_selected_r, highlight_selected_g, highlight_selected_b, highlight_selected_a);
 				}
-				cairo_destroy(high_cr);
 
 				// paint to main
 				cairo_t *main_cr = gdk_cairo_create(gtk_widget_get_window(board));
@@ -1957,7 +1864,7 @@ void handle_left_mouse_up(void) {
 				cairo_destroy(main_cr);
 
 				// update cache surface (used for scaling)
-				cairo_t *cache_cr = cairo_create(cache_layer);
+				cairo_t *cache_cr = cairo_create(main_board->cache_layer);
 				clip_to_square(cache_cr, ij[0], ij[1], wi, hi);
 				paint_layers(cache_cr);
 				cairo_destroy(cache_cr);
@@ -1996,26 +1903,24 @@ void cancel_pre_move(int wi, int hi, bool lock_threads) {
 	}
 	if (old_pre_move[0] > -1) {
 		unset_pre_move();
-		clean_highlight_surface(old_pre_move[0], old_pre_move[1], wi, hi);
-		clean_highlight_surface(old_pre_move[2], old_pre_move[3], wi, hi);
+		clean_square_highlights(old_pre_move[0], old_pre_move[1]);
+		clean_square_highlights(old_pre_move[2], old_pre_move[3]);
 
 		// Re-highlight the last move if it overlaps with the cancelled pre-move
 		if (moves_overlap(prev_highlighted_move, old_pre_move)) {
-			cairo_t *high_cr = cairo_create(highlight_under_layer);
 			if (same_move(prev_highlighted_move[0], prev_highlighted_move[1], old_pre_move[0], old_pre_move[1]) ||
 			    same_move(prev_highlighted_move[2], prev_highlighted_move[3], old_pre_move[0], old_pre_move[1])) {
-				highlight_square(high_cr, old_pre_move[0], old_pre_move[1], highlight_move_r, highlight_move_g,
-				                 highlight_move_b, highlight_move_a, wi, hi);
+				highlight_square(old_pre_move[0], old_pre_move[1], highlight_move_r, highlight_move_g,
+				                 highlight_move_b, highlight_move_a);
 			}
 			if (same_move(prev_highlighted_move[0], prev_highlighted_move[1], old_pre_move[2], old_pre_move[3]) ||
 			    same_move(prev_highlighted_move[2], prev_highlighted_move[3], old_pre_move[2], old_pre_move[3])) {
-				highlight_square(high_cr, old_pre_move[2], old_pre_move[3], highlight_move_r, highlight_move_g,
-				                 highlight_move_b, highlight_move_a, wi, hi);
+				highlight_square(old_pre_move[2], old_pre_move[3], highlight_move_r, highlight_move_g,
+				                 highlight_move_b, highlight_move_a);
 			}
-			cairo_destroy(high_cr);
 		}
 
-		cairo_t *cache_dc = cairo_create(cache_layer);
+		cairo_t *cache_dc = cairo_create(main_board->cache_layer);
 		square_to_rectangle(cache_dc, old_pre_move[0], old_pre_move[1], wi, hi);
 		square_to_rectangle(cache_dc, old_pre_move[2], old_pre_move[3], wi, hi);
 		cairo_clip(cache_dc);
@@ -2033,7 +1938,7 @@ void cancel_pre_move(int wi, int hi, bool lock_threads) {
 		square_to_rectangle(cdr, old_pre_move[0], old_pre_move[1], wi, hi);
 		square_to_rectangle(cdr, old_pre_move[2], old_pre_move[3], wi, hi);
 		cairo_clip(cdr);
-		cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
+		cairo_set_source_surface(cdr, main_board->cache_layer, 0.0f, 0.0f);
 		cairo_set_operator (cdr, CAIRO_OPERATOR_SOURCE);
 		cairo_paint(cdr);
 		cairo_destroy(cdr);
@@ -2049,12 +1954,10 @@ void handle_left_mouse_down(GtkWidget *pWidget, int wi, int hi, int x, int y) {
 	// clean out any previous highlight
 	if (mouse_clicked[0] >= 0) {
 		// clean out old highlight surface
-		clean_highlight_surface(mouse_clicked[0], mouse_clicked[1], wi, hi);
+		clean_square_highlights(mouse_clicked[0], mouse_clicked[1]);
 
 		if (king_in_check_piece == mouse_clicked_piece) {
-			cairo_t *high_cr = cairo_create(highlight_under_layer);
-			highlight_check_square(high_cr, king_in_check_piece->pos.column, king_in_check_piece->pos.row, check_warn_r, check_warn_g, check_warn_b, check_warn_a, wi, hi);
-			cairo_destroy(high_cr);
+			highlight_check_square(king_in_check_piece->pos.column, king_in_check_piece->pos.row, check_warn_r, check_warn_g, check_warn_b, check_warn_a);
 		}
 
 		cairo_t *board_cr = gdk_cairo_create(gtk_widget_get_window(pWidget));
@@ -2083,7 +1986,7 @@ void handle_left_mouse_down(GtkWidget *pWidget, int wi, int hi, int x, int y) {
 				set_pre_move(pre_move);
 				highlight_pre_move(pre_move, wi, hi);
 
-				cairo_t *cache_dc = cairo_create(cache_layer);
+				cairo_t *cache_dc = cairo_create(main_board->cache_layer);
 				squares_for_move(cache_dc, pre_move, wi, hi);
 				cairo_clip(cache_dc);
 				paint_layers(cache_dc);
@@ -2097,7 +2000,7 @@ void handle_left_mouse_down(GtkWidget *pWidget, int wi, int hi, int x, int y) {
 				cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
 				squares_for_move(cdr, pre_move, wi, hi);
 				cairo_clip(cdr);
-				cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
+				cairo_set_source_surface(cdr, main_board->cache_layer, 0.0f, 0.0f);
 				cairo_set_operator(cdr, CAIRO_OPERATOR_SOURCE);
 				cairo_paint(cdr);
 				cairo_destroy(cdr);
@@ -2172,13 +2075,13 @@ void handle_flip_board(GtkWidget *pWidget, bool lock_threads) {
 	flip_board(old_wi, old_hi);
 
 	// Reconstruct cache layer
-	cairo_t *cache_cr = cairo_create(cache_layer);
+	cairo_t *cache_cr = cairo_create(main_board->cache_layer);
 	paint_layers(cache_cr);
 	cairo_destroy(cache_cr);
 
 	// Update displayed board
 	cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(pWidget));
-	cairo_set_source_surface(cdr, cache_layer, 0, 0);
+	cairo_set_source_surface(cdr, main_board->cache_layer, 0, 0);
 	cairo_set_operator(cdr, CAIRO_OPERATOR_SOURCE);
 	cairo_paint(cdr);
 
@@ -2191,164 +2094,97 @@ void handle_flip_board(GtkWidget *pWidget, bool lock_threads) {
 	}
 }
 
-void *process_moves(void *ptr) {
+/* Paint the dragged piece at the last motion event position to the cache layer and queue the areas it changed
+ * Returns G_SOURCE_REMOVE when there is nothing more to paint until the next motion event */
+gboolean paint_drag_frame(int wi, int hi) {
 	double dragged_x, dragged_y;
-	while (is_running_flag()) {
-
-		if (is_moveit_flag() && is_more_events_flag()) {
-
-			gdk_threads_enter();
-
-			int wi = gtk_widget_get_allocated_width(board);
-			int hi = gtk_widget_get_allocated_height(board);
-			double ww = wi/8.0f;
-			double hh = hi/8.0f;
-
-			if (mouse_dragged_piece == NULL || !is_moveit_flag()) {
-				debug("Dragging animation interrupted\n");
-				gdk_threads_leave();
-				continue;
-			}
-
-			get_dragging_prev_xy(&dragged_x, &dragged_y);
-			if (mouse_dragged_piece->dead) {
-
-				debug("handling case when dragged piece was killed\n");
-				set_moveit_flag(false);
-
-				// repaint square from last dragging step
-				cairo_t *cache_dc = cairo_create(cache_layer);
-				clean_last_drag_step(cache_dc, wi, hi);
-				cairo_destroy(cache_dc);
 
-				cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
-
-				// clip cr to repaint only needed square
-				cairo_rectangle(cdr, floor(dragged_x - wi / 16.0f), floor(dragged_y - hi / 16.0f), ceil(ww),
-				                ceil(hh));
-
-				// Actual clip
-				cairo_clip(cdr);
-
-				cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
-				cairo_set_operator(cdr, CAIRO_OPERATOR_OVER);
-				cairo_paint(cdr);
+	if (!is_moveit_flag() || !is_more_events_flag()) {
+		// nothing moved since last frame, wait for the next motion event
+		return G_SOURCE_REMOVE;
+	}
+	TRACE_SCOPE("paint_drag_frame");
 
-				mouse_dragged_piece = NULL;
+	if (mouse_dragged_piece == NULL) {
+		debug("Dragging animation interrupted\n");
+		set_more_events_flag(false);
+		return G_SOURCE_REMOVE;
+	}
 
-				gdk_threads_leave();
-				continue;
-			}
+	get_dragging_prev_xy(&dragged_x, &dragged_y);
+	if (mouse_dragged_piece->dead) {
 
-			// Get coordinates from last mouse move
-			int new_x, new_y;
-			get_last_move_xy(&new_x, &new_y);
+		debug("handling case when dragged piece was killed\n");
+		set_moveit_flag(false);
 
-			// Mark that we processed the last motion event
-			set_more_events_flag(false);
+		// repaint square from last dragging step
+		cairo_t *cache_dc = cairo_create(main_board->cache_layer);
+		clean_last_drag_step(cache_dc, wi, hi);
+		cairo_destroy(cache_dc);
 
-			// double buffering using cache layer
+		queue_piece_area(dragged_x, dragged_y, wi, hi);
 
-			// Paint dragging Background to cache layer
-			cairo_t *cache_dc = cairo_create(cache_layer);
-			cairo_set_operator(cache_dc, CAIRO_OPERATOR_SOURCE);
-			cairo_set_source_surface(cache_dc, dragging_background, 0.0f, 0.0f);
-			cairo_paint(cache_dc);
+		mouse_dragged_piece = NULL;
+		return G_SOURCE_REMOVE;
+	}
 
-			// Paint piece at new position to cache layer
-			cairo_set_source_surface(cache_dc, mouse_dragged_piece->surf, new_x - wi / 16.0f, new_y - hi / 16.0f);
-			cairo_set_operator(cache_dc, CAIRO_OPERATOR_OVER);
-			cairo_paint(cache_dc);
+	// Get coordinates from last mouse move
+	int new_x, new_y;
+	get_last_move_xy(&new_x, &new_y);
 
-			// destroy cache_dc
-			cairo_destroy(cache_dc);
+	// Mark that we processed the last motion event
+	set_more_events_flag(false);
 
-			// Efficient clip
-			cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
-			cairo_rectangle(cdr, floor(dragged_x - wi / 16.0f), floor(dragged_y - hi / 16.0f), ceil(ww), ceil(hh));
-			cairo_rectangle(cdr, floor(new_x - wi / 16.0f), floor(new_y - hi / 16.0f), ceil(ww), ceil(hh));
-			cairo_clip(cdr);
+	// double buffering using cache layer
 
-			// Apply cache surface to visible canvas
-			cairo_set_operator(cdr, CAIRO_OPERATOR_OVER);
-			cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
-			cairo_paint(cdr);
+	// Paint dragging Background to cache layer
+	cairo_t *cache_dc = cairo_create(main_board->cache_layer);
+	cairo_set_operator(cache_dc, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cache_dc, dragging_background, 0.0f, 0.0f);
+	cairo_paint(cache_dc);
 
-			// debug: uncomment to highlight repainted areas
-//			cairo_set_source_rgba(cdr, 1.0f, 0.0f, 0.0f, .4f);
-//			cairo_rectangle(cdr, dragged_x - wi / 16.0f, dragged_y - hi / 16.0f, ww, hh);
-//			cairo_fill(cdr);
-//			cairo_set_source_rgba(cdr, 0.0f, 1.0f, 0.0f, .4f);
-//			cairo_rectangle(cdr, new_x - wi / 16.0f, new_y - hi / 16.0f, ww, hh);
-//			cairo_fill(cdr);
+	// Paint piece at new position to cache layer
+	set_piece_source(cache_dc, mouse_dragged_piece->surf, new_x, new_y, wi, hi);
+	cairo_set_operator(cache_dc, CAIRO_OPERATOR_OVER);
+	cairo_paint(cache_dc);
 
-			cairo_destroy(cdr);
+	// destroy cache_dc
+	cairo_destroy(cache_dc);
 
-			// FIXME: clean this whole dragging_prev_x shite
-			set_dragging_prev_xy(new_x, new_y);
+	// Only the squares under the previous and new positions reach the screen
+	queue_piece_area(dragged_x, dragged_y, wi, hi);
+	queue_piece_area(new_x, new_y, wi, hi);
 
-			gdk_threads_leave();
+	// FIXME: clean this whole dragging_prev_x shite
+	set_dragging_prev_xy(new_x, new_y);
 
-		}
-//		usleep(1000000/120);
-//		usleep(1000000/60);
-		usleep(3000);
-	}
-	return 0;
+	// keep ticking, the next frame stops if no motion came in
+	return G_SOURCE_CONTINUE;
 }
 
-/* Generate an array of xy coordinates to animate a move from start->mid->end. */
-// FIXME: review this
-static void plot_coords(double start[2], double mid[2], double end[2], int points_to_plot, double **plots, int *nPlots) {
-	//int denom;
-	double denom;
-	int n, count;
-	double half_points_num = points_to_plot/2.0f;
-	double k = pow(50, ((double)1.0f)/half_points_num);
-	//printf("k %f\n", k);
-	count = 0;
-
-	/* add the start position to the plots */
-	plots[count][0] = start[0];
-	plots[count][1] = start[1];
-	count++;
-
-	/* Step in */
-	denom = pow(k, half_points_num);
-
-	for (n = 0; n < half_points_num; n++) {
-		plots[count][0] = start[0] + (mid[0] - start[0]) / denom;
-		plots[count][1] = start[1] + (mid[1] - start[1]) / denom;
-		count ++;
-		denom /= k;
+/* Repaint the dragged piece once per frame while it moves
+ * Runs from the frame clock, with the GDK lock held */
+static gboolean drag_one_frame(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer data) {
+	gboolean more = paint_drag_frame(gtk_widget_get_allocated_width(board), gtk_widget_get_allocated_height(board));
+	if (more == G_SOURCE_REMOVE) {
+		drag_tick_id = 0;
 	}
+	return more;
+}
 
-	/* Step out */
-	denom = k;
-	for (n = 0; n < half_points_num; n++) {
-		plots[count][0] = end[0] - (end[0] - mid[0]) / denom;
-		plots[count][1] = end[1] - (end[1] - mid[1]) / denom;
-		count++;
-		denom *= k;
+/* Called on motion events, with the GDK lock held */
+void queue_drag_frame(void) {
+	if (!drag_tick_id) {
+		drag_tick_id = gtk_widget_add_tick_callback(board, drag_one_frame, NULL, NULL);
 	}
-
-	/* add the final position to the plots */
-	plots[count][0] = end[0];
-	plots[count][1] = end[1];
-	count++;
-
-	*nPlots = count;
 }
 
-
-/* This must be called to free up the malloc'ed memory */
-static void free_anim_data(struct anim_data *anim) {
-	int i;
-	for (i = 0; i < ANIM_SIZE; i++) {
-		free(anim->plots[i]);
+/* The user's move, timestamped by timeseal on its way out, clock-sync.c times its echo */
+static void send_move_to_ics(char *ics_mv, int colour) {
+	send_to_ics(ics_mv);
+	if (ics_mode) {
+		clock_sync_move_sent(main_clock, colour);
 	}
-	free(anim->plots);
-	free(anim);
 }
 
 static void clip_to_square(cairo_t *dc, int col, int row, int wi, int hi) {
@@ -2357,49 +2193,19 @@ static void clip_to_square(cairo_t *dc, int col, int row, int wi, int hi) {
 }
 
 static void square_to_rectangle(cairo_t *dc, int col, int row, int wi, int hi) {
-	double xy[2];
-	loc_to_xy(col, row, xy, wi, hi);
-	double square_width = wi / 8.0f;
-	double square_height = hi / 8.0f;
-	double half_width = square_width / 2.0f;
-	double half_height = square_height / 2.0f;
-
-	// use this instead for plain rectangle
-	cairo_rectangle(dc, xy[0] - half_width, xy[1] - half_height, square_width, square_height);
+	cairo_rectangle_int_t square;
+	loc_to_rectangle(col, row, &square, wi, hi);
+	cairo_rectangle(dc, square.x, square.y, square.width, square.height);
 }
 
 // Highlight a square, e.g. to mark a selection or last move
-static void highlight_square(cairo_t *dc, int col, int row, double r, double g, double b, double a, int wi, int hi) {
-	double xy[2];
-	loc_to_xy(col, row, xy, wi, hi);
-	double square_width = wi / 8.0f;
-	double square_height = hi / 8.0f;
-	double half_width = square_width / 2.0f;
-	double half_height = square_height / 2.0f;
-
-	cairo_rectangle(dc, xy[0] - half_width, xy[1] - half_height, square_width, square_height);
-	cairo_set_source_rgba(dc, r, g, b, a);
-	cairo_fill(dc);
+static void highlight_square(int col, int row, double r, double g, double b, double a) {
+	board_context_add_highlight(main_board, col, row, false, r, g, b, a);
 }
 
 // Highlight a square to mark check
-static void highlight_check_square(cairo_t *dc, int col, int row, double r, double g, double b, double a, int wi, int hi) {
-	double xy[2];
-	loc_to_xy(col, row, xy, wi, hi);
-
-	double square_width = wi / 8.0f;
-	double square_height = hi / 8.0f;
-	double half_width = square_width / 2.0f;
-	double half_height = square_height / 2.0f;
-
-	cairo_pattern_t *p = cairo_pattern_create_radial(xy[0], xy[1], 1.3 * half_width, xy[0], xy[1], 0.5 * half_width);
-	cairo_pattern_add_color_stop_rgba(p, 0, r, g, b, 0);
-	cairo_pattern_add_color_stop_rgba(p, 1, r, g, b, a);
-	cairo_rectangle(dc, xy[0] - half_width, xy[1] - half_height, square_width, square_height);
-	cairo_clip(dc);
-	cairo_set_source(dc, p);
-	cairo_mask(dc, p);
-	cairo_fill(dc);
+static void highlight_check_square(int col, int row, double r, double g, double b, double a) {
+	board_context_add_highlight(main_board, col, row, true, r, g, b, a);
 }
 
 static void logical_promote(int last_promote) {
@@ -2483,7 +2289,7 @@ void choose_promote(int last_promote, bool only_surfaces, bool only_logical, int
 		sprintf(ics_mv, "%c%c%c%c=%c\n", 'a' + ocol, '1' + orow, 'a' + ncol, '1' + nrow, type_to_char(to_promote->type));
 		char uci_mv[MOVE_BUFF_SIZE];
 		sprintf(uci_mv, "%c%c%c%c%c\n", 'a' + ocol, '1' + orow, 'a' + ncol, '1' + nrow, (char) (type_to_char(to_promote->type) + 32));
-		send_to_ics(ics_mv);
+		send_move_to_ics(ics_mv, to_promote->colour);
 		send_to_uci(uci_mv);
 
 		char bufstr[8];
@@ -2510,25 +2316,13 @@ void choose_promote(int last_promote, bool only_surfaces, bool only_logical, int
 		}
 
 		// repaint that square for new piece to appear
-		double xy[2];
-		loc_to_xy(ncol, nrow, xy, old_wi, old_hi);
-		gtk_widget_queue_draw_area(board,
-		                           (int) floor(xy[0] - old_wi / 16.0),
-		                           (int) floor(xy[1] - old_hi / 16.0),
-		                           (int) ceil(old_wi / 8.0),
-		                           (int) ceil(old_hi / 8.0));
+		damage_square(ncol, nrow, old_wi, old_hi);
 
 		bool king_is_checked = is_king_checked(main_game, main_game->whose_turn);
 		if (king_is_checked) {
-			double king_xy[2];
 			warn_check(old_wi, old_hi);
-			loc_to_xy(king_in_check_piece->pos.column, king_in_check_piece->pos.row, king_xy, old_wi, old_wi);
-			gtk_widget_queue_draw_area(board,
-			                           (int) floor(king_xy[0] - old_wi / 16.0),
-			                           (int) floor(king_xy[1] - old_hi / 16.0),
-			                           (int) ceil(old_wi / 8.0),
-			                           (int) ceil(old_hi / 8.0));
 		}
+		queue_board_damage();
 	}
 
 }
@@ -2559,11 +2353,12 @@ void reset_board(void) {
 	prev_highlighted_move[0] = -1;
 	// Need to reassign surfaces in case of promotions during previous game
 	assign_surfaces();
-	init_highlight_under_surface(old_wi, old_hi);
+	clear_square_highlights();
 	draw_board_surface(old_wi, old_hi);
 	draw_pieces_surface(old_wi, old_hi);
 	init_dragging_background(old_wi, old_hi);
-	gtk_widget_queue_draw(GTK_WIDGET(board));
+	damage_board();
+	queue_board_damage();
 }
 
 gboolean test_animate_random_step(gpointer data) {
@@ -2608,9 +2403,6 @@ gboolean test_animate_random_step(gpointer data) {
 	xx %= (int)wi;
 	yy %= (int)hi;
 
-	double ww = wi/8.0f;
-	double hh = hi/8.0f;
-
 	/* ENTER THREADS */
 	gdk_threads_enter();
 	{
@@ -2618,31 +2410,31 @@ gboolean test_animate_random_step(gpointer data) {
 	cairo_t *dragging_dc;
 	// clean last step from dragging background - [added since we now paint to draggin_layer]
 		dragging_dc = cairo_create(dragging_background);
-		cairo_rectangle(dragging_dc, (piece->colour?floor(prev_x1-wi/16.0f):floor(prev_x2-wi/16.0f)), (piece->colour?floor(prev_y1-hi/16.0f):floor(prev_y2-hi/16.0f)), ceil(ww), ceil(hh));
+		piece_rectangle(dragging_dc, piece->colour ? prev_x1 : prev_x2, piece->colour ? prev_y1 : prev_y2, wi, hi);
 		cairo_clip(dragging_dc);
 		paint_layers(dragging_dc);
 		cairo_destroy(dragging_dc);
 
 		// paint piece on it - [added since we now paint to dragging_layer]
 		dragging_dc = cairo_create(dragging_background);
-		cairo_set_source_surface(dragging_dc, piece->surf, xx-wi/16, yy-hi/16);
-		cairo_rectangle(dragging_dc, floor(xx-wi/16), floor(yy-hi/16), ceil(ww), ceil(hh));
+		set_piece_source(dragging_dc, piece->surf, xx, yy, wi, hi);
+		piece_rectangle(dragging_dc, xx, yy, wi, hi);
 		cairo_clip(dragging_dc);
 		cairo_paint(dragging_dc);
 		cairo_destroy(dragging_dc);
 
 
 		// paint buffer surface with dragging background
-		cairo_t *cache_dc = cairo_create(cache_layer);
+		cairo_t *cache_dc = cairo_create(main_board->cache_layer);
 		cairo_set_source_surface (cache_dc, dragging_background, 0.0f, 0.0f);
-		cairo_rectangle(dragging_dc, (piece->colour?floor(prev_x1-wi/16.0f):floor(prev_x2-wi/16.0f)), (piece->colour?floor(prev_y1-hi/16.0f):floor(prev_y2-hi/16.0f)), ceil(ww), ceil(hh));
-		cairo_rectangle(cache_dc, floor(xx-wi/16), floor(yy-hi/16), ceil(ww), ceil(hh));
+		piece_rectangle(dragging_dc, piece->colour ? prev_x1 : prev_x2, piece->colour ? prev_y1 : prev_y2, wi, hi);
+		piece_rectangle(cache_dc, xx, yy, wi, hi);
 		cairo_clip(cache_dc);
 		cairo_paint(cache_dc);
 
 		// paint animated piece at new position - [removed since we now paint to dragging_layer]
 	//	cairo_set_operator(cache_dc, CAIRO_OPERATOR_OVER);
-	//	cairo_set_source_surface (cache_dc, anim->piece->surf, xx-wi/16.0f, yy-hi/16.0f);
+	//	set_piece_source(cache_dc, anim->piece->surf, xx, yy, wi, hi);
 	//	cairo_paint(cache_dc);
 
 		// If a piece is being dragged and overlaps with the animation, repaint the dragged piece above to cache layer
@@ -2650,7 +2442,7 @@ gboolean test_animate_random_step(gpointer data) {
 			double dragged_x, dragged_y;
 			get_dragging_prev_xy(&dragged_x, &dragged_y);
 			//FIXME: better lock access to mouse_dragged_piece (this could segfault otherwise)
-			cairo_set_source_surface(cache_dc, mouse_dragged_piece->surf, dragged_x - wi / 16.0f, dragged_y - hi / 16.0f);
+			set_piece_source(cache_dc, mouse_dragged_piece->surf, dragged_x, dragged_y, wi, hi);
 			cairo_set_operator(cache_dc, CAIRO_OPERATOR_OVER);
 			cairo_paint(cache_dc);
 		}
@@ -2667,13 +2459,13 @@ gboolean test_animate_random_step(gpointer data) {
 			return FALSE;
 		}
 		cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
-		cairo_rectangle(cdr, floor(xx-wi/16.0f), floor(yy-hi/16.0f), ceil(ww), ceil(hh));
-		cairo_rectangle(cdr, (piece->colour?floor(prev_x1-wi/16.0f):floor(prev_x2-wi/16.0f)), (piece->colour?floor(prev_y1-hi/16.0f):floor(prev_y2-hi/16.0f)), ceil(ww), ceil(hh));
+		piece_rectangle(cdr, xx, yy, wi, hi);
+		piece_rectangle(cdr, piece->colour ? prev_x1 : prev_x2, piece->colour ? prev_y1 : prev_y2, wi, hi);
 		cairo_clip(cdr);
 
 		// apply buffered surface to cr (NB: cr is clipped)
 		cairo_set_operator (cdr, CAIRO_OPERATOR_OVER);
-		cairo_set_source_surface (cdr, cache_layer, 0.0f, 0.0f);
+		cairo_set_source_surface (cdr, main_board->cache_layer, 0.0f, 0.0f);
 		cairo_paint(cdr);
 
 		// debug
@@ -10,23 +10,35 @@
 
 #include "cairo-board.h"
 #include "chess-backend.h"
+#include "board-context.h"
 
-#define ANIM_SIZE 2048
+#define ANIM_POOL_SIZE 64 // two per piece, a killed animation lingers until its next frame
+#define ANIM_STEP_DURATION 8000 // animation time per path step, in microseconds
+#define ANIM_EASE_RATE 50.0 // speed at the middle of an animation relative to its start
 
-void *process_moves(void *ptr);
+extern board_context *main_board;
+
+void queue_drag_frame(void);
 void reset_board(void);
 void draw_full_update(cairo_t *cdr, int wi, int hi);
 void draw_scaled(cairo_t *cdr, int wi, int hi);
 void draw_cheap_repaint(cairo_t *cdr, int wi, int hi);
+void damage_rectangle(int x, int y, int width, int height);
+void damage_square(int col, int row, int wi, int hi);
+void damage_board(void);
+void queue_board_damage(void);
 void handle_left_mouse_up(void);
 void handle_left_mouse_down(GtkWidget *pWidget, int wi, int hi, int x, int y);
 void handle_right_button_press(GtkWidget *pWidget, int wi, int hi);
 void handle_middle_button_press(GtkWidget *pWidget, int wi, int hi);
 void handle_flip_board(GtkWidget *pWidget, bool lock_threads);
 void init_dragging_background(int wi, int hi);
-void init_highlight_under_surface(int wi, int hi);
+void clear_square_highlights(void);
+void clean_square_highlights(int col, int row);
 void init_highlight_over_surface(int wi, int hi);
+void init_main_board(GtkWidget *widget, chess_game *game);
 void draw_board_surface(int wi, int hi);
+int board_scale_factor(void);
 void draw_pieces_surface(int wi, int hi);
 void highlight_move(int source_col, int source_row, int dest_col, int dest_row, int wi, int hi);
 void highlight_pre_move(int pre_move[4], int wi, int hi);
@@ -38,6 +50,9 @@ void choose_promote_handler(void *GtkWidget, gpointer value);
 void choose_promote_deactivate_handler(void *GtkWidget, gpointer value, gboolean only_surfaces);
 
 void init_anims_map(void);
+struct anim_data *plan_move_animation(chess_piece *piece, int old_col, int old_row, int new_col, int new_row, int move_result, int move_source, int wi, int hi);
+gboolean paint_animation_frame(struct anim_data *anim, gint64 frame_time, int wi, int hi);
+gboolean paint_drag_frame(int wi, int hi);
 
 // TEST
 gboolean test_animate_random_step(gpointer data);
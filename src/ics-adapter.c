@@ -1,3 +1,5 @@
+#define LOG_SUBSYSTEM LOG_ICS
+
 #include "ics-adapter.h"
 #include "cairo-board.h"
 #include "ics_scanner.h"
@@ -8,11 +10,11 @@
 #include "chess-backend.h"
 #include "drawing-backend.h"
 #include "netstuff.h"
-
-/* How much data we read from ICS at once
- * Try smaller values to test the stitching mechanism */
-// #define ICS_BUFF_SIZE 32
-#define ICS_BUFF_SIZE 1024
+#include "ics-ring.h"
+#include "trace.h"
+#include "metrics.h"
+#include "observation-grid.h"
+#include "clock-sync.h"
 
 static int finished_parsing_moves = 0;
 static int requested_times = 0;
@@ -29,6 +31,8 @@ static int requested_moves = 0;
 static int requested_start = 0;
 static int got_header = 0;
 static int parsed_plys = 0;
+static gint64 ics_read_time = 0; // when the buffer being parsed was read, for latency metrics
+static ics_ring ics_in; // from the reader thread to the parser thread
 
 static pthread_t ics_reader_thread;
 static pthread_t ics_buff_parser_thread;
@@ -41,7 +45,6 @@ bool ics_logged_in = false;
 void * icsPr;
 int ics_socket;
 int ics_fd;
-int ics_data_pipe[2];
 
 bool my_channels_requested = false;
 bool got_my_channels_header = false;
@@ -135,6 +138,8 @@ bool check_board12_game_consistency() {
 }
 
 int parse_board12(char *string_chunk) {
+	TRACE_FUNCTION();
+	metrics_mark(METRIC_MARK_ICS, ics_read_time);
 	int gamenum, relation, basetime, increment, ics_flip = 0;
 	int n, moveNum, white_stren, black_stren, white_time, black_time;
 	int double_push, castle_ws, castle_wl, castle_bs, castle_bl, fifty_move_count;
@@ -190,6 +195,22 @@ int parse_board12(char *string_chunk) {
 		debug("\tBoard chars: '%s'\n", last_board_chars);
 		debug("\tSAN move: '%s'\n\n", san_move);
 
+		if (relation == 0 || relation == -2) {
+			observed_position position;
+			position.game_num = gamenum;
+			memcpy(position.board_chars, last_board_chars, sizeof(position.board_chars));
+			position.black_to_play = to_play == 'B';
+			position.flipped = ics_flip == 1;
+			// the ticking field is missing on older servers, clocks start after black's first move
+			position.ticking = n > 23 ? ticking == 1 : relation == 0 && moveNum >= 2;
+			position.white_time = white_time;
+			position.black_time = black_time;
+			strncpy(position.white_name, w_name, sizeof(position.white_name));
+			strncpy(position.black_name, b_name, sizeof(position.black_name));
+			strncpy(position.move, str, sizeof(position.move));
+			observation_grid_post_position(&position);
+		}
+
 		// Did we ask for times?
 		if (requested_times) {
 			requested_times = 0;
@@ -202,9 +223,9 @@ int parse_board12(char *string_chunk) {
 			return 0;
 		}
 
-		// game and clocks started: update the clocks
+		// game and clocks started: bring the clocks in line with the server's
 		if (game_started && clock_started) {
-			update_clocks(main_clock, white_time, black_time, true);
+			clock_sync_board(main_clock, white_time, black_time, (to_play == 'W') ? 0 : 1, relation);
 		}
 
 		// game started and not observing: set last move and swap clocks if needed
@@ -611,6 +632,7 @@ int parse_end_message(char *message, char end_token[32]) {
 
 	char *first_space;
 	game_num = strtol(message+5, &first_space, 10);
+	observation_grid_post_end((int) game_num);
 	if (!am_interested_in_game(game_num)) {
 		// ignore this message
 		debug("Ignoring endmessage for game %ld\n", game_num);
@@ -1103,135 +1125,78 @@ gboolean is_printable(char c) {
 	return FALSE;
 }
 
-void parse_ics_buffer(void) {
-
-	static int chopped_len = 0;
-
-	int i,j;
-	char raw_buff[ICS_BUFF_SIZE];
-
-
-	static char *buff;
-	static int current_buff_alloc = 0;
-
-	memset(raw_buff, 0, ICS_BUFF_SIZE);
+/* NULs and \r confuse the hell out of flex.
+ * If some variable is set, FICS will also send 0x7 (bell) characters
+ * to notifiy of a move, we filter that out as well */
+static bool is_filtered(char c) {
+	return c == 0 || c == '\r' || c == 0x7;
+}
 
-	// read at most ICS_BUFF_SIZE bytes from the ICS pipe
-	int nread = read(ics_data_pipe[0], &raw_buff, ICS_BUFF_SIZE);
-	if (nread < 1) {
-		fprintf(stderr, "ERROR: failed to read data from ICS pipe\n");
+/* How many of the len bytes can be parsed now: whole lines, plus a trailing prompt.
+ * What is left is a chopped line, it stays in the ring until the rest of it comes,
+ * see parse_ics_buffer for lines that never fit */
+static size_t frame_lines(const char *data, size_t len) {
+	size_t n = len;
+	while (n && data[n-1] != '\n') {
+		n--;
 	}
 
-	// Uncomment following block to generate a log of the raw FICS output
-	/*
-	char log_buff[ICS_BUFF_SIZE];
-	memset(log_buff, 0, ICS_BUFF_SIZE);
-	memcpy(log_buff, raw_buff, nread);
-	FILE *log_file = fopen("log_cairo.txt", "a+");
-	fprintf(log_file,"%s", log_buff);
-	fclose(log_file);
-	*/
-
-	/* *
-	 * Check if the case where a truncated line starts our buffer
-	 * actually happens (should never happen with a buffer size greater than 512)
-	 * */
-	if (raw_buff[0] == '\\') {
-		debug("Raw Buffer started with a truncated line!!\n");
+	const char *rest = data + n;
+	const char *end = data + len;
+	while (rest < end && is_filtered(*rest)) {
+		rest++;
 	}
-
-	/* adjust the memory allocated to buff to match just what we need */
-	int new_alloc = nread + chopped_len +1; // allocate 1 extra to NULL terminate
-	if (current_buff_alloc != new_alloc) {
-		/* realloc might move the pointer so use a temp address */
-		char *temp = realloc(buff-chopped_len, new_alloc);
-		if (!temp) {
-			perror("Realloc failed!!");
-			exit(1);
-		}
-		/* assign the right address to buff */
-		buff = temp+chopped_len;
-		current_buff_alloc = new_alloc;
+	size_t left = end - rest;
+	if (!left) {
+		return len;
 	}
 
+	/* The fics, login and password prompts don't end with a newline.
+	 * These are valid expected chopped lines which we don't want to reparse */
+	if ((left >= 6 && !memcmp(rest, "fics% ", 6))
+			|| (left >= 7 && !memcmp(rest, "login: ", 7))
+			|| (left >= 10 && !memcmp(rest, "password: ", 10))) {
+		return len;
+	}
+	return n;
+}
 
-	/* memset buff to 0 without overwriting the chopped bit that is before */
-	memset(buff, 0, nread+1);
-
+/* Bytes up to and including the first newline, all of them if there is none */
+static size_t to_line_end(const char *data, size_t len) {
+	const char *newline = memchr(data, '\n', len);
+	return newline ? (size_t) (newline - data) + 1 : len;
+}
 
-	/* Remove NULLs and \r which confuse the hell out of flex.
-	 * If some variable is set, FICS will also send 0x7 (bell) characters
-	 * to notifiy of a move, we filter that out here as well */
-	j = 0;
-	for (i = 0; i < nread; i++) {
-		if ( raw_buff[i] != 0 && raw_buff[i] != '\r' && raw_buff[i] != 0x7 ) {
-			buff[j] = raw_buff[i];
-			j++;
+/* Drop the filtered characters where they are, returns the new length */
+static size_t filter_in_place(char *data, size_t len) {
+	size_t i, j;
+	for (i = j = 0; i < len; i++) {
+		if (!is_filtered(data[i])) {
+			data[j++] = data[i];
 		}
 	}
-	/* NB: buff is still NULL terminated */
-
-	/////////////
-	/* Remove line truncation marks and stitch them */
-	/* NB: buff is still NULL terminated */
-	/////////////
-
-	if (chopped_len) {
-		buff -= chopped_len;
-		chopped_len = 0;
-	}
-
-	/* Detect a chopped line if the last character in the buffer
-	 * is not a \n.
-	 * If a chopped line is detected, chopped_len is set appropriately
-	 * and we copy the chopped bit to the next scanned buff*/
-	char *buff_end = strchr(buff, '\0') - 1; // first null is end of string
-	if (*buff_end != '\n') {
-		/* The only exceptions to this are the fics, login and password prompts.
-		 * These are valid expected chopped lines which we don't want to reparse */
-		char *last_endline = strrchr(buff, '\n'); // get last endline
-		if (last_endline == NULL) {
-			last_endline = buff-1;
-		}
-		if (!memcmp(last_endline+1, "fics% ", 6)) {
-			//debug("DETECTED FICS PROMPT\n");
-		}
-		else if (!memcmp(last_endline+1, "login: ", 7)) {
-			//debug("DETECTED LOGIN PROMPT\n");
-		}
-		else if (!memcmp(last_endline+1, "password: ", 10)) {
-			//debug("DETECTED PASSWORD PROMPT\n");
-		}
-		else {
-			/* Detected a chopped line */
-			chopped_len = buff_end - last_endline;
-
-			/* grab chopped bit */
-			char *chopped_bit = malloc(chopped_len);
-			memcpy(chopped_bit, last_endline + 1, chopped_len);
+	return j;
+}
 
-			/* slide buff */
-			memmove(buff+chopped_len, buff, (buff_end-buff + 1)-chopped_len);
-			/* NB: buff is still NULL terminated after slide */
+/* Scan and handle len bytes of whole lines, in place in the ring */
+static void parse_ics_lines(char *data, size_t len) {
 
-			/* copy the chopped bit back to the beginning of buff */
-			memcpy(buff, chopped_bit, chopped_len);
-			free(chopped_bit);
+	int i;
+	YY_BUFFER_STATE scanned;
 
-			/* move buff pointer to the beginning of the unchopped data
-			 * This means we won't parse the chopped bit this time round */
-			buff += chopped_len;
-		}
-	}
-	else {
-		/* Buffer ended by newline */
-		chopped_len = 0;
+	size_t used = filter_in_place(data, len);
+	if (len - used >= 2) {
+		// flex scans in place a buffer ending with two NULs, the filtered characters left room for them
+		data[used] = data[used+1] = '\0';
+		scanned = ics_scanner__scan_buffer(data, used + 2);
+	} else {
+		scanned = ics_scanner__scan_bytes(data, used);
 	}
 
-	char *post_buff = calloc(current_buff_alloc-chopped_len+1, sizeof(char));
-
+	// echoed as scanned, except for a lone newline
+	bool held_newline = false;
+	bool echoed = false;
 
-	ics_scanner__scan_bytes(buff, current_buff_alloc-chopped_len);
 	i = 0;
 	while (i > -1) {
 
@@ -1253,7 +1218,16 @@ void parse_ics_buffer(void) {
 			case GAME_END:
 			case FOLLOWING:
 			default:
-				strcat(post_buff, ics_scanner_text);
+				if (!echoed && !held_newline && !strcmp(ics_scanner_text, "\n")) {
+					held_newline = true;
+					break;
+				}
+				if (held_newline) {
+					fputc('\n', stdout);
+					held_newline = false;
+				}
+				fputs(ics_scanner_text, stdout);
+				echoed = true;
 				break;
 		}
 
@@ -1348,8 +1322,11 @@ void parse_ics_buffer(void) {
 				strcpy(my_handle, ics_scanner_text);
 				debug("DEBUG got handle for this session: '%s'\n", my_handle);
 
+				// all in one write
+				hold_fics_sends();
 				set_fics_variables();
 				request_my_channels();
+				release_fics_sends();
 
 				break;
 
@@ -1567,7 +1544,7 @@ void parse_ics_buffer(void) {
 				gdk_threads_enter();
 				draw_pieces_surface(old_wi, old_hi);
 				init_dragging_background(old_wi, old_hi);
-				init_highlight_under_surface(old_wi, old_hi);
+				clear_square_highlights();
 //				init_highlight_over_surface(old_wi, old_hi);
 
 				// highlight last move
@@ -1578,7 +1555,8 @@ void parse_ics_buffer(void) {
 					warn_check(old_wi, old_hi);
 				}
 
-				gtk_widget_queue_draw(GTK_WIDGET(board));
+				damage_board();
+				queue_board_damage();
 				gdk_threads_leave();
 				if (parsed_plys > 1 && !clock_started) {
 					clock_started = 1;
@@ -1653,22 +1631,61 @@ void parse_ics_buffer(void) {
 		}
 	}
 
-	if (strlen(post_buff) != 1 || post_buff[0] != '\n') {
-		fprintf(stdout, "%s", post_buff);
+	if (echoed) {
 		fflush(stdout);
 	}
-	free(post_buff);
+	ics_scanner__delete_buffer(scanned);
+}
 
+/* Parse the whole lines the reader put in the ring, false once it closed */
+static bool parse_ics_buffer(void) {
+
+	// what the ring holds of a chopped line, no use looking again before more comes
+	static size_t chopped_len = 0;
+
+	if (!ics_ring_wait(&ics_in, chopped_len)) {
+		return false;
+	}
+	TRACE_SCOPE("parse_ics_buffer");
+	ics_read_time = g_get_monotonic_time();
 
-	return;
+	// the rest of a line too long to frame is thrown away as it comes
+	static bool dropping = false;
+
+	char *data;
+	size_t len, framed;
+	while ((data = ics_ring_peek(&ics_in, &len)), len) {
+		if (dropping) {
+			framed = to_line_end(data, len);
+			dropping = data[framed-1] != '\n';
+			ics_ring_consume(&ics_in, framed);
+			continue;
+		}
+		framed = frame_lines(data, len);
+		if (!framed) {
+			// at least ICS_RING_SPILL bytes can always be seen in one piece, flex must not get a fragment
+			if (len >= ICS_RING_SPILL) {
+				fprintf(stderr, "Dropping an ICS line longer than %d bytes\n", ICS_RING_SPILL);
+				dropping = true;
+				continue;
+			}
+			break;
+		}
+		parse_ics_lines(data, framed);
+		ics_ring_consume(&ics_in, framed);
+	}
+	chopped_len = len;
+
+	return true;
 }
 
 void *read_message_function(void *ptr) {
 	int *socket = (int *) (ptr);
 
-	while (!read_write_ics_fd(STDIN_FILENO, ics_data_pipe[1], *socket)) {
-		usleep(10000);
-	}
+	// blocks until there is something to read
+	while (!read_write_ics_fd(STDIN_FILENO, &ics_in, *socket));
+	// wakes the parser up for good
+	ics_ring_close(&ics_in);
 
 	fprintf(stdout, "[read ics thread] - Closing ICS reader\n");
 	return 0;
@@ -1676,9 +1693,7 @@ void *read_message_function(void *ptr) {
 
 void *parse_ics_function(void *ptr) {
 
-	while (is_running_flag()) {
-		parse_ics_buffer();
-	}
+	while (is_running_flag() && parse_ics_buffer());
 
 	fprintf(stdout, "[parse ics thread] - Closing ICS parser\n");
 	return 0;
@@ -1691,10 +1706,7 @@ int init_ics() {
 		return 1;
 	}
 	fprintf(stdout, "Connected to ICS server.\n");
-	if (pipe(ics_data_pipe)) {
-		perror("Pipe creation failed");
-		return 1;
-	}
+	ics_ring_init(&ics_in);
 	pthread_create(&ics_reader_thread, NULL, read_message_function, (void*)(&ics_fd));
 	pthread_create(&ics_buff_parser_thread, NULL, parse_ics_function, (void*)(&ics_fd));
 	return 0;
@@ -0,0 +1,95 @@
+#include <string.h>
+
+#include "ics-ring.h"
+
+void ics_ring_init(ics_ring *ring) {
+	ring->head = 0;
+	ring->tail = 0;
+	ring->closed = false;
+	pthread_mutex_init(&ring->lock, NULL);
+	pthread_cond_init(&ring->moved, NULL);
+}
+
+static void wake(ics_ring *ring) {
+	pthread_mutex_lock(&ring->lock);
+	pthread_cond_broadcast(&ring->moved);
+	pthread_mutex_unlock(&ring->lock);
+}
+
+/* Contiguous free space after the head and the held bytes just past it,
+ * blocks while the ring is full */
+char *ics_ring_reserve(ics_ring *ring, size_t held, size_t *len) {
+	size_t start = ring->head + held;
+	size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	if (start - tail == ICS_RING_SIZE) {
+		pthread_mutex_lock(&ring->lock);
+		while (start - (tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) == ICS_RING_SIZE) {
+			pthread_cond_wait(&ring->moved, &ring->lock);
+		}
+		pthread_mutex_unlock(&ring->lock);
+	}
+
+	size_t offset = start & (ICS_RING_SIZE - 1);
+	size_t space = ICS_RING_SIZE - (start - tail);
+	*len = space < ICS_RING_SIZE - offset ? space : ICS_RING_SIZE - offset;
+	return ring->data + offset;
+}
+
+/* Hand len bytes from the head over to the parser */
+void ics_ring_commit(ics_ring *ring, size_t len) {
+	if (!len) {
+		return;
+	}
+	__atomic_store_n(&ring->head, ring->head + len, __ATOMIC_RELEASE);
+	// once per read from the socket, not per line
+	wake(ring);
+}
+
+void ics_ring_close(ics_ring *ring) {
+	pthread_mutex_lock(&ring->lock);
+	ring->closed = true;
+	pthread_cond_broadcast(&ring->moved);
+	pthread_mutex_unlock(&ring->lock);
+}
+
+/* Block until more than seen bytes are waiting
+ * Returns how many are, 0 once the reader closed and nothing new came */
+size_t ics_ring_wait(ics_ring *ring, size_t seen) {
+	size_t waiting;
+
+	pthread_mutex_lock(&ring->lock);
+	while ((waiting = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - ring->tail) <= seen && !ring->closed) {
+		pthread_cond_wait(&ring->moved, &ring->lock);
+	}
+	pthread_mutex_unlock(&ring->lock);
+
+	return waiting > seen ? waiting : 0;
+}
+
+/* The waiting bytes from the tail that can be read in one piece
+ * Near the end of the ring the start is mirrored past it, so that a line going
+ * round reads straight. Those are the only bytes ever copied on the way in */
+char *ics_ring_peek(ics_ring *ring, size_t *len) {
+	size_t waiting = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - ring->tail;
+	size_t offset = ring->tail & (ICS_RING_SIZE - 1);
+	size_t to_end = ICS_RING_SIZE - offset;
+
+	if (waiting > to_end && to_end < ICS_RING_SPILL) {
+		size_t spill = waiting - to_end < ICS_RING_SPILL ? waiting - to_end : ICS_RING_SPILL;
+		memcpy(ring->data + ICS_RING_SIZE, ring->data, spill);
+		*len = to_end + spill;
+	} else {
+		*len = waiting < to_end ? waiting : to_end;
+	}
+	return ring->data + offset;
+}
+
+/* Give len bytes from the tail back to the reader */
+void ics_ring_consume(ics_ring *ring, size_t len) {
+	if (!len) {
+		return;
+	}
+	__atomic_store_n(&ring->tail, ring->tail + len, __ATOMIC_RELEASE);
+	wake(ring);
+}
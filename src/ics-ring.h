@@ -0,0 +1,41 @@
+#ifndef CAIRO_BOARD_ICS_RING_H
+#define CAIRO_BOARD_ICS_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/* Single producer, single consumer byte ring between the ICS reader and the parser
+ * The reader reads the socket straight into the free space and publishes it,
+ * the parser frames and filters whole lines where they lie, then gives them back.
+ * head and tail only ever grow, their difference is how much is waiting */
+
+#define ICS_RING_SIZE 65536 // must be a power of two
+#define ICS_RING_SPILL 16384 // lines up to this long can always be read in one piece, see parse_ics_buffer
+
+typedef struct {
+	char data[ICS_RING_SIZE + ICS_RING_SPILL];
+	size_t head; // bytes published, only the reader moves it
+	size_t tail; // bytes consumed, only the parser moves it
+	bool closed; // the reader hit end of stream
+	pthread_mutex_t lock; // only to sleep on, the indices are read without it
+	pthread_cond_t moved; // head, tail or closed changed
+} ics_ring;
+
+static inline char *ics_ring_at(ics_ring *ring, size_t pos) {
+	return &ring->data[pos & (ICS_RING_SIZE - 1)];
+}
+
+void ics_ring_init(ics_ring *ring);
+
+/* Reader side */
+char *ics_ring_reserve(ics_ring *ring, size_t held, size_t *len);
+void ics_ring_commit(ics_ring *ring, size_t len);
+void ics_ring_close(ics_ring *ring);
+
+/* Parser side */
+size_t ics_ring_wait(ics_ring *ring, size_t seen);
+char *ics_ring_peek(ics_ring *ring, size_t *len);
+void ics_ring_consume(ics_ring *ring, size_t len);
+
+#endif //CAIRO_BOARD_ICS_RING_H
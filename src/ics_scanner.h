@@ -9,6 +9,8 @@ void ics_scanner_restart (FILE *input_file);
 
 extern int ics_scanner_leng;
 YY_BUFFER_STATE ics_scanner__scan_bytes(const char *bytes, int len);
+YY_BUFFER_STATE ics_scanner__scan_buffer(char *base, yy_size_t size);
+void ics_scanner__delete_buffer(YY_BUFFER_STATE b);
 
 enum _ics_match_type {
 	EOF_TYPE = -1,
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <glib.h>
+
+#include "logging.h"
+
+#define LOG_RING_SIZE 1024 // lines per thread, must be a power of 2
+#define LOG_LINE_SIZE 256
+
+typedef struct _log_ring {
+	char lines[LOG_RING_SIZE][LOG_LINE_SIZE];
+	unsigned long head; // only written by the owning thread
+	unsigned long tail; // only written by the drain thread
+	unsigned long dropped;
+	struct _log_ring *next;
+} log_ring;
+
+int log_levels[LOG_SUBSYSTEMS] = {LOG_ERROR, LOG_ERROR, LOG_ERROR, LOG_ERROR, LOG_ERROR, LOG_ERROR};
+
+static const char *subsystem_names[LOG_SUBSYSTEMS] = {"general", "draw", "chess", "clock", "ics", "uci"};
+static const char *level_names[] = {"off", "error", "info", "debug"};
+static const char level_chars[] = {' ', 'E', 'I', 'D'};
+
+// levels to restore when debug is toggled back off
+static int saved_levels[LOG_SUBSYSTEMS];
+static int debug_toggled = 0;
+
+// all rings ever registered, push only
+static log_ring *all_rings = NULL;
+static __thread log_ring *my_ring = NULL;
+
+static FILE *log_file = NULL;
+static pthread_t log_drain_thread;
+static int draining = 0;
+// set by producers when there is something to drain, the drain thread sleeps until then
+static int drain_pending = 0;
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t drain_wake = PTHREAD_COND_INITIALIZER;
+static gint64 log_epoch = 0;
+
+static log_ring *register_thread(void) {
+	log_ring *ring = calloc(1, sizeof(log_ring));
+	if (!ring) {
+		perror("Failed to allocate log ring");
+		return NULL;
+	}
+
+	// lock-free push onto the list of rings
+	ring->next = __atomic_load_n(&all_rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&all_rings, &ring->next, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	my_ring = ring;
+	return ring;
+}
+
+/* Only the first line after a drain pays for the signal */
+static void wake_drain(void) {
+	if (!__atomic_exchange_n(&drain_pending, 1, __ATOMIC_ACQ_REL)) {
+		pthread_mutex_lock(&drain_lock);
+		pthread_cond_signal(&drain_wake);
+		pthread_mutex_unlock(&drain_lock);
+	}
+}
+
+void log_write(log_subsystem subsystem, log_level level, const char *format, ...) {
+	log_ring *ring = my_ring;
+	if (ring == NULL) {
+		ring = register_thread();
+		if (ring == NULL) {
+			return;
+		}
+	}
+
+	unsigned long head = ring->head;
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SIZE) {
+		__atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	char *line = ring->lines[head & (LOG_RING_SIZE - 1)];
+	gint64 now = g_get_monotonic_time() - log_epoch;
+	int len = snprintf(line, LOG_LINE_SIZE, "%" G_GINT64_FORMAT ".%03d %c %-7s ", now / 1000000, (int) (now / 1000 % 1000),
+	                   level_chars[level], subsystem_names[subsystem]);
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(line + len, (size_t) (LOG_LINE_SIZE - len), format, args);
+	va_end(args);
+
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	wake_drain();
+}
+
+void log_set_level(log_subsystem subsystem, log_level level) {
+	__atomic_store_n(&log_levels[subsystem], level, __ATOMIC_RELAXED);
+}
+
+static int level_from_name(const char *name, size_t len) {
+	int i;
+	for (i = LOG_OFF; i <= LOG_DEBUG; i++) {
+		if (strlen(level_names[i]) == len && !strncmp(level_names[i], name, len)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* spec is a comma separated list of either 'level', applying to all subsystems,
+ * or 'subsystem=level', e.g. "info,ics=debug" */
+int log_set_levels(const char *spec) {
+	int i;
+	const char *token = spec;
+	while (*token) {
+		size_t token_len = strcspn(token, ",");
+		const char *equals = memchr(token, '=', token_len);
+		if (equals == NULL) {
+			int level = level_from_name(token, token_len);
+			if (level < 0) {
+				fprintf(stderr, "Unknown log level '%.*s'\n", (int) token_len, token);
+				return 1;
+			}
+			for (i = 0; i < LOG_SUBSYSTEMS; i++) {
+				log_set_level(i, level);
+			}
+		} else {
+			int level = level_from_name(equals + 1, token_len - (equals + 1 - token));
+			int subsystem = -1;
+			for (i = 0; i < LOG_SUBSYSTEMS; i++) {
+				if (strlen(subsystem_names[i]) == (size_t) (equals - token) && !strncmp(subsystem_names[i], token, equals - token)) {
+					subsystem = i;
+				}
+			}
+			if (level < 0 || subsystem < 0) {
+				fprintf(stderr, "Unknown log setting '%.*s'\n", (int) token_len, token);
+				return 1;
+			}
+			log_set_level(subsystem, level);
+		}
+		token += token_len;
+		if (*token == ',') {
+			token++;
+		}
+	}
+	return 0;
+}
+
+/* Switch every subsystem to debug and back, only touches atomics so it is safe from a signal handler */
+void log_toggle_debug(void) {
+	int i;
+	if (!debug_toggled) {
+		for (i = 0; i < LOG_SUBSYSTEMS; i++) {
+			saved_levels[i] = __atomic_exchange_n(&log_levels[i], LOG_DEBUG, __ATOMIC_RELAXED);
+		}
+		debug_toggled = 1;
+	} else {
+		for (i = 0; i < LOG_SUBSYSTEMS; i++) {
+			log_set_level(i, saved_levels[i]);
+		}
+		debug_toggled = 0;
+	}
+}
+
+static int drain_rings(void) {
+	int count = 0;
+	log_ring *ring;
+	for (ring = __atomic_load_n(&all_rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+		unsigned long head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		unsigned long tail = ring->tail;
+		for (; tail < head; tail++) {
+			char *line = ring->lines[tail & (LOG_RING_SIZE - 1)];
+			size_t len = strlen(line);
+			fwrite(line, 1, len, log_file);
+			if (len == 0 || line[len - 1] != '\n') {
+				fputc('\n', log_file);
+			}
+			count++;
+		}
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+		unsigned long dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+		if (dropped) {
+			fprintf(log_file, "[log] dropped %lu lines\n", dropped);
+		}
+	}
+	if (count) {
+		fflush(log_file);
+	}
+	return count;
+}
+
+static void *drain_function(void *ignored) {
+	while (__atomic_load_n(&draining, __ATOMIC_ACQUIRE)) {
+		// clear before draining so that lines written meanwhile wake us again
+		__atomic_store_n(&drain_pending, 0, __ATOMIC_RELEASE);
+		drain_rings();
+
+		pthread_mutex_lock(&drain_lock);
+		while (!__atomic_load_n(&drain_pending, __ATOMIC_ACQUIRE) && __atomic_load_n(&draining, __ATOMIC_ACQUIRE)) {
+			pthread_cond_wait(&drain_wake, &drain_lock);
+		}
+		pthread_mutex_unlock(&drain_lock);
+	}
+	// flush whatever was logged while stopping
+	drain_rings();
+	return 0;
+}
+
+/* Start the drain thread, logging to stdout if file_path is NULL
+ * Lines logged before this are kept in the rings until it starts */
+int log_start(const char *file_path) {
+	log_epoch = g_get_monotonic_time();
+	if (file_path != NULL) {
+		log_file = fopen(file_path, "a");
+		if (log_file == NULL) {
+			perror("Failed to open log file");
+			log_file = stdout;
+		}
+	} else {
+		log_file = stdout;
+	}
+
+	draining = 1;
+	if (pthread_create(&log_drain_thread, NULL, drain_function, NULL)) {
+		perror("Failed to start log thread");
+		draining = 0;
+		return 1;
+	}
+	return 0;
+}
+
+void log_stop(void) {
+	if (!draining) {
+		return;
+	}
+	pthread_mutex_lock(&drain_lock);
+	__atomic_store_n(&draining, 0, __ATOMIC_RELEASE);
+	pthread_cond_signal(&drain_wake);
+	pthread_mutex_unlock(&drain_lock);
+	pthread_join(log_drain_thread, NULL);
+	if (log_file != stdout) {
+		fclose(log_file);
+	}
+	log_file = NULL;
+}
@@ -0,0 +1,42 @@
+#ifndef __CAIRO_BOARD_LOGGING_H__
+#define __CAIRO_BOARD_LOGGING_H__
+
+/* Asynchronous logging backend behind the debug() and log_info() macros
+ * Callers format into a per-thread lock-free ring buffer and a background
+ * thread drains the rings to the log file, so logging never blocks on I/O.
+ * Lines are dropped (and counted) rather than blocking when a ring is full */
+
+typedef enum {
+	LOG_GENERAL,
+	LOG_DRAW,
+	LOG_CHESS,
+	LOG_CLOCK,
+	LOG_ICS,
+	LOG_UCI,
+	LOG_SUBSYSTEMS
+} log_subsystem;
+
+typedef enum {
+	LOG_OFF,
+	LOG_ERROR,
+	LOG_INFO,
+	LOG_DEBUG
+} log_level;
+
+/* Source files set this before any include to tag their log output */
+#ifndef LOG_SUBSYSTEM
+#define LOG_SUBSYSTEM LOG_GENERAL
+#endif
+
+extern int log_levels[LOG_SUBSYSTEMS];
+
+#define log_enabled(subsystem, level) (__atomic_load_n(&log_levels[subsystem], __ATOMIC_RELAXED) >= (level))
+
+void log_write(log_subsystem subsystem, log_level level, const char *format, ...) __attribute__((format(printf, 3, 4)));
+void log_set_level(log_subsystem subsystem, log_level level);
+int log_set_levels(const char *spec);
+void log_toggle_debug(void);
+int log_start(const char *file_path);
+void log_stop(void);
+
+#endif
@@ -28,6 +28,14 @@
 #include "analysis_panel.h"
 #include "test.h"
 #include "ics-adapter.h"
+#include "trace.h"
+#include "metrics.h"
+#include "observation-grid.h"
+#include "sprite-cache.h"
+#include "ui-queue.h"
+#include "render-bench.h"
+#include "clock-sync.h"
+#include "clock-stats.h"
 
 /* check that C's multibyte output is supported for use with figurine characters */
 #ifndef __STDC_ISO_10646__
@@ -56,6 +64,9 @@ void sig_handler(int sig) {
 		case SIGINT:
 			gtk_main_quit();
 			break;
+		case SIGUSR1:
+			log_toggle_debug();
+			break;
 		case SIGABRT:
 		case SIGSEGV:
 			signal(sig, SIG_IGN);
@@ -68,6 +79,8 @@ void sig_handler(int sig) {
 
 /* <Options variables> */
 gboolean debug_flag = FALSE;
+gboolean startup_trace_flag = FALSE;
+gboolean render_bench_flag = FALSE;
 gboolean ics_mode = FALSE;
 bool guest_mode = false;
 
@@ -126,6 +139,7 @@ int got_premove = 0;
 // </premove variables>
 
 /* GUI variables */
+static gint64 startup_epoch;
 double svg_w, svg_h;
 static guint clock_board_ratio = 20;
 GtkWidget *main_window;
@@ -157,7 +171,9 @@ static int pre_move[4] = {-1};
 
 bool playing = false;
 static guint de_scale_timer = 0;
+static bool sprites_pending = false;
 static guint auto_play_timer = 0;
+static bool pieces_ready = false; // the board is left blank until they load, see pieces_loaded
 static guint clock_refresher = 0;
 
 int old_wi, old_hi;
@@ -237,7 +253,6 @@ void send_to_ics(char*);
 void set_header_label(const char *w_name, const char *b_name, const char *w_rating, const char *b_rating);
 
 static void get_int_from_popup(void);
-static void spawn_mover(void);
 
 /************************ <MULTITHREAD STUFF> ******************************/
 static bool moveit_flag;
@@ -416,10 +431,21 @@ void create_signals(void) {
 
 
 /******** <XY to IJ mapping helpers> ***********/
+/* Squares are whole pixels: square i spans [i*size/8, (i+1)*size/8)
+ * which spreads the size % 8 remainder pixels over the board */
+int square_edge(int i, int size) {
+	return i * size / 8;
+}
+
+/* Inverse of square_edge: the square containing pixel x */
+static int square_index(int x, int size) {
+	return (8 * (x + 1) - 1) / size;
+}
+
 void xy_to_loc(int x, int y, int *pos, int wi, int hi) {
 	bool flipped = is_board_flipped();
-	int a = (int) 8*x/wi;
-	int b = (int) 8*y/hi;
+	int a = square_index(x, wi);
+	int b = square_index(y, hi);
 	pos[0] = (flipped ? 7 - a : a) ;
 	pos[1] = (flipped ? b : 7 - b);
 }
@@ -434,14 +460,27 @@ chess_square *xy_to_square(chess_game *game, int x, int y, int wi, int hi) {
 /* Converts column,row to x,y coordinates */
 void ij_to_xy(int i, int j, double *xy, int wi, int hi) {
 	bool flipped = is_board_flipped();
-	xy[0] = (wi * ((flipped ? 7 - i : i) + .5f)) / 8;
-	xy[1] = (hi * ((flipped ? 7 - j : j) + .5f)) / 8;
+	int a = flipped ? 7 - i : i;
+	int b = flipped ? 7 - j : j;
+	xy[0] = (square_edge(a, wi) + square_edge(a + 1, wi)) / 2.0;
+	xy[1] = (square_edge(b, hi) + square_edge(b + 1, hi)) / 2.0;
 }
 
 void loc_to_xy(int column, int row, double *xy, int wi, int hi) {
 	ij_to_xy(column, 7-row, xy, wi, hi);
 }
 
+/* Whole pixel bounds of a square */
+void loc_to_rectangle(int column, int row, cairo_rectangle_int_t *rect, int wi, int hi) {
+	bool flipped = is_board_flipped();
+	int a = flipped ? 7 - column : column;
+	int b = flipped ? row : 7 - row;
+	rect->x = square_edge(a, wi);
+	rect->y = square_edge(b, hi);
+	rect->width = square_edge(a + 1, wi) - rect->x;
+	rect->height = square_edge(b + 1, hi) - rect->y;
+}
+
 void piece_to_xy(chess_piece *piece, double *xy ,int wi, int hi) {
 	loc_to_xy(piece->pos.column, piece->pos.row, xy, wi, hi);
 }
@@ -458,9 +497,15 @@ void assign_surfaces() {
 }
 
 static gboolean on_board_draw(GtkWidget *pWidget, cairo_t *cdr) {
+	static bool first_draw = true;
+	gint64 frame_start = g_get_monotonic_time();
 	int wi = gtk_widget_get_allocated_width(pWidget);
 	int hi = gtk_widget_get_allocated_height(pWidget);
 
+	if (!pieces_ready) {
+		return FALSE;
+	}
+
 	if (needs_update) {
 		draw_full_update(cdr, wi, hi);
 	} else if (needs_scale) {
@@ -468,6 +513,14 @@ static gboolean on_board_draw(GtkWidget *pWidget, cairo_t *cdr) {
 	} else {
 		draw_cheap_repaint(cdr, wi, hi);
 	}
+	metrics_sample(METRIC_FRAME_TIME, g_get_monotonic_time() - frame_start);
+	metrics_mark_done(METRIC_MARK_ICS, METRIC_ICS_LATENCY);
+	metrics_mark_done(METRIC_MARK_DRAG, METRIC_DRAG_LATENCY);
+
+	if (first_draw) {
+		first_draw = false;
+		startup_trace("first board paint", startup_epoch);
+	}
 
 	return TRUE;
 }
@@ -1021,8 +1074,12 @@ int move_piece(chess_piece *piece, int col, int row, int check_legality, int mov
 	}
 }
 
+static void set_opening_tooltip(gpointer text) {
+	gtk_widget_set_tooltip_text(opening_code_label, text);
+}
+
 void update_eco_tag(bool should_lock_threads) {
-	char *eco_full = get_eco_full(main_game->moves_list);
+	char *eco_full = get_eco_full(get_san_moves(main_game));
 	if (eco_full) {
 		char eco[128];
 		char eco_description[128];
@@ -1034,12 +1091,11 @@ void update_eco_tag(bool should_lock_threads) {
 		strncpy(eco_description, eco_full + 4, 128);
 		snprintf(eco, 128, "<span weight=\"bold\">%s</span> %s", eco_code, eco_description);
 		if (should_lock_threads) {
-			gdk_threads_enter();
-		}
-		gtk_label_set_markup(GTK_LABEL(opening_code_label), eco);
-		gtk_widget_set_tooltip_text(opening_code_label, eco_description);
-		if (should_lock_threads) {
-			gdk_threads_leave();
+			ui_queue_label_text(opening_code_label, eco, TRUE);
+			ui_queue_call(set_opening_tooltip, strdup(eco_description), free);
+		} else {
+			gtk_label_set_markup(GTK_LABEL(opening_code_label), eco);
+			gtk_widget_set_tooltip_text(opening_code_label, eco_description);
 		}
 	}
 }
@@ -1101,20 +1157,41 @@ static gboolean on_motion(GtkWidget *pWidget, GdkEventMotion *event) {
 	// Grab the last event
 	if (is_moveit_flag()) {
 		set_last_move_xy((int) event->x, (int) event->y);
+		metrics_mark(METRIC_MARK_DRAG, g_get_monotonic_time());
 		set_more_events_flag(true);
+		queue_drag_frame();
 	}
 	return TRUE;
 }
 
+static gboolean on_sprites_ready(gpointer data);
+
 gboolean de_scale(gpointer data) {
 //	debug("De-scale\n");
+	de_scale_timer = 0;
+
+	// Keep showing the scaled cache layer until the sprites for the new size are rasterized
+	int wi = gtk_widget_get_allocated_width(GTK_WIDGET(data));
+	int hi = gtk_widget_get_allocated_height(GTK_WIDGET(data));
+	sprites_pending = !sprite_cache_prefetch(theme_dir, wi / 8, hi / 8, board_scale_factor(), on_sprites_ready);
+	if (sprites_pending) {
+		return FALSE;
+	}
+
 	needs_update = 1;
 	gtk_widget_queue_draw(GTK_WIDGET(data));
-	de_scale_timer = 0;
 	// Only fire once
 	return FALSE;
 }
 
+static gboolean on_sprites_ready(gpointer data) {
+	// A pending resize will de-scale by itself
+	if (sprites_pending && !de_scale_timer) {
+		de_scale(board);
+	}
+	return FALSE;
+}
+
 static gboolean on_get_move(GtkWidget *pWidget) {
 	debug("Got Move\n");
 	auto_play_one_ics_move(pWidget);
@@ -1152,6 +1229,12 @@ static int first_configure = 1;
 static int last_alloc_wi = 0;
 static int last_alloc_hi = 0;
 
+// Moved to a monitor with another device scale: layers and sprites must be recreated
+static void on_scale_factor_changed(GObject *object, GParamSpec *pspec, gpointer data) {
+	needs_update = 1;
+	gtk_widget_queue_draw(board);
+}
+
 static gboolean on_configure_event(GtkWidget *pWidget, GdkEventConfigure *event) {
 	if (pWidget == board) {
 		// This is a board resize event
@@ -1300,38 +1383,33 @@ static int init_pieces(chess_game *game) {
 	return 0;
 }
 
+/* Back to the initial position, without touching any widget */
+void reset_position(chess_game *game) {
+	game->current_move_number = 1;
+	reset_san_moves(game);
+	init_zobrist_hash_history(game);
+	init_pieces(game);
+}
+
 static void reset_game(bool lock_threads) {
-	main_game->current_move_number = 1;
-	memset(main_game->moves_list, 0, strlen(main_game->moves_list));
-	main_game->moves_list[0] = '\0';
-	main_game->ply_num = 1;
-	init_zobrist_hash_history(main_game);
-	init_pieces(main_game);
+	reset_position(main_game);
 	if (main_list != NULL) {
 		plys_list_free(main_list);
 	}
 	main_list = plys_list_new();
 
 	if (lock_threads) {
-		gdk_threads_enter();
-	}
-	gtk_label_set_markup(GTK_LABEL(opening_code_label), "");
-	gtk_widget_set_tooltip_text(opening_code_label, "");
-	if (lock_threads) {
-		gdk_threads_leave();
+		ui_queue_label_text(opening_code_label, "", TRUE);
+		ui_queue_call(set_opening_tooltip, "", NULL);
+	} else {
+		gtk_label_set_markup(GTK_LABEL(opening_code_label), "");
+		gtk_widget_set_tooltip_text(opening_code_label, "");
 	}
 }
 
-static pthread_t move_event_processor_thread;
-
-static void spawn_mover(void) {
-	pthread_create(&move_event_processor_thread, NULL, process_moves, NULL);
-}
-
 void send_to_ics(char *s) {
 	if (ics_mode) {
-		size_t len = strlen(s);
-		send_to_fics(s, &len);
+		send_to_fics(s, strlen(s));
 	}
 	else {
 		debug("Would send to ICS %s", s);
@@ -1436,6 +1514,7 @@ int open_file(const char *name) {
 }
 
 void load_game(const char* file_path, int game_num) {
+	TRACE_FUNCTION();
 
 	if (open_file(file_path)) {
 		return;
@@ -1807,9 +1886,13 @@ void set_header_label(const char *w_name, const char *b_name, const char *w_rati
 void start_game(char *w_name, char *b_name, int seconds, int increment, int relation, bool should_lock) {
 
 	clock_reset(main_clock, seconds, increment, relation, should_lock);
+	clock_sync_reset();
+	clock_stats_begin(w_name, b_name);
 
 	if (should_lock) {
 		gdk_threads_enter();
+		// apply what the previous game posted before resetting the views
+		ui_queue_flush();
 	}
 
 	game_started = true;
@@ -1867,6 +1950,7 @@ void end_game(void) {
 	clock_started = 0;
 	my_game = 0;
 	clock_freeze(main_clock);
+	clock_stats_end();
 }
 
 gint cleanup(gpointer ignored) {
@@ -1894,8 +1978,6 @@ gint cleanup(gpointer ignored) {
 
 	/* cancel threads and wait for all threads to exit */
 	debug("Cancelling all threads...\n");
-	pthread_cancel(move_event_processor_thread);
-	pthread_join(move_event_processor_thread, NULL);
 	if (ics_mode) {
 		cleanup_ics();
 	}
@@ -1903,6 +1985,8 @@ gint cleanup(gpointer ignored) {
 	cleanup_uci();
 	cleanup_mutexes();
 
+	trace_dump();
+
 	debug("All threads terminated\n");
 
 	debug("Finished cleanup\n");
@@ -1999,9 +2083,15 @@ void plys_list_free(plys_list *to_destroy) {
 
 /* Append text at the end of the moves_list buffer
  * NB: text must be NULL terminated*/
+static void insert_moves_list_text_call(gpointer text) {
+	insert_text_moves_list_view(text, false);
+}
+
 void insert_text_moves_list_view(const gchar *text, bool should_lock_threads) {
 	if (should_lock_threads) {
-		gdk_threads_enter();
+		// from a worker thread, let the main loop append a copy
+		ui_queue_call(insert_moves_list_text_call, strdup(text), free);
+		return;
 	}
 	if (!GTK_IS_TEXT_VIEW(moves_list_view)) {
 		// Killed? tough!
@@ -2020,10 +2110,6 @@ void insert_text_moves_list_view(const gchar *text, bool should_lock_threads) {
 
 	/* scroll to bottom */
 	gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(moves_list_view), end_mark, .0, FALSE, .0, .0);
-
-	if (should_lock_threads) {
-		gdk_threads_leave();
-	}
 }
 
 
@@ -2149,29 +2235,35 @@ void insert_san_move(const char* san_move, bool should_lock_threads) {
 }
 
 /* deletes the contents of the buffer associated with the moves list view */
-void reset_moves_list_view(gboolean should_lock_threads) {
-	if (should_lock_threads) {
-		gdk_threads_enter();
-	}
+static void reset_moves_list_call(gpointer ignored) {
 	gtk_text_buffer_set_text(moves_list_buffer, "", -1);
+}
+
+void reset_moves_list_view(gboolean should_lock_threads) {
 	if (should_lock_threads) {
-		gdk_threads_leave();
+		ui_queue_call(reset_moves_list_call, NULL, NULL);
+	} else {
+		reset_moves_list_call(NULL);
 	}
 }
 
 GHashTable *eco_full;
+static pthread_mutex_t eco_full_lock = PTHREAD_MUTEX_INITIALIZER;
 
 #define ECO_LINE_MAX 256
 
+/* Builds the ECO table off to the side and only publishes it once complete
+ * so that this can run on a worker thread while the UI starts */
 int compile_eco(void) {
 	char name[] = "full_eco.idx";
 	char san_key[ECO_LINE_MAX];
 	char full_description[ECO_LINE_MAX];
 
-	eco_full = g_hash_table_new(g_str_hash, g_str_equal);
+	GHashTable *table = g_hash_table_new(g_str_hash, g_str_equal);
 	FILE *f = fopen(name, "r");
 	if (f == NULL) {
 		fprintf(stderr, "Error opening file '%s': %s\n", name, strerror(errno));
+		g_hash_table_destroy(table);
 		return 1;
 	}
 	while (fgets(san_key, ECO_LINE_MAX, f) != NULL) {
@@ -2180,15 +2272,29 @@ int compile_eco(void) {
 		if (fgets(full_description, ECO_LINE_MAX, f)) {
 			full_description[strlen(full_description) - 1] = 0;
 //			printf("Full_description '%s'\n", full_description);
-			g_hash_table_insert(eco_full, strdup(san_key), strdup(full_description));
+			g_hash_table_insert(table, strdup(san_key), strdup(full_description));
 		}
 	}
+	fclose(f);
+
+	pthread_mutex_lock(&eco_full_lock);
+	eco_full = table;
+	pthread_mutex_unlock(&eco_full_lock);
 
 	return 0;
 }
 
 char *get_eco_full(const char *san_moves_list) {
-	return g_hash_table_lookup(eco_full, san_moves_list);
+	GHashTable *table;
+	pthread_mutex_lock(&eco_full_lock);
+	table = eco_full;
+	pthread_mutex_unlock(&eco_full_lock);
+
+	// ECO table is still being compiled
+	if (table == NULL) {
+		return NULL;
+	}
+	return g_hash_table_lookup(table, san_moves_list);
 }
 
 static void get_theme_colours(GtkWidget *widget) {
@@ -2215,19 +2321,122 @@ static void get_theme_colours(GtkWidget *widget) {
 	}
 }
 
-static gboolean spawn_uci_engine_idle(gpointer data) {
+/* Startup phase timings, printed with --startup-trace */
+void startup_trace(const char *phase, gint64 since) {
+	if (!startup_trace_flag) {
+		return;
+	}
+	gint64 now = g_get_monotonic_time();
+	fprintf(stdout, "[startup] %-20s %8.2f ms (at %8.2f ms)\n", phase, (now - since) / 1000.0, (now - startup_epoch) / 1000.0);
+}
+
+static pthread_t svg_loader_thread;
+static pthread_t eco_loader_thread;
+static pthread_t uci_spawner_thread;
+
+static int startup_pending = 2; // the pieces and, off ICS, the engine game, see startup_step_done
+
+/* Get the pieces SVG dimensions for rendering */
+static void measure_piecesSvg(void) {
+	RsvgDimensionData g_DimensionData;
+	rsvg_handle_get_dimensions (piecesSvg[B_QUEEN], &g_DimensionData);
+	svg_w = 1.0f / (8.0f * (double) g_DimensionData.width);
+	svg_h = 1.0f / (8.0f * (double) g_DimensionData.height);
+}
+
+/* The board takes input, and a loaded game starts playing, once the pieces are in
+ * and the engine game is set up, so that its reset can't drop moves already played */
+static void startup_step_done(void) {
+	if (--startup_pending) {
+		return;
+	}
+	gtk_widget_set_sensitive(board, TRUE);
+	if (load_file_specified) {
+		if (!open_file(file_to_load)) {
+			auto_play_timer = g_timeout_add(auto_play_delay, auto_play_one_move, board);
+		}
+	}
+	startup_trace("ready", startup_epoch);
+}
+
+// On the main loop once load_pieces_function is done
+static gboolean pieces_loaded(gpointer ignored) {
+	pthread_join(svg_loader_thread, NULL);
+	measure_piecesSvg();
+	pieces_ready = true;
+	needs_update = 1;
+	gtk_widget_queue_draw(board);
+
+	// ICS positions get drawn as soon as they come
+	if (ics_mode) {
+		init_ics();
+	}
+	startup_step_done();
+	return FALSE;
+}
+
+static void *load_pieces_function(void *ignored) {
+	gint64 start = g_get_monotonic_time();
+	load_piecesSvg();
+	startup_trace("load pieces SVG", start);
+	gdk_threads_add_idle(pieces_loaded, NULL);
+	return 0;
+}
+
+/* Set up the main board without any window and time the renderer on it */
+static int run_render_bench(const char *pgn_path) {
+	init_zobrist_keys();
+	init_anims_map();
+	load_piecesSvg();
+	measure_piecesSvg();
+
+	main_game = game_new();
+	reset_position(main_game);
+	init_main_board(NULL, main_game);
+
+	set_moveit_flag(false);
+	set_running_flag(true);
+	set_more_events_flag(false);
+
+	return render_bench(pgn_path);
+}
+
+// Positions shown before the table was in have no opening yet
+static gboolean eco_loaded(gpointer ignored) {
+	update_eco_tag(false);
+	return FALSE;
+}
+
+static void *compile_eco_function(void *ignored) {
+	gint64 start = g_get_monotonic_time();
+	compile_eco();
+	startup_trace("compile ECO", start);
+	gdk_threads_add_idle(eco_loaded, NULL);
+	return 0;
+}
+
+// On the main loop, where the board's moves are made, once the engine is up
+static gboolean engine_spawned(gpointer ignored) {
+	if (ics_mode) {
+		// ICS games set up their own engine game
+		return FALSE;
+	}
+	debug("Starting new UCI game...\n");
+//	start_new_uci_game(60, ENGINE_WHITE);
+//	start_new_uci_game(60, ENGINE_BLACK);
+	start_new_uci_game(60, ENGINE_ANALYSIS);
+	start_uci_analysis();
+	startup_step_done();
+	return FALSE;
+}
+
+static void *spawn_uci_engine_function(void *data) {
 	debug("Spawning UCI engine...\n");
-	bool brainfish = *(bool*)data;
+	bool brainfish = GPOINTER_TO_INT(data);
 	spawn_uci_engine(brainfish);
 	debug("Spawned UCI engine [OK]\n");
-	if (!ics_mode) {
-		debug("Starting new UCI game...\n");
-//		start_new_uci_game(60, ENGINE_WHITE);
-//		start_new_uci_game(60, ENGINE_BLACK);
-		start_new_uci_game(60, ENGINE_ANALYSIS);
-		start_uci_analysis();
-	}
-	return FALSE;
+	gdk_threads_add_idle(engine_spawned, NULL);
+	return 0;
 }
 
 int main (int argc, char **argv) {
@@ -2236,6 +2445,8 @@ int main (int argc, char **argv) {
 	static struct option long_options[] = {
 			{"debug",      no_argument,       &debug_flag,         TRUE},
 			{"d",          no_argument,       &debug_flag,         TRUE},
+			{"startup-trace", no_argument,    &startup_trace_flag, TRUE},
+			{"render-bench", no_argument,     &render_bench_flag,  TRUE},
 			{"first",      no_argument,       &test_first_player,  TRUE},
 			{"login1",     required_argument, 0,                   ICS_TEST_HANDLE1},
 			{"login2",     required_argument, 0,                   ICS_TEST_HANDLE2},
@@ -2253,9 +2464,16 @@ int main (int argc, char **argv) {
 			{"load",       required_argument, 0,                   LOAD_FILE_ARG},
 			{"gamenum",    required_argument, 0,                   LOAD_GAME_NUM_ARG},
 			{"delay",      required_argument, 0,                   AUTO_PLAY_DELAY_ARG},
+			{"trace",      required_argument, 0,                   TRACE_FILE_ARG},
+			{"log",        required_argument, 0,                   LOG_LEVELS_ARG},
+			{"logfile",    required_argument, 0,                   LOG_FILE_ARG},
+			{"clockcsv",   required_argument, 0,                   CLOCK_CSV_ARG},
 			{0,            0,                 0,                   0}
 	};
 
+	char *log_levels_spec = NULL;
+	char *log_file_path = NULL;
+
 	opterr = 1;
 	optind = 1;
 	for(;;) {
@@ -2314,6 +2532,18 @@ int main (int argc, char **argv) {
 			case AUTO_PLAY_DELAY_ARG:
 				auto_play_delay = atoi(optarg);
 				break;
+			case TRACE_FILE_ARG:
+				trace_init(optarg);
+				break;
+			case LOG_LEVELS_ARG:
+				log_levels_spec = optarg;
+				break;
+			case LOG_FILE_ARG:
+				log_file_path = optarg;
+				break;
+			case CLOCK_CSV_ARG:
+				clock_stats_set_csv(optarg);
+				break;
 
 			default:
 				break;
@@ -2321,6 +2551,15 @@ int main (int argc, char **argv) {
 		}
 	}
 
+	// -debug turns everything on, -log can then refine per subsystem
+	if (debug_flag) {
+		log_set_levels("debug");
+	}
+	if (log_levels_spec != NULL && log_set_levels(log_levels_spec)) {
+		return 1;
+	}
+	log_start(log_file_path);
+
 	// Compute highlight colours
 	highlight_selected_r = 1;
 	highlight_selected_g = (dg + lg) / 3.0;
@@ -2337,6 +2576,11 @@ int main (int argc, char **argv) {
 	highlight_pre_move_b = (db + lb) / 3.0;
 	highlight_pre_move_a = 0.6;
 
+	// Offscreen benchmark, replays --load or the default game without opening any window
+	if (render_bench_flag) {
+		return run_render_bench(load_file_specified ? file_to_load : RENDER_BENCH_PGN);
+	}
+
 	debug("Debug info enabled\n");
 	if (ics_mode) {
 		if (!ics_host_specified) {
@@ -2376,8 +2620,16 @@ int main (int argc, char **argv) {
 
 	}
 
+	startup_epoch = g_get_monotonic_time();
+	gint64 phase_start = startup_epoch;
+
 	init_config();
-	compile_eco();
+	startup_trace("init config", phase_start);
+
+	// Pieces and ECO codes load in the background while GTK initialises
+	pthread_create(&svg_loader_thread, NULL, load_pieces_function, NULL);
+	pthread_create(&eco_loader_thread, NULL, compile_eco_function, NULL);
+	pthread_detach(eco_loader_thread);
 
 	old_wi = old_hi = 0;
 	int win_def_wi;
@@ -2392,6 +2644,7 @@ int main (int argc, char **argv) {
 	signal(SIGABRT, sig_handler);
 	signal(SIGSEGV, sig_handler);
 	signal(SIGINT, sig_handler);
+	signal(SIGUSR1, sig_handler); // kill -USR1 toggles debug logging at runtime
 
 	/* initialise random numbers for Zobrist hashing */
 	init_zobrist_keys();
@@ -2404,10 +2657,11 @@ int main (int argc, char **argv) {
 	gdk_threads_init();
 	gdk_threads_enter();
 
+	phase_start = g_get_monotonic_time();
 	gtk_init(&argc, &argv);
+	startup_trace("gtk init", phase_start);
 
-	load_piecesSvg();
-
+	phase_start = g_get_monotonic_time();
 	main_game = game_new();
 
 	main_window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
@@ -2543,6 +2797,7 @@ int main (int argc, char **argv) {
 
 	/* create the board area */
 	board = gtk_drawing_area_new();
+	init_main_board(board, main_game);
 
 	gtk_window_set_default_size(GTK_WINDOW(main_window), win_def_wi, win_def_hi);
 	gtk_window_set_icon_from_file(GTK_WINDOW(main_window), "icon.png", NULL);
@@ -2606,10 +2861,25 @@ int main (int argc, char **argv) {
 	gtk_container_add(GTK_CONTAINER(collapsible_analysis), create_analysis_panel());
 	gtk_expander_set_expanded(GTK_EXPANDER(collapsible_analysis), true);
 
+	// Performance metrics are collapsed by default, they only refresh while shown
+	GtkWidget *collapsible_metrics = gtk_expander_new_with_mnemonic("Performance _Metrics");
+	gtk_container_add(GTK_CONTAINER(collapsible_metrics), create_metrics_panel());
+	gtk_expander_set_expanded(GTK_EXPANDER(collapsible_metrics), false);
+
+	// Observed games are collapsed by default too, tiles are not painted while hidden
+	GtkWidget *collapsible_observed = gtk_expander_new_with_mnemonic("_Observed Games");
+	gtk_container_add(GTK_CONTAINER(collapsible_observed), create_observation_grid());
+	gtk_expander_set_expanded(GTK_EXPANDER(collapsible_observed), false);
+
+	GtkWidget *panels_v_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+	gtk_box_pack_start(GTK_BOX(panels_v_box), collapsible_analysis, TRUE, TRUE, 0);
+	gtk_box_pack_start(GTK_BOX(panels_v_box), collapsible_observed, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(panels_v_box), collapsible_metrics, FALSE, FALSE, 0);
+
 	// Pack analysis pane and moves list into a wrapper
 	GtkWidget *analysis_wrapper = gtk_paned_new(GTK_ORIENTATION_VERTICAL);
 	gtk_paned_pack1(GTK_PANED(analysis_wrapper), moves_v_box, TRUE, FALSE);
-	gtk_paned_pack2(GTK_PANED(analysis_wrapper), collapsible_analysis, FALSE, FALSE);
+	gtk_paned_pack2(GTK_PANED(analysis_wrapper), panels_v_box, FALSE, FALSE);
 
 	// The right split pane
 	GtkWidget *right_split_pane = gtk_paned_new(GTK_ORIENTATION_VERTICAL);
@@ -2642,16 +2912,19 @@ int main (int argc, char **argv) {
 	g_signal_connect (G_OBJECT(board), "button-release-event", G_CALLBACK(on_button_release), NULL);
 	g_signal_connect (G_OBJECT(board), "motion_notify_event", G_CALLBACK(on_motion), NULL);
 	g_signal_connect (G_OBJECT(board), "configure_event", G_CALLBACK(on_configure_event), NULL);
+	g_signal_connect (G_OBJECT(board), "notify::scale-factor", G_CALLBACK(on_scale_factor_changed), NULL);
 	g_signal_connect (G_OBJECT(board), "got-move", G_CALLBACK(on_get_move), NULL);
 	g_signal_connect (G_OBJECT(board), "got-crafty-move", G_CALLBACK(on_get_crafty_move), NULL);
 	g_signal_connect (G_OBJECT(board), "got-uci-move", G_CALLBACK(on_get_uci_move), NULL);
 	g_signal_connect (G_OBJECT(board), "flip-board", G_CALLBACK(on_flip_board), NULL);
 
-	/* Get the pieces SVG dimensions for rendering */
-	RsvgDimensionData g_DimensionData;
-	rsvg_handle_get_dimensions (piecesSvg[B_QUEEN], &g_DimensionData);
-	svg_w = 1.0f / (8.0f * (double) g_DimensionData.width);
-	svg_h = 1.0f / (8.0f * (double) g_DimensionData.height);
+	startup_trace("build widgets", phase_start);
+
+	// no input until the pieces and the engine are ready, see startup_step_done
+	gtk_widget_set_sensitive(board, FALSE);
+	if (ics_mode) {
+		startup_pending--;
+	}
 
 	set_moveit_flag(false);
 	set_running_flag(true);
@@ -2660,24 +2933,17 @@ int main (int argc, char **argv) {
 	reset_game(false);
 
 	gtk_widget_show_all(main_window);
+	startup_trace("show window", startup_epoch);
+
+	init_uci_adapter();
 
 	// only show this when we have tabs to show
 	gtk_widget_hide(channels_notebook);
 
-	if (load_file_specified) {
-		if (!open_file(file_to_load)) {
-			auto_play_timer = g_timeout_add(auto_play_delay, auto_play_one_move, board);
-		}
-	}
-
-	if (ics_mode) {
-		init_ics();
-	}
-
+	// The engine handshake can take a while, don't hold the main loop for it
 	bool brainfish = false;
-	g_idle_add(spawn_uci_engine_idle, &brainfish);
-
-	spawn_mover();
+	pthread_create(&uci_spawner_thread, NULL, spawn_uci_engine_function, GINT_TO_POINTER(brainfish));
+	pthread_detach(uci_spawner_thread);
 
 	///////////////////////
 //	test_random_animation();
@@ -2720,6 +2986,7 @@ int main (int argc, char **argv) {
 
 	cleanup(NULL);
 
+	log_stop();
 
 	return 0;
 }
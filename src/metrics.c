@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <gtk/gtk.h>
+
+#include "metrics.h"
+
+#define METRICS_REFRESH_MS 1000
+
+enum {
+	ROW_REPAINT,
+	ROW_DRAG,
+	ROW_ICS,
+	ROW_LAG,
+	ROW_UCI,
+	ROW_CLOCK,
+	ROW_MEMORY,
+	ROWS
+};
+
+typedef struct {
+	gint64 sum;
+	gint64 count;
+	gint64 max;
+} metric_window;
+
+static metric_window samples[METRIC_SAMPLES];
+static gint64 counters[METRIC_COUNTERS];
+static gint64 gauges[METRIC_GAUGES];
+static gint64 marks[METRIC_MARKS];
+
+static GtkWidget *metrics_grid;
+static GtkWidget *value_labels[ROWS];
+static gint64 last_refresh;
+static guint refresh_timer = 0; // only while the panel is mapped
+
+void metrics_sample(metric_sample_id id, gint64 usec) {
+	metric_window *window = &samples[id];
+	__atomic_add_fetch(&window->sum, usec, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&window->count, 1, __ATOMIC_RELAXED);
+	gint64 max = __atomic_load_n(&window->max, __ATOMIC_RELAXED);
+	while (usec > max && !__atomic_compare_exchange_n(&window->max, &max, usec, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void metrics_count(metric_counter_id id) {
+	__atomic_add_fetch(&counters[id], 1, __ATOMIC_RELAXED);
+}
+
+/* Latest value of something measured rarely, shown until replaced */
+void metrics_gauge(metric_gauge_id id, gint64 value) {
+	__atomic_store_n(&gauges[id], value, __ATOMIC_RELAXED);
+}
+
+/* Remember when something happened, keeping the earliest pending time until it is consumed */
+void metrics_mark(metric_mark_id mark, gint64 when) {
+	gint64 expected = 0;
+	__atomic_compare_exchange_n(&marks[mark], &expected, when, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/* Record the time elapsed since the pending mark, if any */
+void metrics_mark_done(metric_mark_id mark, metric_sample_id id) {
+	gint64 when = __atomic_exchange_n(&marks[mark], 0, __ATOMIC_RELAXED);
+	if (when) {
+		metrics_sample(id, g_get_monotonic_time() - when);
+	}
+}
+
+static void take_window(metric_sample_id id, metric_window *out) {
+	out->sum = __atomic_exchange_n(&samples[id].sum, 0, __ATOMIC_RELAXED);
+	out->count = __atomic_exchange_n(&samples[id].count, 0, __ATOMIC_RELAXED);
+	out->max = __atomic_exchange_n(&samples[id].max, 0, __ATOMIC_RELAXED);
+}
+
+static void format_latency(char *buf, size_t len, metric_window *window) {
+	if (!window->count) {
+		snprintf(buf, len, "-");
+		return;
+	}
+	snprintf(buf, len, "%.1f ms avg, %.1f ms max", window->sum / 1000.0 / window->count, window->max / 1000.0);
+}
+
+static long read_rss_kb(void) {
+	long total, resident;
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (f == NULL) {
+		return -1;
+	}
+	if (fscanf(f, "%ld %ld", &total, &resident) != 2) {
+		resident = -1;
+	}
+	fclose(f);
+	return resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* Called from a gdk_threads timeout, with the GDK lock held */
+static gboolean refresh_metrics(gpointer ignored) {
+	int i;
+	gint64 now = g_get_monotonic_time();
+	double elapsed = (now - last_refresh) / 1000000.0;
+	last_refresh = now;
+
+	// Consume the counters so the panel shows the last interval only
+	metric_window windows[METRIC_SAMPLES];
+	for (i = 0; i < METRIC_SAMPLES; i++) {
+		take_window(i, &windows[i]);
+	}
+	gint64 info_lines = __atomic_exchange_n(&counters[METRIC_UCI_INFO], 0, __ATOMIC_RELAXED);
+	gint64 info_dropped = __atomic_exchange_n(&counters[METRIC_UCI_INFO_DROPPED], 0, __ATOMIC_RELAXED);
+
+	char text[128];
+	metric_window *frames = &windows[METRIC_FRAME_TIME];
+	if (frames->count) {
+		snprintf(text, sizeof(text), "%.0f fps, %.1f ms avg, %.1f ms max", frames->count / elapsed,
+		         frames->sum / 1000.0 / frames->count, frames->max / 1000.0);
+	} else {
+		snprintf(text, sizeof(text), "0 fps");
+	}
+	gtk_label_set_text(GTK_LABEL(value_labels[ROW_REPAINT]), text);
+
+	format_latency(text, sizeof(text), &windows[METRIC_DRAG_LATENCY]);
+	gtk_label_set_text(GTK_LABEL(value_labels[ROW_DRAG]), text);
+
+	format_latency(text, sizeof(text), &windows[METRIC_ICS_LATENCY]);
+	gtk_label_set_text(GTK_LABEL(value_labels[ROW_ICS]), text);
+
+	gint64 lag = __atomic_load_n(&gauges[METRIC_ICS_LAG], __ATOMIC_RELAXED);
+	if (lag) {
+		snprintf(text, sizeof(text), "%.0f ms round trip, +/- %.0f ms, clock %+.0f ms", lag / 1000.0,
+		         __atomic_load_n(&gauges[METRIC_ICS_LAG_VARIANCE], __ATOMIC_RELAXED) / 1000.0,
+		         __atomic_load_n(&gauges[METRIC_ICS_CLOCK_OFFSET], __ATOMIC_RELAXED) / 1000.0);
+	} else {
+		snprintf(text, sizeof(text), "-");
+	}
+	gtk_label_set_text(GTK_LABEL(value_labels[ROW_LAG]), text);
+
+	snprintf(text, sizeof(text), "%.0f lines/s, %.1f%% dropped", info_lines / elapsed,
+	         info_lines ? 100.0 * info_dropped / info_lines : 0.0);
+	gtk_label_set_text(GTK_LABEL(value_labels[ROW_UCI]), text);
+
+	format_latency(text, sizeof(text), &windows[METRIC_CLOCK_JITTER]);
+	gtk_label_set_text(GTK_LABEL(value_labels[ROW_CLOCK]), text);
+
+	long rss = read_rss_kb();
+	if (rss < 0) {
+		snprintf(text, sizeof(text), "-");
+	} else {
+		snprintf(text, sizeof(text), "%.1f MB RSS", rss / 1024.0);
+	}
+	gtk_label_set_text(GTK_LABEL(value_labels[ROW_MEMORY]), text);
+
+	return TRUE;
+}
+
+/* Start refreshing when the panel is shown, from a fresh interval */
+static void on_metrics_map(GtkWidget *widget, gpointer ignored) {
+	int i;
+	metric_window stale;
+	for (i = 0; i < METRIC_SAMPLES; i++) {
+		take_window(i, &stale);
+	}
+	for (i = 0; i < METRIC_COUNTERS; i++) {
+		__atomic_store_n(&counters[i], 0, __ATOMIC_RELAXED);
+	}
+	last_refresh = g_get_monotonic_time();
+	if (!refresh_timer) {
+		refresh_timer = gdk_threads_add_timeout(METRICS_REFRESH_MS, refresh_metrics, NULL);
+	}
+}
+
+static void on_metrics_unmap(GtkWidget *widget, gpointer ignored) {
+	if (refresh_timer) {
+		g_source_remove(refresh_timer);
+		refresh_timer = 0;
+	}
+}
+
+GtkWidget *create_metrics_panel(void) {
+	int i;
+	const char *names[ROWS] = {"Repaint", "Drag latency", "ICS latency", "ICS lag", "Engine info", "Clock jitter", "Memory"};
+
+	metrics_grid = gtk_grid_new();
+	gtk_style_context_add_class(gtk_widget_get_style_context(metrics_grid), "metrics-panel-contents");
+	gtk_grid_set_column_spacing(GTK_GRID(metrics_grid), 12);
+
+	for (i = 0; i < ROWS; i++) {
+		GtkWidget *name_label = gtk_label_new(names[i]);
+		gtk_label_set_xalign(GTK_LABEL(name_label), 0);
+		gtk_grid_attach(GTK_GRID(metrics_grid), name_label, 0, i, 1, 1);
+
+		value_labels[i] = gtk_label_new("-");
+		gtk_label_set_xalign(GTK_LABEL(value_labels[i]), 0);
+		gtk_widget_set_hexpand(value_labels[i], TRUE);
+		gtk_grid_attach(GTK_GRID(metrics_grid), value_labels[i], 1, i, 1, 1);
+	}
+
+	g_signal_connect(metrics_grid, "map", G_CALLBACK(on_metrics_map), NULL);
+	g_signal_connect(metrics_grid, "unmap", G_CALLBACK(on_metrics_unmap), NULL);
+
+	return metrics_grid;
+}
@@ -0,0 +1,44 @@
+#ifndef CAIRO_BOARD_METRICS_H
+#define CAIRO_BOARD_METRICS_H
+
+#include <gtk/gtk.h>
+
+/* Live performance counters, updated with atomics from the hot paths
+ * and summarised once a second in the metrics panel while it is shown */
+
+typedef enum {
+	METRIC_FRAME_TIME, // on_board_draw duration
+	METRIC_DRAG_LATENCY, // motion event to dragged piece painted
+	METRIC_ICS_LATENCY, // ICS data read to board painted
+	METRIC_CLOCK_JITTER, // lateness of clock ticks from when the display was due to change
+	METRIC_SAMPLES
+} metric_sample_id;
+
+typedef enum {
+	METRIC_UCI_INFO, // engine info lines received
+	METRIC_UCI_INFO_DROPPED, // engine info lines ignored while stopping
+	METRIC_COUNTERS
+} metric_counter_id;
+
+typedef enum {
+	METRIC_ICS_LAG, // smoothed round trip of our moves to ICS, see clock-sync.c
+	METRIC_ICS_LAG_VARIANCE,
+	METRIC_ICS_CLOCK_OFFSET, // smoothed local minus server time of the running side
+	METRIC_GAUGES
+} metric_gauge_id;
+
+typedef enum {
+	METRIC_MARK_DRAG,
+	METRIC_MARK_ICS,
+	METRIC_MARKS
+} metric_mark_id;
+
+void metrics_sample(metric_sample_id id, gint64 usec);
+void metrics_count(metric_counter_id id);
+void metrics_gauge(metric_gauge_id id, gint64 value);
+void metrics_mark(metric_mark_id mark, gint64 when);
+void metrics_mark_done(metric_mark_id mark, metric_sample_id id);
+
+GtkWidget *create_metrics_panel(void);
+
+#endif //CAIRO_BOARD_METRICS_H
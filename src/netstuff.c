@@ -8,31 +8,60 @@
 #include <sys/types.h>
 
 #include <sys/socket.h>
-#include <sys/select.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdbool.h>
 #include <netdb.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include "ics-adapter.h"
+#include "ics-ring.h"
+#include "clock-sync.h"
 
 #define BSIZE 1024
 
 static char *key = "Timestamp (FICS) v1.0 - programmed by Henrik Gram.";
 static char hello[100] = "TIMESTAMP|cairo-board programmed by Julbra from FICS|Running on Gentoo Linux|";
 
-// encode the passed string using fics timeseal's protocol
-static size_t codec(char *s, size_t l) {
+#define KEY_LEN 50
+#define TIMESEAL_ROOM 24 // the most codec adds to a line: stamp, padding and end of message
 
-	int n;
+// what a character becomes at each key position, (c|0x80) only depends on its low 7 bits
+static char sealed[KEY_LEN][128];
+static pthread_once_t sealed_once = PTHREAD_ONCE_INIT;
+
+static void init_sealed(void) {
+	int k, c;
+	for (k = 0; k < KEY_LEN; k++) {
+		for (c = 0; c < 128; c++) {
+			sealed[k][c] = ((c|0x80)^key[k]) - 32;
+		}
+	}
+}
+
+static long timeseal_stamp(void) {
 	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec%10000)*1000 + tv.tv_usec/1000;
+}
+
+/* encode the passed string in place using fics timeseal's protocol
+ * s needs TIMESEAL_ROOM bytes of room after its l characters */
+static size_t codec(char *s, size_t l, long stamp) {
+
+	size_t n;
+	int k;
+
+	pthread_once(&sealed_once, init_sealed);
 
 	// escape character which announces the start of the timestamp value
 	s[l++] = '\x18';
 
-	// get the current timestamp
-	gettimeofday(&tv, NULL);
-
 	// add the timestamp the the sent string
-	l += sprintf(&s[l], "%ld", (tv.tv_sec%10000)*1000 + tv.tv_usec/1000);
+	l += sprintf(&s[l], "%ld", stamp);
 
 	// escape character which announces the end of the timestamp value
 	s[l++]='\x19';
@@ -49,8 +78,11 @@ static size_t codec(char *s, size_t l) {
 		SC(n,n+11), SC(n+2,n+9), SC(n+4,n+7);
 	}
 
-	for(n = 0; n < l; n++) {
-		s[n] = ((s[n]|0x80)^key[n%50]) - 32;
+	for (n = 0, k = 0; n < l; n++) {
+		s[n] = sealed[k][s[n] & 0x7f];
+		if (++k == KEY_LEN) {
+			k = 0;
+		}
 	}
 
 	/* escape sequence announces the end of our message */
@@ -67,6 +99,148 @@ static void write_to_fd(int fd, char *buff, size_t n) {
 	}
 }
 
+/* Lines waiting to go to ICS. Each is stored as its length, its text,
+ * then room for codec to encode it where it lies */
+typedef struct {
+	char *bytes;
+	size_t used;
+	size_t size;
+	int lines;
+	bool commands; // anything but ping acks, the server pings back once it has handled them
+} send_queue;
+
+#define SEND_IOVECS 64 // lines per writev, a login's worth
+
+static send_queue queued; // any thread appends, under send_lock
+static send_queue sending; // swapped with queued by the reader thread, which alone touches it
+static pthread_mutex_t send_lock = PTHREAD_MUTEX_INITIALIZER;
+static int held_sends = 0; // see hold_fics_sends
+static int wake_pipe[2] = {-1, -1}; // gets the reader thread out of poll to flush
+static gint64 ping_probe_at = 0; // when commands left with no ping seen since, reader thread only
+
+static bool queue_line(send_queue *q, const char *line, size_t len) {
+	size_t need = q->used + sizeof(size_t) + len + TIMESEAL_ROOM;
+	if (need > q->size) {
+		size_t size = q->size ? q->size : BSIZE;
+		while (size < need) {
+			size *= 2;
+		}
+		char *grown = realloc(q->bytes, size);
+		if (grown == NULL) {
+			perror("Failed to grow the ICS send queue");
+			return false;
+		}
+		q->bytes = grown;
+		q->size = size;
+	}
+	memcpy(q->bytes + q->used, &len, sizeof(size_t));
+	memcpy(q->bytes + q->used + sizeof(size_t), line, len);
+	q->used = need;
+	q->lines++;
+	return true;
+}
+
+static void wake_reader(void) {
+	if (write(wake_pipe[1], "", 1) == -1 && errno != EAGAIN) {
+		perror(NULL);
+	}
+}
+
+/* Queue each line of buff without its newline, text after the last newline makes a line too
+ * Only the first line queued since the last flush needs to wake the reader thread */
+static void queue_lines(const char *buff, size_t len, bool wake) {
+	size_t start, end;
+
+	pthread_mutex_lock(&send_lock);
+	wake = wake && !queued.lines && !held_sends;
+	for (start = 0; start < len; start = end + 1) {
+		for (end = start; end < len && buff[end] != '\n'; end++);
+		if (!queue_line(&queued, buff + start, end - start)) {
+			break;
+		}
+		queued.commands = true;
+	}
+	pthread_mutex_unlock(&send_lock);
+
+	if (wake) {
+		wake_reader();
+	}
+}
+
+static void writev_all(int fd, struct iovec *iov, int count) {
+	while (count) {
+		ssize_t n = writev(fd, iov, count);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror(NULL);
+			return;
+		}
+		for (; count && (size_t) n >= iov->iov_len; iov++, count--) {
+			n -= iov->iov_len;
+		}
+		if (count) {
+			iov->iov_base = (char *) iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+}
+
+/* Encode everything queued where it lies and send it with one writev
+ * Called by the reader thread once per turn of its loop */
+static void flush_to_fics(int ics_fd) {
+	struct iovec iov[SEND_IOVECS];
+	size_t pos = 0;
+
+	pthread_mutex_lock(&send_lock);
+	if (!queued.lines || held_sends) {
+		pthread_mutex_unlock(&send_lock);
+		return;
+	}
+	send_queue swap = sending;
+	sending = queued;
+	queued = swap;
+	queued.used = 0;
+	queued.lines = 0;
+	queued.commands = false;
+	pthread_mutex_unlock(&send_lock);
+
+	// one stamp for the whole batch, it all leaves now
+	long stamp = timeseal_stamp();
+	while (pos < sending.used) {
+		int count = 0;
+		for (; count < SEND_IOVECS && pos < sending.used; count++) {
+			size_t len;
+			memcpy(&len, sending.bytes + pos, sizeof(size_t));
+			iov[count].iov_base = sending.bytes + pos + sizeof(size_t);
+			iov[count].iov_len = codec(iov[count].iov_base, len, stamp);
+			pos += sizeof(size_t) + len + TIMESEAL_ROOM;
+		}
+		writev_all(ics_fd, iov, count);
+	}
+	if (sending.commands && !ping_probe_at) {
+		ping_probe_at = g_get_monotonic_time();
+	}
+}
+
+/* Lines sent between this and release_fics_sends leave together, in one write */
+void hold_fics_sends(void) {
+	pthread_mutex_lock(&send_lock);
+	held_sends++;
+	pthread_mutex_unlock(&send_lock);
+}
+
+void release_fics_sends(void) {
+	pthread_mutex_lock(&send_lock);
+	bool wake = !--held_sends && queued.lines;
+	pthread_mutex_unlock(&send_lock);
+
+	if (wake) {
+		wake_reader();
+	}
+}
+
 int open_tcp(char *hostname, unsigned short uport) {
 
 	int socket_fd;
@@ -94,7 +268,14 @@ int open_tcp(char *hostname, unsigned short uport) {
 		return -1;
 	}
 
-	i = codec(hello, strlen(hello));
+	if (pipe(wake_pipe)) {
+		perror("Pipe creation failed");
+		return -1;
+	}
+	fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+
+	i = codec(hello, strlen(hello), timeseal_stamp());
 	write_to_fd(socket_fd, hello, i);
 
 	return socket_fd;
@@ -104,105 +285,92 @@ void close_tcp(int fd) {
 	close(fd);
 }
 
-void send_to_fics(char *buff, size_t *rd) {
-
-	// static storage duration, no linkage
-	static int i = 0;
-
-	for (; i < *rd; i++) {
-
-		// search for '\n' character
-		if (buff[i] == '\n') {
-			char ffub[BSIZE+20];
-			size_t k;
-
-			// copy passed buffer till '\n'
-			memcpy(ffub, buff, (size_t) i);
-
-			// encode string
-			k = codec(ffub, i);
+/* Queue the lines of buff to be encoded and sent by the reader thread, from any thread */
+void send_to_fics(const char *buff, size_t len) {
+	queue_lines(buff, len, true);
+}
 
-			/* send encoded data to socket */
-			write_to_fd(ics_fd, ffub, k);
-
-			/* fold back end of buffer to the beginning */
-			for(i++, k = 0; i < *rd; i++, k++) {
-				buff[k] = buff[i];
-			}
-			*rd = k;
-			i = -1;
-		}
+// timeseal asks for an ack with this at the start of a line
+#define TIMESEAL_PING "[G]\n\r"
+#define TIMESEAL_PING_LEN 5
 
+/* Only ever from the reader thread, goes out with this turn's flush
+ * A ping answering commands we sent times their round trip for the clocks */
+static void ack_ping(void) {
+	if (ping_probe_at) {
+		clock_sync_rtt_sample(g_get_monotonic_time() - ping_probe_at);
+		ping_probe_at = 0;
 	}
+	pthread_mutex_lock(&send_lock);
+	queue_line(&queued, "\x2""9", 2);
+	pthread_mutex_unlock(&send_lock);
 }
 
-/* decode encrypted buff and write it to output_fd */
-static void get_from_fics(int ics_fd, int output_fd, char *buff, size_t *rd) {
+/* Answer timeseal's pings in the len bytes just read at the head of the ring
+ * and take them out in place. Returns how many bytes are ready for the parser,
+ * what could be the start of a ping cut by the read is held back after them */
+static size_t strip_pings(ics_ring *ring, size_t len, size_t *held) {
 
-	size_t n, m;
+	// like the stream, a ping starts after a '\r'
+	static bool line_start = true;
 
-	while(*rd > 0) {
+	size_t head = ring->head;
+	size_t r, w, k;
 
-		// write ack to fics
-		if (!strncmp(buff, "[G]\n\r", *rd < 5 ? *rd : 5)) {
-			if(*rd < 5) {
-				break;
+	for (r = w = 0; r < len;) {
+		if (line_start && *ics_ring_at(ring, head + r) == '[') {
+			for (k = 0; k < TIMESEAL_PING_LEN && r + k < len && *ics_ring_at(ring, head + r + k) == TIMESEAL_PING[k]; k++);
+			if (k == TIMESEAL_PING_LEN) {
+				ack_ping();
+				r += k;
+				continue;
 			}
-			else {
-				char reply[20] = "\x2""9";
-				n = codec(reply, 2);
-				write_to_fd(ics_fd, reply, n);
-				for(n = 5; n < *rd; n++) {
-					buff[n-5] = buff[n];
+			if (r + k == len) {
+				*held = len - r;
+				for (k = 0; k < *held; k++) {
+					*ics_ring_at(ring, head + w + k) = *ics_ring_at(ring, head + r + k);
 				}
-				*rd -= 5;
-				continue;
+				return w;
 			}
 		}
-
-		// find '\r' in buff
-		for (n = 0; n < *rd && buff[n] != '\r'; n++);
-
-		// n < *rd means we found \r
-		if (n < *rd) {
-			n++;
-		}
-
-		// write the decoded data to output_fd
-		write_to_fd(output_fd, buff, n);
-
-		for (m = n; m < *rd; m++) {
-			buff[m - n] = buff[m];
-		}
-		*rd -= n;
+		char c = *ics_ring_at(ring, head + r++);
+		*ics_ring_at(ring, head + w++) = c;
+		line_start = c == '\r';
 	}
+
+	*held = 0;
+	return w;
 }
 
-// Please optimise this
-int read_write_ics_fd(int input_fd, int output_fd, int ics_fd) {
+/* Wait for input from the user or from ICS and pass it on
+ * Blocks in poll until either fd is readable or lines were queued for ICS,
+ * reads from ICS go straight into the ring for the parser and
+ * whatever was queued is written in one go at the end of each turn */
+int read_write_ics_fd(int input_fd, ics_ring *ring, int ics_fd) {
 
 	int i;
 
-	/* read and write file descriptor sets */
-	fd_set r_fds;
-	fd_set w_fds;
+	// stays closed once the user's input hit end of file, we keep serving ICS
+	static bool input_closed = false;
 
-	/* reset our file descriptor sets */
-	FD_ZERO(&r_fds);
-	FD_ZERO(&w_fds);
+	struct pollfd fds[3];
+	fds[0].fd = ics_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = input_closed ? -1 : input_fd;
+	fds[1].events = POLLIN;
+	fds[2].fd = wake_pipe[0];
+	fds[2].events = POLLIN;
 
-	/* add input_fd to the read fds */
-	FD_SET(input_fd, &r_fds);
-
-	/* add ics_fd to both read and write fds */
-	FD_SET(ics_fd, &r_fds);
-	FD_SET(ics_fd, &w_fds);
-
-	/* check I/O status of our fds */
-	select(ics_fd+1, &r_fds, &w_fds, NULL, NULL);
+	if (poll(fds, 3, -1) < 0) {
+		if (errno == EINTR) {
+			return 0;
+		}
+		perror(NULL);
+		return -1;
+	}
 
-	// we can read from stdin and write to ics
-	if (FD_ISSET(input_fd, &r_fds) && FD_ISSET(ics_fd, &w_fds)) {
+	// we can read from input_fd
+	if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
 		static size_t w_rd = 0;
 		static char buff[BSIZE];
 
@@ -210,28 +378,39 @@ int read_write_ics_fd(int input_fd, int output_fd, int ics_fd) {
 		w_rd += i = read(input_fd, buff + w_rd, BSIZE - w_rd);
 
 		if (!i) {
-			fprintf(stderr, "Read 0 bytes?!\n");
-			return 1;
+			fprintf(stderr, "End of input, only reading from ICS now\n");
+			input_closed = true;
 		}
 		if (i < 0) {
 			perror(NULL);
 			return -1;
 		}
 
-		send_to_fics(buff, &w_rd);
+		// whole lines go, the rest waits for its newline
+		size_t n = w_rd;
+		while (n && buff[n-1] != '\n') {
+			n--;
+		}
+		if (n) {
+			queue_lines(buff, n, false);
+			memmove(buff, buff + n, w_rd - n);
+			w_rd -= n;
+		}
 		if (w_rd == BSIZE) {
 			fprintf(stderr, "Line too long?!\n");
 			return -1;
 		}
 	}
 
-	// we can read from and write to ics
-	if (FD_ISSET(ics_fd, &r_fds) && FD_ISSET(ics_fd, &w_fds)) {
-		static int r_rd = 0;
-		static char buff[BSIZE];
+	// we can read from ics, or it hung up and read returns 0
+	if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+		// bytes of a possible ping kept past the head, see strip_pings
+		static size_t held = 0;
+		size_t space;
+		char *buff = ics_ring_reserve(ring, held, &space);
 
 		/* read from ics */
-		r_rd += i = read(ics_fd, buff, BSIZE - r_rd);
+		i = read(ics_fd, buff, space);
 		if (!i) {
 			fprintf(stderr, "Connection closed\n");
 			return 1;
@@ -241,14 +420,18 @@ int read_write_ics_fd(int input_fd, int output_fd, int ics_fd) {
 			return -1;
 		}
 
-		// decode and write to output
-		get_from_fics(ics_fd, output_fd, buff, &r_rd);
-		if (r_rd == BSIZE) {
-			fprintf(stderr, "Receive buffer full?!\n");
-			return -1;
-		}
+		// the parser sees everything up to the held bytes
+		ics_ring_commit(ring, strip_pings(ring, held + i, &held));
+	}
+
+	// woken up to flush
+	if (fds[2].revents & POLLIN) {
+		char drain[64];
+		while (read(wake_pipe[0], drain, sizeof(drain)) > 0);
 	}
 
+	flush_to_fics(ics_fd);
+
 	return 0;
 
 }
@@ -274,7 +457,14 @@ int main_n(int argc, char **argv) {
 		return 1;
 	}
 
-	while(!read_write_ics_fd(STDIN_FILENO, STDOUT_FILENO, ics_fd));
+	static ics_ring ring;
+	ics_ring_init(&ring);
+	while(!read_write_ics_fd(STDIN_FILENO, &ring, ics_fd)) {
+		size_t len;
+		char *data = ics_ring_peek(&ring, &len);
+		write_to_fd(STDOUT_FILENO, data, len);
+		ics_ring_consume(&ring, len);
+	}
 
 	return 0;
 }
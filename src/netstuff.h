@@ -2,10 +2,14 @@
 #ifndef __NET_STUFF_H
 #define __NET_STUFF_H
 
+#include "ics-ring.h"
+
 int open_tcp(char *hostname, unsigned short uport);
 void close_tcp(int fd);
-int read_write_ics_fd(int input_fd, int output_fd, int ics_fd);
-void send_to_fics(char *buff, int *rd);
+int read_write_ics_fd(int input_fd, ics_ring *ring, int ics_fd);
+void send_to_fics(const char *buff, size_t len);
+void hold_fics_sends(void);
+void release_fics_sends(void);
 
 #endif
 
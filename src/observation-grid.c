@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <gtk/gtk.h>
+
+#include "observation-grid.h"
+#include "board-context.h"
+#include "chess-backend.h"
+#include "ui-queue.h"
+#include "trace.h"
+
+#define TILE_SIZE 160
+#define CLOCKS_REFRESH_MS 1000
+
+typedef struct {
+	int game_num;
+	GtkWidget *box; // flow box child holding the board and the clocks
+	GtkWidget *area;
+	GtkWidget *label;
+	board_context *ctx;
+	chess_game *game;
+
+	char white_name[121];
+	char black_name[121];
+	int white_time; // seconds, as of updated_at
+	int black_time;
+	bool black_to_play;
+	bool ticking;
+	gint64 updated_at;
+	char *clocks_markup; // last text set on the label
+
+	bool dirty; // position changed since the pieces layer was drawn
+	int drawn_width; // size the layers were drawn at, 0 if never
+	int drawn_height;
+	bool drawn_flipped;
+	gint64 last_paint;
+	guint repaint_source; // deferred repaint, 0 if none
+} observation_tile;
+
+static GHashTable *tiles; // game number -> tile
+static GtkWidget *flow_box;
+static GtkWidget *scroller;
+static guint clocks_timer = 0; // only while there are tiles on show
+
+static void free_tile(gpointer data) {
+	observation_tile *tile = data;
+	if (tile->repaint_source) {
+		g_source_remove(tile->repaint_source);
+	}
+	// the flow box wrapped the tile in a child of its own
+	gtk_widget_destroy(gtk_widget_get_parent(tile->box));
+	board_context_free(tile->ctx);
+	game_free(tile->game);
+	g_free(tile->clocks_markup);
+	free(tile);
+}
+
+/* Whether any part of the tile is scrolled into view */
+static bool tile_on_screen(observation_tile *tile) {
+	if (!gtk_widget_get_mapped(tile->area)) {
+		return false;
+	}
+	int x, y;
+	if (!gtk_widget_translate_coordinates(tile->area, scroller, 0, 0, &x, &y)) {
+		return false;
+	}
+	GtkAllocation view;
+	gtk_widget_get_allocation(scroller, &view);
+	return x + gtk_widget_get_allocated_width(tile->area) > 0 && y + gtk_widget_get_allocated_height(tile->area) > 0 &&
+	       x < view.width && y < view.height;
+}
+
+static void format_clock(char *buf, size_t len, int seconds) {
+	if (seconds < 0) {
+		seconds = 0;
+	}
+	if (seconds >= 3600) {
+		snprintf(buf, len, "%d:%02d:%02d", seconds / 3600, (seconds / 60) % 60, seconds % 60);
+	} else {
+		snprintf(buf, len, "%d:%02d", seconds / 60, seconds % 60);
+	}
+}
+
+static void refresh_tile_clocks(observation_tile *tile, gint64 now) {
+	int white_time = tile->white_time;
+	int black_time = tile->black_time;
+	if (tile->ticking) {
+		int elapsed = (int) ((now - tile->updated_at) / G_USEC_PER_SEC);
+		if (tile->black_to_play) {
+			black_time -= elapsed;
+		} else {
+			white_time -= elapsed;
+		}
+	}
+
+	char white_clock[16], black_clock[16];
+	format_clock(white_clock, sizeof(white_clock), white_time);
+	format_clock(black_clock, sizeof(black_clock), black_time);
+	char *markup = g_markup_printf_escaped(tile->black_to_play ? "%s %s  <b>%s %s</b>" : "<b>%s %s</b>  %s %s",
+	                                       tile->white_name, white_clock, tile->black_name, black_clock);
+
+	// setting the same text again would still relayout the label
+	if (tile->clocks_markup != NULL && !strcmp(markup, tile->clocks_markup)) {
+		g_free(markup);
+		return;
+	}
+	gtk_label_set_markup(GTK_LABEL(tile->label), markup);
+	g_free(tile->clocks_markup);
+	tile->clocks_markup = markup;
+}
+
+/* One timer for all the tiles, clocks are counted down from the last server times */
+static gboolean refresh_clocks(gpointer ignored) {
+	gint64 now = g_get_monotonic_time();
+	GHashTableIter iter;
+	gpointer value;
+	g_hash_table_iter_init(&iter, tiles);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		observation_tile *tile = value;
+		if (tile_on_screen(tile)) {
+			refresh_tile_clocks(tile, now);
+		}
+	}
+	return TRUE;
+}
+
+/* Arm the clocks timer while the grid is shown with tiles in it, remove it otherwise */
+static void update_clocks_timer(void) {
+	bool wanted = g_hash_table_size(tiles) && gtk_widget_get_mapped(scroller);
+	if (wanted && !clocks_timer) {
+		clocks_timer = gdk_threads_add_timeout(CLOCKS_REFRESH_MS, refresh_clocks, NULL);
+	} else if (!wanted && clocks_timer) {
+		g_source_remove(clocks_timer);
+		clocks_timer = 0;
+	}
+}
+
+static void on_grid_map_changed(GtkWidget *widget, gpointer ignored) {
+	if (gtk_widget_get_mapped(widget)) {
+		// the clocks stood still while hidden
+		refresh_clocks(NULL);
+	}
+	update_clocks_timer();
+}
+
+static gboolean on_tile_draw(GtkWidget *widget, cairo_t *cdr, gpointer data) {
+	TRACE_FUNCTION();
+	observation_tile *tile = data;
+	board_context *ctx = tile->ctx;
+	int wi = gtk_widget_get_allocated_width(widget);
+	int hi = gtk_widget_get_allocated_height(widget);
+
+	bool resized = wi != tile->drawn_width || hi != tile->drawn_height;
+	if (resized) {
+		board_context_set_sprites(ctx, wi, hi);
+	}
+	if (resized || ctx->flipped != tile->drawn_flipped) {
+		board_context_draw_board(ctx, wi, hi);
+		tile->dirty = true;
+	}
+	if (tile->dirty || ctx->cache_layer == NULL) {
+		board_context_draw_pieces(ctx, wi, hi);
+		if (resized || ctx->cache_layer == NULL) {
+			cairo_surface_destroy(ctx->cache_layer);
+			ctx->cache_layer = board_context_create_layer(ctx, CAIRO_CONTENT_COLOR, wi, hi);
+		}
+		cairo_t *cache_dc = cairo_create(ctx->cache_layer);
+		board_context_paint_layers(ctx, cache_dc, wi, hi);
+		cairo_destroy(cache_dc);
+		tile->dirty = false;
+		tile->drawn_width = wi;
+		tile->drawn_height = hi;
+		tile->drawn_flipped = ctx->flipped;
+	}
+
+	cairo_set_source_surface(cdr, ctx->cache_layer, 0, 0);
+	cairo_paint(cdr);
+	tile->last_paint = g_get_monotonic_time();
+	return TRUE;
+}
+
+static gboolean deferred_repaint(gpointer data) {
+	observation_tile *tile = data;
+	tile->repaint_source = 0;
+	if (tile_on_screen(tile)) {
+		gtk_widget_queue_draw(tile->area);
+	}
+	return FALSE;
+}
+
+/* Repaint a changed tile, at most once per OBSERVATION_TILE_INTERVAL_MS
+ * Off screen tiles are only marked dirty and redrawn once exposed */
+static void queue_tile_repaint(observation_tile *tile) {
+	tile->dirty = true;
+	if (tile->repaint_source || !tile_on_screen(tile)) {
+		return;
+	}
+	gint64 wait = tile->last_paint + OBSERVATION_TILE_INTERVAL_MS * 1000 - g_get_monotonic_time();
+	if (wait <= 0) {
+		gtk_widget_queue_draw(tile->area);
+	} else {
+		tile->repaint_source = gdk_threads_add_timeout((guint) (wait / 1000) + 1, deferred_repaint, tile);
+	}
+}
+
+static observation_tile *new_tile(int game_num) {
+	observation_tile *tile = calloc(1, sizeof(observation_tile));
+	if (tile == NULL) {
+		perror("Failed to allocate observation tile");
+		return NULL;
+	}
+	tile->game = game_new();
+	if (tile->game == NULL) {
+		free(tile);
+		return NULL;
+	}
+	tile->game_num = game_num;
+
+	tile->area = gtk_drawing_area_new();
+	gtk_widget_set_size_request(tile->area, TILE_SIZE, TILE_SIZE);
+	gtk_widget_set_halign(tile->area, GTK_ALIGN_CENTER);
+	tile->ctx = board_context_new(tile->area, tile->game);
+	if (tile->ctx == NULL) {
+		gtk_widget_destroy(tile->area);
+		game_free(tile->game);
+		free(tile);
+		return NULL;
+	}
+	g_signal_connect(tile->area, "draw", G_CALLBACK(on_tile_draw), tile);
+
+	tile->label = gtk_label_new(NULL);
+	gtk_label_set_ellipsize(GTK_LABEL(tile->label), PANGO_ELLIPSIZE_MIDDLE);
+	gtk_label_set_max_width_chars(GTK_LABEL(tile->label), 24);
+
+	tile->box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
+	gtk_box_pack_start(GTK_BOX(tile->box), tile->area, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(tile->box), tile->label, FALSE, FALSE, 0);
+	gtk_container_add(GTK_CONTAINER(flow_box), tile->box);
+	gtk_widget_show_all(tile->box);
+
+	g_hash_table_insert(tiles, GINT_TO_POINTER(game_num), tile);
+	update_clocks_timer();
+	return tile;
+}
+
+/* Set up the tile's pieces from the style 12 board, filling each side's set in board order */
+static void load_board(chess_game *game, const char *board_chars) {
+	int i, j;
+	int white_count = 0, black_count = 0;
+
+	memset(game->white_set, 0, sizeof(game->white_set));
+	memset(game->black_set, 0, sizeof(game->black_set));
+	for (i = 0; i < 16; i++) {
+		game->white_set[i].dead = true;
+		game->black_set[i].dead = true;
+		game->black_set[i].colour = BLACK;
+	}
+
+	for (j = 7; j >= 0; j--) {
+		for (i = 0; i < 8; i++) {
+			char c = board_chars[(7 - j) * 9 + i];
+			if (c == '-') {
+				continue;
+			}
+			bool black = islower(c);
+			int type = char_to_type(black, toupper(c));
+			chess_piece *piece;
+			if (type < 0) {
+				continue;
+			} else if (black && black_count < 16) {
+				piece = &game->black_set[black_count++];
+			} else if (!black && white_count < 16) {
+				piece = &game->white_set[white_count++];
+			} else {
+				continue;
+			}
+			piece->type = type;
+			piece->dead = false;
+			piece->pos.column = i;
+			piece->pos.row = j;
+		}
+	}
+}
+
+static bool parse_square(const char *s, int *col, int *row) {
+	if (s[0] < 'a' || s[0] > 'h' || s[1] < '1' || s[1] > '8') {
+		return false;
+	}
+	*col = s[0] - 'a';
+	*row = s[1] - '1';
+	return true;
+}
+
+/* Highlight the previous move from its verbose notation: "P/e2-e4", "o-o", "o-o-o" or "none" */
+static void highlight_last_move(board_context *ctx, const char *move, bool black_to_play) {
+	int from_col, from_row, to_col, to_row;
+
+	board_context_clear_highlights(ctx);
+	if (!strncmp(move, "o-o", 3)) {
+		// the side that moved is not the one to play
+		from_row = to_row = black_to_play ? 0 : 7;
+		from_col = 4;
+		to_col = strncmp(move, "o-o-o", 5) ? 6 : 2;
+	} else if (strlen(move) < 7 || move[1] != '/' || move[4] != '-' ||
+	           !parse_square(move + 2, &from_col, &from_row) || !parse_square(move + 5, &to_col, &to_row)) {
+		return;
+	}
+	board_context_add_highlight(ctx, from_col, from_row, false, highlight_move_r, highlight_move_g, highlight_move_b, highlight_move_a);
+	board_context_add_highlight(ctx, to_col, to_row, false, highlight_move_r, highlight_move_g, highlight_move_b, highlight_move_a);
+}
+
+static void update_tile(gpointer data) {
+	observed_position *position = data;
+	observation_tile *tile = g_hash_table_lookup(tiles, GINT_TO_POINTER(position->game_num));
+	if (tile == NULL) {
+		tile = new_tile(position->game_num);
+		if (tile == NULL) {
+			return;
+		}
+	}
+
+	load_board(tile->game, position->board_chars);
+	tile->ctx->flipped = position->flipped;
+	highlight_last_move(tile->ctx, position->move, position->black_to_play);
+
+	memcpy(tile->white_name, position->white_name, sizeof(tile->white_name));
+	memcpy(tile->black_name, position->black_name, sizeof(tile->black_name));
+	tile->white_time = position->white_time;
+	tile->black_time = position->black_time;
+	tile->black_to_play = position->black_to_play;
+	tile->ticking = position->ticking;
+	tile->updated_at = g_get_monotonic_time();
+
+	if (tile->clocks_markup == NULL || tile_on_screen(tile)) {
+		refresh_tile_clocks(tile, tile->updated_at);
+	}
+	queue_tile_repaint(tile);
+}
+
+static void remove_tile(gpointer data) {
+	g_hash_table_remove(tiles, data);
+	update_clocks_timer();
+}
+
+/* Called from the ICS parser thread, several positions posted before the
+ * main loop drains its queue cost a single repaint */
+void observation_grid_post_position(const observed_position *position) {
+	observed_position *copy = malloc(sizeof(observed_position));
+	if (copy == NULL) {
+		perror("Failed to allocate observed position");
+		return;
+	}
+	memcpy(copy, position, sizeof(observed_position));
+	ui_queue_call(update_tile, copy, free);
+}
+
+void observation_grid_post_end(int game_num) {
+	ui_queue_call(remove_tile, GINT_TO_POINTER(game_num), NULL);
+}
+
+GtkWidget *create_observation_grid(void) {
+	tiles = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_tile);
+
+	flow_box = gtk_flow_box_new();
+	gtk_flow_box_set_selection_mode(GTK_FLOW_BOX(flow_box), GTK_SELECTION_NONE);
+	gtk_flow_box_set_homogeneous(GTK_FLOW_BOX(flow_box), TRUE);
+	gtk_widget_set_valign(flow_box, GTK_ALIGN_START);
+
+	scroller = gtk_scrolled_window_new(NULL, NULL);
+	gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroller), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+	gtk_scrolled_window_set_min_content_height(GTK_SCROLLED_WINDOW(scroller), TILE_SIZE + 32);
+	gtk_container_add(GTK_CONTAINER(scroller), flow_box);
+
+	g_signal_connect(scroller, "map", G_CALLBACK(on_grid_map_changed), NULL);
+	g_signal_connect(scroller, "unmap", G_CALLBACK(on_grid_map_changed), NULL);
+
+	return scroller;
+}
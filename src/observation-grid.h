@@ -0,0 +1,34 @@
+#ifndef CAIRO_BOARD_OBSERVATION_GRID_H
+#define CAIRO_BOARD_OBSERVATION_GRID_H
+
+#include <stdbool.h>
+#include <gtk/gtk.h>
+
+#include "cairo-board.h"
+
+/* Grid of small live boards, one per game observed on ICS
+ * The ICS parser posts positions from its thread, tiles are updated on the main loop
+ * and repainted at most once per OBSERVATION_TILE_INTERVAL_MS, only while on screen.
+ * All tiles share one clock timer and, when of the same size, one sprite set */
+
+#define OBSERVATION_TILE_INTERVAL_MS 250
+
+typedef struct {
+	int game_num;
+	char board_chars[72]; // style 12 ranks, 8th rank first
+	bool black_to_play;
+	bool flipped;
+	bool ticking; // the side to move's clock is running
+	int white_time; // seconds
+	int black_time;
+	char white_name[121];
+	char black_name[121];
+	char move[MOVE_BUFF_SIZE]; // verbose notation of the previous move, "none" if none
+} observed_position;
+
+GtkWidget *create_observation_grid(void);
+
+void observation_grid_post_position(const observed_position *position);
+void observation_grid_post_end(int game_num);
+
+#endif //CAIRO_BOARD_OBSERVATION_GRID_H
@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <gtk/gtk.h>
+
+#include "render-bench.h"
+#include "cairo-board.h"
+#include "chess-backend.h"
+#include "drawing-backend.h"
+#include "san_scanner.h"
+
+#define BENCH_REBUILDS 10
+#define BENCH_FULL_UPDATES 50
+#define BENCH_REPAINTS 200
+#define BENCH_SCALES 50
+#define BENCH_DRAGS 20
+#define BENCH_DRAG_STEPS 30
+#define BENCH_FRAME_USEC 16667 // animations stepped as by a 60 Hz frame clock
+
+static const int bench_sizes[] = {256, 512, 800, 1200};
+
+enum {
+	OP_FULL_REBUILD, // draw_full_update after a resize, layers rebuilt
+	OP_FULL_UPDATE, // draw_full_update with the layers up to date
+	OP_CHEAP_REPAINT, // draw_cheap_repaint of two damaged squares
+	OP_SCALED, // draw_scaled while a resize is pending
+	OP_DRAG_FRAME, // one frame of a dragged piece
+	OP_ANIM_FRAME, // one frame of a move animation
+	OPS
+};
+
+static const char *op_names[OPS] = {"full update (rebuild)", "full update", "cheap repaint", "scaled", "drag frame", "animation frame"};
+
+typedef struct {
+	gint64 *nsec;
+	int count;
+	int size;
+} bench_samples;
+
+static bench_samples samples[OPS];
+
+static gint64 now_nsec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (gint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void record(int op, gint64 nsec) {
+	bench_samples *s = &samples[op];
+	if (s->count == s->size) {
+		int size = s->size ? 2 * s->size : 256;
+		gint64 *grown = realloc(s->nsec, size * sizeof(gint64));
+		if (grown == NULL) {
+			perror("Failed to grow benchmark samples");
+			return;
+		}
+		s->nsec = grown;
+		s->size = size;
+	}
+	s->nsec[s->count++] = nsec;
+}
+
+static int compare_nsec(const void *a, const void *b) {
+	gint64 x = *(const gint64 *) a;
+	gint64 y = *(const gint64 *) b;
+	return x < y ? -1 : x > y;
+}
+
+static void report(int size) {
+	int i, j;
+	for (i = 0; i < OPS; i++) {
+		bench_samples *s = &samples[i];
+		if (!s->count) {
+			continue;
+		}
+		qsort(s->nsec, s->count, sizeof(gint64), compare_nsec);
+		gint64 sum = 0;
+		for (j = 0; j < s->count; j++) {
+			sum += s->nsec[j];
+		}
+		// nearest rank percentile
+		int p99 = (99 * s->count + 99) / 100 - 1;
+		printf("%5dpx  %-22s %6d ops  %8.3f ms mean  %8.3f ms p99\n", size, op_names[i], s->count,
+		       sum / 1e6 / s->count, s->nsec[p99] / 1e6);
+		s->count = 0;
+	}
+}
+
+static void timed_full_update(cairo_t *cr, int size, int op) {
+	gint64 start = now_nsec();
+	draw_full_update(cr, size, size);
+	record(op, now_nsec() - start);
+}
+
+static void bench_repaints(cairo_t *cr, int size) {
+	int i, j;
+	for (i = 0; i < BENCH_REPAINTS; i++) {
+		// GTK clips the widget's context to the queued area
+		cairo_save(cr);
+		for (j = 0; j < 2; j++) {
+			int col = rand() % 8;
+			int row = rand() % 8;
+			cairo_rectangle_int_t square;
+			damage_square(col, row, size, size);
+			loc_to_rectangle(col, row, &square, size, size);
+			cairo_rectangle(cr, square.x, square.y, square.width, square.height);
+		}
+		cairo_clip(cr);
+
+		gint64 start = now_nsec();
+		draw_cheap_repaint(cr, size, size);
+		record(OP_CHEAP_REPAINT, now_nsec() - start);
+		cairo_restore(cr);
+	}
+}
+
+static void bench_scaled(cairo_t *cr, int size) {
+	int i;
+	for (i = 0; i < BENCH_SCALES; i++) {
+		cairo_save(cr);
+		gint64 start = now_nsec();
+		draw_scaled(cr, size * 9 / 10, size * 9 / 10);
+		record(OP_SCALED, now_nsec() - start);
+		cairo_restore(cr);
+	}
+	// back to an unscaled cache layer
+	draw_full_update(cr, size, size);
+}
+
+/* Play every move of the file with its animation, frame by frame */
+static void bench_replay(cairo_t *cr, int size, const char *pgn_path) {
+	if (open_file(pgn_path)) {
+		return;
+	}
+
+	bool played = false;
+	int token;
+	while ((token = san_scanner_lex()) != SAN_EOF_TYPE) {
+		if (token == MATCHED_TAG && played) {
+			// next game of the file
+			reset_position(main_game);
+			draw_full_update(cr, size, size);
+			played = false;
+		}
+		if (token != MATCHED_MOVE) {
+			continue;
+		}
+
+		int move[4];
+		if (!resolve_move(main_game, colorise_type(type, main_game->whose_turn), currentMoveString, move)) {
+			fprintf(stderr, "Could not resolve move %c%s, stopping replay\n", type_to_char(type), currentMoveString);
+			return;
+		}
+		chess_piece *piece = main_game->squares[move[0]][move[1]].piece;
+		char san[SAN_MOVE_SIZE];
+		int move_result = move_piece(piece, move[2], move[3], 0, AUTO_SOURCE_NO_ANIM, san, main_game, false);
+		if (move_result < 0) {
+			fprintf(stderr, "Could not play move %s, stopping replay\n", san);
+			return;
+		}
+		played = true;
+
+		struct anim_data *anim = plan_move_animation(piece, move[0], move[1], move[2], move[3], move_result, AUTO_SOURCE_NO_ANIM, size, size);
+		if (anim == NULL) {
+			continue;
+		}
+		gint64 frame_time = 1; // 0 means not started
+		gboolean more;
+		do {
+			gint64 start = now_nsec();
+			more = paint_animation_frame(anim, frame_time, size, size);
+			record(OP_ANIM_FRAME, now_nsec() - start);
+			frame_time += BENCH_FRAME_USEC;
+		} while (more == G_SOURCE_CONTINUE);
+	}
+}
+
+static chess_piece *random_live_piece(void) {
+	int i;
+	int start = rand() % 32;
+	for (i = 0; i < 32; i++) {
+		int k = (start + i) % 32;
+		chess_piece *piece = k < 16 ? &main_game->white_set[k] : &main_game->black_set[k - 16];
+		if (!piece->dead) {
+			return piece;
+		}
+	}
+	return NULL;
+}
+
+static void bench_drags(cairo_t *cr, int size) {
+	int i, j;
+	for (i = 0; i < BENCH_DRAGS; i++) {
+		chess_piece *piece = random_live_piece();
+		if (piece == NULL) {
+			return;
+		}
+		double xy[2];
+		piece_to_xy(piece, xy, size, size);
+		handle_left_mouse_down(NULL, size, size, (int) xy[0], (int) xy[1]);
+
+		for (j = 0; j < BENCH_DRAG_STEPS; j++) {
+			set_last_move_xy(rand() % size, rand() % size);
+			set_more_events_flag(true);
+			gint64 start = now_nsec();
+			paint_drag_frame(size, size);
+			record(OP_DRAG_FRAME, now_nsec() - start);
+		}
+
+		// drop it without moving, the full update puts the ghosted piece back
+		set_moveit_flag(false);
+		set_more_events_flag(false);
+		draw_full_update(cr, size, size);
+	}
+}
+
+/* Needs the main board set up with no widget, see run_render_bench in main.c */
+int render_bench(const char *pgn_path) {
+	unsigned int i;
+	int j;
+
+	// same drags on every run
+	srand(1);
+
+	printf("Offscreen rendering of '%s'\n", pgn_path);
+	for (i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++) {
+		int size = bench_sizes[i];
+		cairo_surface_t *target = cairo_image_surface_create(CAIRO_FORMAT_RGB24, size, size);
+		cairo_t *cr = cairo_create(target);
+
+		reset_position(main_game);
+		for (j = 0; j < BENCH_REBUILDS; j++) {
+			needs_update = 1;
+			timed_full_update(cr, size, OP_FULL_REBUILD);
+		}
+		for (j = 0; j < BENCH_FULL_UPDATES; j++) {
+			timed_full_update(cr, size, OP_FULL_UPDATE);
+		}
+		bench_repaints(cr, size);
+		bench_scaled(cr, size);
+		bench_replay(cr, size, pgn_path);
+		bench_drags(cr, size);
+
+		report(size);
+		cairo_destroy(cr);
+		cairo_surface_destroy(target);
+	}
+
+	for (i = 0; i < OPS; i++) {
+		free(samples[i].nsec);
+	}
+	return 0;
+}
@@ -0,0 +1,12 @@
+#ifndef CAIRO_BOARD_RENDER_BENCH_H
+#define CAIRO_BOARD_RENDER_BENCH_H
+
+/* Offscreen renderer benchmark, run with --render-bench (or the render-bench target)
+ * Replays a game with its move animations and random drags on the main board
+ * at several sizes, then prints the mean and 99th percentile time of each operation */
+
+#define RENDER_BENCH_PGN "pgn/test_kill_complex.pgn"
+
+int render_bench(const char *pgn_path);
+
+#endif //CAIRO_BOARD_RENDER_BENCH_H
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <gtk/gtk.h>
+#include <librsvg/rsvg.h>
+
+#include "cairo-board.h"
+#include "sprite-cache.h"
+
+#define SPRITE_CACHE_IDLE 4 // unused sets kept around
+
+struct _sprite_set {
+	struct _sprite_set *next;
+	const char *theme;
+	int width;
+	int height;
+	int scale; // device scale factor, sprites are width*scale x height*scale pixels
+	int refs; // boards holding the set
+	unsigned long last_used;
+	cairo_surface_t *sprites[12];
+};
+
+static sprite_set *sets = NULL;
+static unsigned long use_counter = 0;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The SVG handles must not be rendered from two threads at once
+static pthread_mutex_t raster_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Latest set asked of the worker, protected by cache_lock
+static const char *wanted_theme;
+static int wanted_width, wanted_height, wanted_scale;
+static GSourceFunc wanted_ready;
+static bool worker_running = false;
+
+/* cache_lock must be held */
+static sprite_set *find_set(const char *theme, int width, int height, int scale) {
+	sprite_set *set;
+	for (set = sets; set != NULL; set = set->next) {
+		if (set->width == width && set->height == height && set->scale == scale && !strcmp(set->theme, theme)) {
+			set->last_used = ++use_counter;
+			return set;
+		}
+	}
+	return NULL;
+}
+
+/* Free the least recently used sets nobody holds beyond SPRITE_CACHE_IDLE
+ * cache_lock must be held */
+static void trim_idle_sets(void) {
+	for (;;) {
+		int idle = 0;
+		sprite_set **oldest = NULL;
+		sprite_set **link;
+		for (link = &sets; *link != NULL; link = &(*link)->next) {
+			if ((*link)->refs) {
+				continue;
+			}
+			idle++;
+			if (oldest == NULL || (*link)->last_used < (*oldest)->last_used) {
+				oldest = link;
+			}
+		}
+		if (idle <= SPRITE_CACHE_IDLE) {
+			return;
+		}
+
+		int i;
+		sprite_set *set = *oldest;
+		*oldest = set->next;
+		for (i = 0; i < 12; i++) {
+			cairo_surface_destroy(set->sprites[i]);
+		}
+		free(set);
+	}
+}
+
+/* cache_lock must be held, takes ownership of sprites */
+static sprite_set *insert_set(const char *theme, int width, int height, int scale, cairo_surface_t *sprites[12]) {
+	int i;
+	sprite_set *set = find_set(theme, width, height, scale);
+	if (set != NULL) {
+		// rasterized concurrently, keep the one already cached
+		for (i = 0; i < 12; i++) {
+			cairo_surface_destroy(sprites[i]);
+		}
+		return set;
+	}
+
+	set = calloc(1, sizeof(sprite_set));
+	if (set == NULL) {
+		perror("Failed to allocate sprite set");
+		for (i = 0; i < 12; i++) {
+			cairo_surface_destroy(sprites[i]);
+		}
+		return NULL;
+	}
+	memcpy(set->sprites, sprites, sizeof(set->sprites));
+	set->theme = theme;
+	set->width = width;
+	set->height = height;
+	set->scale = scale;
+	set->last_used = ++use_counter;
+	set->next = sets;
+	sets = set;
+
+	trim_idle_sets();
+	return set;
+}
+
+static void rasterize(int width, int height, int scale, cairo_surface_t *sprites[12]) {
+	int i;
+	pthread_mutex_lock(&raster_lock);
+	for (i = 0; i < 12; i++) {
+		// rasterized at device resolution so HiDPI layers blit them unscaled
+		sprites[i] = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width * scale, height * scale);
+		cairo_surface_set_device_scale(sprites[i], scale, scale);
+		cairo_t *dc = cairo_create(sprites[i]);
+		cairo_scale(dc, 8 * width * svg_w, 8 * height * svg_h);
+		rsvg_handle_render_cairo(piecesSvg[i], dc);
+		cairo_destroy(dc);
+	}
+	pthread_mutex_unlock(&raster_lock);
+}
+
+/* Hold the set for that square size and scale, rasterizing it now if it isn't cached
+ * Every acquired set must be given back with sprite_cache_release, NULL if out of memory */
+sprite_set *sprite_cache_acquire(const char *theme, int width, int height, int scale) {
+	pthread_mutex_lock(&cache_lock);
+	sprite_set *set = find_set(theme, width, height, scale);
+	if (set == NULL) {
+		pthread_mutex_unlock(&cache_lock);
+		debug("Rasterizing %dx%d@%d sprites\n", width, height, scale);
+		cairo_surface_t *fresh[12];
+		rasterize(width, height, scale, fresh);
+		pthread_mutex_lock(&cache_lock);
+		set = insert_set(theme, width, height, scale, fresh);
+	}
+	if (set != NULL) {
+		set->refs++;
+	}
+	pthread_mutex_unlock(&cache_lock);
+	return set;
+}
+
+void sprite_cache_release(sprite_set *set) {
+	if (set == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&cache_lock);
+	set->refs--;
+	trim_idle_sets();
+	pthread_mutex_unlock(&cache_lock);
+}
+
+/* The sprite of a piece type, owned by the set */
+cairo_surface_t *sprite_set_surface(sprite_set *set, int type) {
+	return set->sprites[type];
+}
+
+static void *rasterize_function(void *ignored) {
+	for (;;) {
+		pthread_mutex_lock(&cache_lock);
+		const char *theme = wanted_theme;
+		int width = wanted_width;
+		int height = wanted_height;
+		int scale = wanted_scale;
+		GSourceFunc ready = wanted_ready;
+		if (find_set(theme, width, height, scale) != NULL) {
+			// nothing newer was asked for meanwhile
+			worker_running = false;
+			pthread_mutex_unlock(&cache_lock);
+			return 0;
+		}
+		pthread_mutex_unlock(&cache_lock);
+
+		debug("Rasterizing %dx%d@%d sprites in the background\n", width, height, scale);
+		cairo_surface_t *sprites[12];
+		rasterize(width, height, scale, sprites);
+
+		pthread_mutex_lock(&cache_lock);
+		insert_set(theme, width, height, scale, sprites);
+		pthread_mutex_unlock(&cache_lock);
+
+		gdk_threads_add_idle(ready, NULL);
+	}
+}
+
+/* Return true if the set for that square size and scale is cached, otherwise rasterize it
+ * on a worker thread and call ready from the main loop once it is */
+bool sprite_cache_prefetch(const char *theme, int width, int height, int scale, GSourceFunc ready) {
+	pthread_mutex_lock(&cache_lock);
+	if (find_set(theme, width, height, scale) != NULL) {
+		pthread_mutex_unlock(&cache_lock);
+		return true;
+	}
+
+	wanted_theme = theme;
+	wanted_width = width;
+	wanted_height = height;
+	wanted_scale = scale;
+	wanted_ready = ready;
+	if (!worker_running) {
+		pthread_t worker;
+		if (pthread_create(&worker, NULL, rasterize_function, NULL)) {
+			perror("Failed to start sprite rasterizer");
+			pthread_mutex_unlock(&cache_lock);
+			// let the caller rasterize synchronously
+			return true;
+		}
+		pthread_detach(worker);
+		worker_running = true;
+	}
+	pthread_mutex_unlock(&cache_lock);
+	return false;
+}
@@ -0,0 +1,21 @@
+#ifndef CAIRO_BOARD_SPRITE_CACHE_H
+#define CAIRO_BOARD_SPRITE_CACHE_H
+
+#include <stdbool.h>
+#include <gtk/gtk.h>
+
+/* Cache of rasterized piece sprite sets, keyed by theme, square size and device scale
+ * Sets are refcounted: every board of the same size shares one set, which stays cached
+ * while any board holds it. A few unused sets are kept to make resizing back cheap */
+
+typedef struct _sprite_set sprite_set;
+
+sprite_set *sprite_cache_acquire(const char *theme, int width, int height, int scale);
+
+void sprite_cache_release(sprite_set *set);
+
+cairo_surface_t *sprite_set_surface(sprite_set *set, int type);
+
+bool sprite_cache_prefetch(const char *theme, int width, int height, int scale, GSourceFunc ready);
+
+#endif //CAIRO_BOARD_SPRITE_CACHE_H
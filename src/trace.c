@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <glib.h>
+
+#include "trace.h"
+
+#define TRACE_BUFFER_EVENTS 65536 // per thread, must be a power of 2
+
+typedef struct {
+	const char *name;
+	gint64 ts; // monotonic, in microseconds
+	char phase; // 'B'egin or 'E'nd
+} trace_event;
+
+typedef struct _trace_buffer {
+	trace_event events[TRACE_BUFFER_EVENTS];
+	unsigned long head; // number of events ever recorded, only written by the owning thread
+	long tid;
+	struct _trace_buffer *next;
+} trace_buffer;
+
+bool trace_enabled = false;
+
+static char trace_file[4096];
+static gint64 trace_epoch;
+
+// all buffers ever registered, push only
+static trace_buffer *all_buffers = NULL;
+static __thread trace_buffer *my_buffer = NULL;
+
+void trace_init(const char *file_path) {
+	strncpy(trace_file, file_path, sizeof(trace_file) - 1);
+	trace_epoch = g_get_monotonic_time();
+	trace_enabled = true;
+}
+
+static trace_buffer *register_thread(void) {
+	trace_buffer *buf = calloc(1, sizeof(trace_buffer));
+	if (!buf) {
+		perror("Failed to allocate trace buffer");
+		return NULL;
+	}
+	buf->tid = syscall(SYS_gettid);
+
+	// lock-free push onto the list of buffers
+	buf->next = __atomic_load_n(&all_buffers, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&all_buffers, &buf->next, buf, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	my_buffer = buf;
+	return buf;
+}
+
+static void record(const char *name, char phase) {
+	trace_buffer *buf = my_buffer;
+	if (buf == NULL) {
+		buf = register_thread();
+		if (buf == NULL) {
+			return;
+		}
+	}
+
+	// Oldest events get overwritten once the ring is full
+	unsigned long head = buf->head;
+	trace_event *ev = &buf->events[head & (TRACE_BUFFER_EVENTS - 1)];
+	ev->name = name;
+	ev->ts = g_get_monotonic_time();
+	ev->phase = phase;
+	__atomic_store_n(&buf->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_begin(const char *name) {
+	record(name, 'B');
+}
+
+void trace_end(const char *name) {
+	record(name, 'E');
+}
+
+int trace_dump(void) {
+	if (!trace_enabled) {
+		return 0;
+	}
+
+	FILE *f = fopen(trace_file, "w");
+	if (f == NULL) {
+		perror("Failed to open trace file");
+		return 1;
+	}
+
+	int pid = getpid();
+	bool first = true;
+	fprintf(f, "{\"traceEvents\":[\n");
+
+	trace_buffer *buf;
+	for (buf = __atomic_load_n(&all_buffers, __ATOMIC_ACQUIRE); buf != NULL; buf = buf->next) {
+		unsigned long head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+		unsigned long i = head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+		for (; i < head; i++) {
+			trace_event *ev = &buf->events[i & (TRACE_BUFFER_EVENTS - 1)];
+			fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" G_GINT64_FORMAT ",\"pid\":%d,\"tid\":%ld}",
+			        first ? "" : ",\n", ev->name, ev->phase, ev->ts - trace_epoch, pid, buf->tid);
+			first = false;
+		}
+	}
+
+	fprintf(f, "\n]}\n");
+	fclose(f);
+	fprintf(stdout, "Wrote trace to %s\n", trace_file);
+	return 0;
+}
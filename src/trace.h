@@ -0,0 +1,39 @@
+#ifndef __CAIRO_BOARD_TRACE_H__
+#define __CAIRO_BOARD_TRACE_H__
+
+#include <stdbool.h>
+
+/* Lightweight begin/end tracing dumped in Chrome trace_event JSON format
+ * (load the file in chrome://tracing or https://ui.perfetto.dev)
+ * Each thread records into its own lock-free ring buffer, nothing is
+ * written out until trace_dump() */
+
+extern bool trace_enabled;
+
+void trace_init(const char *file_path);
+void trace_begin(const char *name);
+void trace_end(const char *name);
+int trace_dump(void);
+
+static inline const char *trace_scope_begin(const char *name) {
+	if (trace_enabled) {
+		trace_begin(name);
+	}
+	return name;
+}
+
+static inline void trace_scope_end(const char **name) {
+	if (trace_enabled) {
+		trace_end(*name);
+	}
+}
+
+/* Records a begin event now and the matching end event when the enclosing block exits.
+ * NB: name is kept by reference so it must be a string literal */
+#define TRACE_SCOPE(name) const char *__trace_scope __attribute__((cleanup(trace_scope_end))) = trace_scope_begin(name)
+#define TRACE_FUNCTION() TRACE_SCOPE(__FUNCTION__)
+
+#define TRACE_BEGIN(name) do { if (trace_enabled) trace_begin(name); } while (0)
+#define TRACE_END(name) do { if (trace_enabled) trace_end(name); } while (0)
+
+#endif
@@ -1,12 +1,18 @@
+#define LOG_SUBSYSTEM LOG_UCI
+
 #include <gtk/gtk.h>
 #include <regex.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 
 #include "chess-backend.h"
 #include "analysis_panel.h"
 #include "uci-adapter.h"
 #include "uci_scanner.h"
+#include "trace.h"
+#include "metrics.h"
 
 const static unsigned int STOP_TIMEOUT_SEC = 5;
 const static unsigned int READY_TIMEOUT_SEC = 3;
@@ -44,6 +50,8 @@ static bool stop_requested = 0;
 static pthread_mutex_t uci_writer_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t uci_ok_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t uci_ready_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t uci_ok_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t uci_ready_cond = PTHREAD_COND_INITIALIZER;
 static pthread_mutex_t analysing_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t stop_requested_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t all_moves_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -76,6 +84,8 @@ void cleanup_uci() {
 	pthread_mutex_destroy(&uci_writer_lock);
 	pthread_mutex_destroy(&uci_ok_lock);
 	pthread_mutex_destroy(&uci_ready_lock);
+	pthread_cond_destroy(&uci_ok_cond);
+	pthread_cond_destroy(&uci_ready_cond);
 	pthread_mutex_destroy(&analysing_lock);
 	pthread_mutex_destroy(&stop_requested_lock);
 	pthread_mutex_destroy(&all_moves_lock);
@@ -84,6 +94,7 @@ void cleanup_uci() {
 void set_uci_ok(bool val) {
 	pthread_mutex_lock(&uci_ok_lock);
 	uci_ok = val;
+	pthread_cond_broadcast(&uci_ok_cond);
 	pthread_mutex_unlock(&uci_ok_lock);
 }
 
@@ -98,6 +109,7 @@ bool is_uci_ok() {
 void set_uci_ready(bool val) {
 	pthread_mutex_lock(&uci_ready_lock);
 	uci_ready = val;
+	pthread_cond_broadcast(&uci_ready_cond);
 	pthread_mutex_unlock(&uci_ready_lock);
 }
 
@@ -161,16 +173,38 @@ void init_uci_adapter() {
 	compile_regex(&info_nps_matcher, " nps ([0-9]+)");
 	compile_regex(&info_best_line_matcher, " pv ([a-h1-8rnbq ]+)");
 
+	// Commands written here before the engine is up simply queue in the pipe
+	// until the UCI manager thread starts reading it
 	int result = pipe(uci_user_in);
 	if (result < 0) {
 		perror("Failed to create UCI manager pipe ");
 		exit(1);
 	}
+}
 
-	pthread_create(&uci_read_thread, NULL, parse_uci_function, NULL);
-	pthread_create(&uci_manager_thread, NULL, uci_manager_function, NULL);
+/* Block until *flag is true or timeout_sec elapsed (0 waits forever)
+ * Returns the final value of the flag */
+static bool wait_for_flag(pthread_mutex_t *lock, pthread_cond_t *cond, bool *flag, unsigned int timeout_sec) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout_sec;
+
+	bool val;
+	pthread_mutex_lock(lock);
+	while (!*flag) {
+		if (!timeout_sec) {
+			pthread_cond_wait(cond, lock);
+		} else if (pthread_cond_timedwait(cond, lock, &deadline) == ETIMEDOUT) {
+			break;
+		}
+	}
+	val = *flag;
+	pthread_mutex_unlock(lock);
+	return val;
 }
 
+/* Spawns the engine and performs the UCI handshake
+ * This blocks until the engine is ready so must not be called from the GTK main loop */
 int spawn_uci_engine(bool brainfish) {
 	GPid child_pid;
 	GError *spawnError = NULL;
@@ -185,6 +219,7 @@ int spawn_uci_engine(bool brainfish) {
 	}
 	argv[1] = NULL;
 
+	gint64 start = g_get_monotonic_time();
 	gboolean ret = g_spawn_async_with_pipes(g_get_home_dir(), argv, NULL, G_SPAWN_DEFAULT, NULL, NULL, &child_pid,
 	                                        &uci_in, &uci_out, &uci_err, &spawnError);
 
@@ -192,13 +227,13 @@ int spawn_uci_engine(bool brainfish) {
 		g_error("spawn_uci_engine FAILED %s", spawnError->message);
 		return -1;
 	}
+	startup_trace("engine spawn", start);
 
-	init_uci_adapter();
+	pthread_create(&uci_read_thread, NULL, parse_uci_function, NULL);
 
+	start = g_get_monotonic_time();
 	write_to_uci("uci");
-	while (!is_uci_ok()) {
-		usleep(500);
-	}
+	wait_for_flag(&uci_ok_lock, &uci_ok_cond, &uci_ok, 0);
 	debug("UCI OK!\n");
 
 	write_to_uci("setoption name Threads value 7");
@@ -210,6 +245,10 @@ int spawn_uci_engine(bool brainfish) {
 		write_to_uci("setoption name BookPath value /home/hts/brainfish/Cerebellum_Light.bin");
 	}
 	wait_for_engine_ready();
+	startup_trace("engine handshake", start);
+
+	// Only start processing queued user commands once the engine is configured
+	pthread_create(&uci_manager_thread, NULL, uci_manager_function, NULL);
 	return 0;
 }
 
@@ -406,9 +445,11 @@ void parse_move_with_ponder(char *moveText) {
 }
 
 void parse_info(char *info) {
+	TRACE_FUNCTION();
 
 	if (is_stop_requested() && is_analysing()) {
 //		debug("Skip info while stopping\n");
+		metrics_count(METRIC_UCI_INFO_DROPPED);
 		return;
 	}
 
@@ -535,6 +576,7 @@ void parse_info(char *info) {
 }
 
 void best_line_to_san(char *line, char *san) {
+	TRACE_FUNCTION();
 
 	chess_game *trans_game = game_new();
 	clone_game(main_game, trans_game);
@@ -632,6 +674,7 @@ void parse_uci_buffer(void) {
 		usleep(1000000);
 		return;
 	}
+	TRACE_SCOPE("parse_uci_buffer");
 	uci_scanner__scan_bytes(raw_buff, nread);
 //	debug("Read from UCI '%s'\n", raw_buff);
 	int i = 0;
@@ -672,6 +715,7 @@ void parse_uci_buffer(void) {
 				break;
 			}
 			case UCI_INFO: {
+				metrics_count(METRIC_UCI_INFO);
 				parse_info(uci_scanner_text);
 				break;
 			}
@@ -707,20 +751,11 @@ void write_to_uci(char *message) {
 }
 
 static void wait_for_engine_ready(void) {
-	struct timeval start, now, diff;
-
 	set_uci_ready(false);
 	write_to_uci("isready");
 
-	gettimeofday(&start, NULL);
-	while (!is_uci_ready()) {
-		usleep(10000);
-		gettimeofday(&now, NULL);
-		timersub(&now, &start, &diff);
-		if (diff.tv_sec > READY_TIMEOUT_SEC) {
-			debug("Ooops, UCI Engine did not reply to 'isready' within %d seconds, process crashed?!\n", READY_TIMEOUT_SEC);
-			break;
-		}
+	if (!wait_for_flag(&uci_ready_lock, &uci_ready_cond, &uci_ready, READY_TIMEOUT_SEC)) {
+		debug("Ooops, UCI Engine did not reply to 'isready' within %d seconds, process crashed?!\n", READY_TIMEOUT_SEC);
 	}
 }
 
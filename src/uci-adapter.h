@@ -7,6 +7,7 @@ typedef enum {
 	ENGINE_BLACK
 } UCI_MODE;
 
+void init_uci_adapter(void);
 void cleanup_uci(void);
 int spawn_uci_engine(bool brainfish);
 void write_to_uci(char *message);
@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <string.h>
+#include <gtk/gtk.h>
+
+#include "ui-queue.h"
+#include "clock-widget.h"
+#include "trace.h"
+
+// Messages posted since the last drain, newest first
+static ui_message *pending = NULL;
+
+static void apply_message(ui_message *msg) {
+	switch (msg->type) {
+		case UI_CLOCK_REFRESH:
+			refresh_one_clock(msg->clock_refresh.clock, msg->clock_refresh.black);
+			break;
+		case UI_LABEL_TEXT:
+			if (msg->label_text.markup) {
+				gtk_label_set_markup(GTK_LABEL(msg->label_text.label), msg->label_text.text);
+			} else {
+				gtk_label_set_text(GTK_LABEL(msg->label_text.label), msg->label_text.text);
+			}
+			free(msg->label_text.text);
+			break;
+		case UI_CALL:
+			msg->call.function(msg->call.data);
+			if (msg->call.free_data != NULL) {
+				msg->call.free_data(msg->call.data);
+			}
+			break;
+	}
+}
+
+/* Apply all pending messages in the order they were posted
+ * Only the main loop, or a thread holding the GDK lock, may call this */
+void ui_queue_flush(void) {
+	ui_message *msg = __atomic_exchange_n(&pending, NULL, __ATOMIC_ACQUIRE);
+
+	// reverse the stack to get the posting order back
+	ui_message *ordered = NULL;
+	while (msg != NULL) {
+		ui_message *next = msg->next;
+		msg->next = ordered;
+		ordered = msg;
+		msg = next;
+	}
+
+	while (ordered != NULL) {
+		ui_message *next = ordered->next;
+		apply_message(ordered);
+		free(ordered);
+		ordered = next;
+	}
+}
+
+static gboolean drain_function(gpointer ignored) {
+	TRACE_SCOPE("ui_queue_drain");
+	ui_queue_flush();
+	return FALSE;
+}
+
+static void post(ui_message *msg) {
+	ui_message *head = __atomic_load_n(&pending, __ATOMIC_RELAXED);
+	do {
+		msg->next = head;
+	} while (!__atomic_compare_exchange_n(&pending, &head, msg, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	if (head == NULL) {
+		// first message since the last drain, run one just before the next redraw
+		gdk_threads_add_idle_full(GDK_PRIORITY_REDRAW - 1, drain_function, NULL, NULL);
+	}
+}
+
+static ui_message *new_message(ui_message_type type) {
+	ui_message *msg = malloc(sizeof(ui_message));
+	if (msg == NULL) {
+		perror("Failed to allocate UI message");
+		return NULL;
+	}
+	msg->type = type;
+	return msg;
+}
+
+void ui_queue_clock_refresh(GtkWidget *clock, int black) {
+	ui_message *msg = new_message(UI_CLOCK_REFRESH);
+	if (msg == NULL) {
+		return;
+	}
+	msg->clock_refresh.clock = clock;
+	msg->clock_refresh.black = black;
+	post(msg);
+}
+
+void ui_queue_label_text(GtkWidget *label, const char *text, gboolean markup) {
+	ui_message *msg = new_message(UI_LABEL_TEXT);
+	if (msg == NULL) {
+		return;
+	}
+	msg->label_text.label = label;
+	msg->label_text.text = strdup(text);
+	if (msg->label_text.text == NULL) {
+		perror("Failed to copy label text");
+		free(msg);
+		return;
+	}
+	msg->label_text.markup = markup;
+	post(msg);
+}
+
+/* free_data, if not NULL, is called on data once function ran */
+void ui_queue_call(void (*function)(gpointer data), gpointer data, GDestroyNotify free_data) {
+	ui_message *msg = new_message(UI_CALL);
+	if (msg == NULL) {
+		return;
+	}
+	msg->call.function = function;
+	msg->call.data = data;
+	msg->call.free_data = free_data;
+	post(msg);
+}
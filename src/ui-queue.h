@@ -0,0 +1,42 @@
+#ifndef CAIRO_BOARD_UI_QUEUE_H
+#define CAIRO_BOARD_UI_QUEUE_H
+
+#include <gtk/gtk.h>
+
+/* Lock-free queue of UI updates posted by worker threads
+ * Any thread can post, the GTK main loop applies them in order once per
+ * iteration, just before it redraws */
+
+typedef enum {
+	UI_CLOCK_REFRESH, // repaint one side of a clock widget
+	UI_LABEL_TEXT, // set the text of a label
+	UI_CALL // run a function on the main loop
+} ui_message_type;
+
+typedef struct _ui_message {
+	struct _ui_message *next;
+	ui_message_type type;
+	union {
+		struct {
+			GtkWidget *clock;
+			int black;
+		} clock_refresh;
+		struct {
+			GtkWidget *label;
+			char *text;
+			gboolean markup;
+		} label_text;
+		struct {
+			void (*function)(gpointer data);
+			gpointer data;
+			GDestroyNotify free_data;
+		} call;
+	};
+} ui_message;
+
+void ui_queue_clock_refresh(GtkWidget *clock, int black);
+void ui_queue_label_text(GtkWidget *label, const char *text, gboolean markup);
+void ui_queue_call(void (*function)(gpointer data), gpointer data, GDestroyNotify free_data);
+void ui_queue_flush(void);
+
+#endif //CAIRO_BOARD_UI_QUEUE_H